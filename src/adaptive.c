@@ -0,0 +1,80 @@
+#include "adaptive.h"
+
+void adaptive_init(adaptive_t *adaptive, const chip8_t *chip8){
+	*adaptive = (adaptive_t){
+		.inst_per_frame = chip8->inst_per_frame,
+		.base_inst_per_frame = chip8->inst_per_frame,
+		.min_inst_per_frame = ADAPTIVE_MIN_IPS / 60,
+		.max_inst_per_frame = ADAPTIVE_MAX_IPS / 60,
+		.start_cycles = chip8->cycles,
+		.start_idle = chip8->idle_cycles,
+	};
+}
+
+bool adaptive_update(adaptive_t *adaptive, chip8_t *chip8, bool missed_deadline){
+	adaptive->missed += missed_deadline;
+	if(++adaptive->frames < ADAPTIVE_WINDOW){
+		return false;
+	}
+
+	// a reset rewinds the counters, start the window over
+	if(chip8->cycles < adaptive->start_cycles || chip8->idle_cycles < adaptive->start_idle){
+		adaptive->start_cycles = chip8->cycles;
+		adaptive->start_idle = chip8->idle_cycles;
+		adaptive->frames = adaptive->missed = 0;
+		return false;
+	}
+
+	const uint64_t executed = chip8->cycles - adaptive->start_cycles;
+	uint64_t idle = chip8->idle_cycles - adaptive->start_idle;
+	if(idle > executed){
+		idle = executed; // a loop iteration that began in the previous window
+	}
+	const uint32_t missed = adaptive->missed;
+	const uint32_t frames = adaptive->frames;
+
+	adaptive->start_cycles = chip8->cycles;
+	adaptive->start_idle = chip8->idle_cycles;
+	adaptive->frames = adaptive->missed = 0;
+
+	if(executed == 0){
+		return false; // paused or stopped at a breakpoint
+	}
+
+	adaptive->idle_ratio = (double)idle / executed;
+	uint32_t target = adaptive->inst_per_frame;
+
+	if(missed > ADAPTIVE_WINDOW / 10){
+		// host can't keep up, drop a quarter
+		target = target * 3 / 4;
+		adaptive->backed_off = true;
+	}
+	else if(idle == 0){
+		// never waits, so its speed is paced by the clock alone: keep the configured rate
+		target = (target + adaptive->base_inst_per_frame) / 2;
+		adaptive->backed_off = false;
+	}
+	else if(adaptive->idle_ratio < 0.05){
+		// barely gets to wait, its frame's work doesn't fit
+		target = target * 5 / 4 + 1;
+		adaptive->backed_off = false;
+	}
+	else{
+		// busy work per frame plus 25% headroom, moving halfway there each window
+		const uint32_t busy = (executed - idle) / frames;
+		const uint32_t wanted = busy + busy / 4 + 1;
+		target = (target + wanted) / 2;
+		adaptive->backed_off = false;
+	}
+
+	if(target < adaptive->min_inst_per_frame) target = adaptive->min_inst_per_frame;
+	if(target > adaptive->max_inst_per_frame) target = adaptive->max_inst_per_frame;
+
+	if(target == adaptive->inst_per_frame){
+		return false;
+	}
+
+	adaptive->inst_per_frame = target;
+	chip8->inst_per_frame = target;
+	return true;
+}
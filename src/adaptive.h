@@ -0,0 +1,36 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include "chip8.h"
+
+#define ADAPTIVE_WINDOW 30 // frames between adjustments
+#define ADAPTIVE_MIN_IPS 300
+#define ADAPTIVE_MAX_IPS 20000
+
+/*
+Adaptive clock. Every window it looks at how many instructions the ROM
+spent waiting (chip8->idle_cycles) and sets the instruction budget to the
+busy work plus some headroom, so each ROM runs at the lowest rate that
+keeps it at full speed. When the host misses frame deadlines it backs off.
+*/
+typedef struct {
+	uint32_t inst_per_frame; // current budget
+	uint32_t base_inst_per_frame; // configured rate, for ROMs that never wait
+	uint32_t min_inst_per_frame;
+	uint32_t max_inst_per_frame;
+
+	uint32_t frames; // frames in the current window
+	uint32_t missed; // frame deadlines missed in the current window
+	uint64_t start_cycles; // chip8->cycles when the window started
+	uint64_t start_idle; // chip8->idle_cycles when the window started
+
+	double idle_ratio; // share of the last window spent waiting
+	bool backed_off; // last change was because of host load
+} adaptive_t;
+
+void adaptive_init(adaptive_t *adaptive, const chip8_t *chip8);
+
+// Call once per frame, returns true when the budget changed
+bool adaptive_update(adaptive_t *adaptive, chip8_t *chip8, bool missed_deadline);
+
+#endif
@@ -0,0 +1,243 @@
+#include "analysis.h"
+#include "quirks.h"
+#include "timing.h"
+
+// Static analyser: control-flow graph, code and data, self-modifying stores
+
+/*
+usage: analyse <rom> [--listing FILE] [--dot FILE] [--profile NAME]
+
+	--listing FILE	annotated disassembly, - for stdout
+	--dot FILE	control-flow graph for Graphviz: dot -Tsvg FILE > cfg.svg
+	--profile NAME	quirks profile, FX55/FX65 move I under vip (default default)
+
+Prints a summary: reachable instructions, basic blocks, code and data
+bytes, stores that hit or may hit code, and how many reachable
+instructions start a superinstruction.
+*/
+
+#define TIMING_RUNS 100
+
+static const analysis_store_t *find_store(const analysis_t *analysis, uint16_t pc){
+	for(uint32_t i = 0; i < analysis->store_count; i++){
+		if(analysis->stores[i].pc == pc){
+			return &analysis->stores[i];
+		}
+	}
+	return NULL;
+}
+
+static void print_labels(FILE *out, uint8_t flags, uint16_t address){
+	if(flags & BYTE_CALLED){
+		fprintf(out, "sub_%03X:\n", address);
+	}
+	else if(flags & BYTE_TABLE){
+		fprintf(out, "table_%03X:\n", address);
+	}
+	else if(flags & BYTE_LEADER){
+		fprintf(out, "L%03X:\n", address);
+	}
+	if(flags & BYTE_POINTED){
+		fprintf(out, "data_%03X:\n", address);
+	}
+}
+
+static void print_instruction(FILE *out, const chip8_t *chip8, const analysis_t *analysis, uint16_t pc){
+	const uint16_t opcode = ram_read16(chip8, pc);
+	const uint16_t index = analysis->index[pc];
+	char mnemonic[32], note[96] = "";
+	size_t length = 0;
+	analysis_mnemonic(opcode, mnemonic, sizeof mnemonic);
+
+	const analysis_store_t *store = find_store(analysis, pc);
+	if(store && store->address == ANALYSIS_I_UNKNOWN){
+		length += snprintf(note + length, sizeof note - length, "; store through an unknown I may hit code");
+	}
+	else if(store){
+		length += snprintf(note + length, sizeof note - length, "; writes code at %03X-%03X",
+			store->address, (store->address + store->size - 1) & CHIP8_RAM_MASK);
+	}
+	else if((opcode >> 12) == 0xD || (opcode & 0xF0FF) == 0xF033 || (opcode & 0xF0FF) == 0xF055 || (opcode & 0xF0FF) == 0xF065){
+		length += snprintf(note + length, sizeof note - length, index == ANALYSIS_I_UNKNOWN ? "; I unknown" : "; I=%03X", index);
+	}
+	if((analysis->flags[pc] | analysis->flags[pc + 1]) & BYTE_WRITTEN){
+		length += snprintf(note + length, sizeof note - length, "%srewritten by a store", length ? ", " : "; ");
+	}
+	if(analysis->flags[pc + 1] & BYTE_START){
+		snprintf(note + length, sizeof note - length, "%soverlaps the instruction at %03X", length ? ", " : "; ", pc + 1);
+	}
+
+	if(note[0]){
+		fprintf(out, "%03X  %04X  %-16s%s\n", pc, opcode, mnemonic, note);
+	}
+	else{
+		fprintf(out, "%03X  %04X  %s\n", pc, opcode, mnemonic);
+	}
+}
+
+// ROM bytes that aren't code, 8 a line, lines break where a label or the kind of use changes
+static uint16_t print_data(FILE *out, const analysis_t *analysis, const uint8_t *rom, uint16_t address){
+	const uint8_t uses = BYTE_POINTED | BYTE_READ | BYTE_WRITTEN;
+	const bool used = analysis->flags[address] & uses;
+	uint16_t end = address;
+	while(end < analysis->rom_end && end - address < 8 && !(analysis->flags[end] & BYTE_CODE)
+		&& (end == address || !(analysis->flags[end] & BYTE_POINTED)) && ((analysis->flags[end] & uses) != 0) == used){
+		end++;
+	}
+
+	fprintf(out, "%03X  DB   ", address);
+	for(uint16_t a = address; a < end; a++){
+		fprintf(out, " %02X", rom[a - CHIP8_ENTRY_POINT]);
+	}
+	fprintf(out, "%*s", 3 * (8 - (end - address)) + 2, "");
+	if(!used){
+		fprintf(out, "; unreferenced\n");
+	}
+	else{
+		bool read = false, written = false;
+		for(uint16_t a = address; a < end; a++){
+			read |= analysis->flags[a] & BYTE_READ;
+			written |= analysis->flags[a] & BYTE_WRITTEN;
+		}
+		fprintf(out, "; %s\n", written ? (read ? "read and written" : "written") : read ? "read" : "pointed at");
+	}
+	return end;
+}
+
+static void write_listing(FILE *out, const chip8_t *chip8, const analysis_t *analysis){
+	size_t size;
+	const uint8_t *rom = chip8_image_rom(chip8->image, &size);
+	for(uint16_t address = 0; address < CHIP8_RAM_SIZE;){
+		const uint8_t flags = analysis->flags[address];
+		const bool in_rom = address >= CHIP8_ENTRY_POINT && address < analysis->rom_end;
+		if(flags & BYTE_START){
+			print_labels(out, flags, address);
+			print_instruction(out, chip8, analysis, address);
+			address += analysis->flags[address + 1] & BYTE_START ? 1 : 2;
+		}
+		else if(!(flags & BYTE_CODE) && in_rom){
+			print_labels(out, flags & BYTE_POINTED, address);
+			address = print_data(out, analysis, rom, address);
+		}
+		else{
+			address++;
+		}
+	}
+}
+
+static bool block_rewritten(const analysis_t *analysis, const analysis_block_t *block){
+	for(uint16_t a = block->start; a < block->end; a++){
+		if(analysis->flags[a] & BYTE_WRITTEN){
+			return true;
+		}
+	}
+	return false;
+}
+
+static void write_dot(FILE *out, const chip8_t *chip8, const analysis_t *analysis){
+	static const char *edge_style[] = {
+		[EDGE_NEXT] = "",
+		[EDGE_JUMP] = " [style=bold]",
+		[EDGE_CALL] = " [style=dashed label=call]",
+		[EDGE_SKIP] = " [label=skip]",
+		[EDGE_TABLE] = " [style=dotted label=table]",
+	};
+
+	fprintf(out, "digraph rom {\n\tnode [shape=box fontname=monospace];\n");
+	for(uint32_t b = 0; b < analysis->block_count; b++){
+		const analysis_block_t *block = &analysis->blocks[b];
+		fprintf(out, "\t\"%03X\" [label=\"", block->start);
+		for(uint16_t pc = block->start; pc < block->end; pc += 2){
+			char mnemonic[32];
+			analysis_mnemonic(ram_read16(chip8, pc), mnemonic, sizeof mnemonic);
+			fprintf(out, "%03X  %s\\l", pc, mnemonic);
+		}
+		fprintf(out, "\"%s%s];\n", analysis->flags[block->start] & BYTE_CALLED ? " peripheries=2" : "",
+			block_rewritten(analysis, block) ? " color=red" : "");
+	}
+	for(uint32_t e = 0; e < analysis->edge_count; e++){
+		const analysis_edge_t *edge = &analysis->edges[e];
+		fprintf(out, "\t\"%03X\" -> \"%03X\"%s;\n", edge->from, edge->to, edge_style[edge->kind]);
+	}
+	fprintf(out, "}\n");
+}
+
+static bool write_file(const char *path, const chip8_t *chip8, const analysis_t *analysis,
+	void (*write)(FILE *, const chip8_t *, const analysis_t *)){
+	FILE *out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+	if(!out){
+		printf("could not write %s\n", path);
+		return false;
+	}
+	write(out, chip8, analysis);
+	return out == stdout || fclose(out) == 0;
+}
+
+int main(int argc, char **argv){
+	if(argc < 2){
+		printf("usage: %s <rom> [--listing FILE] [--dot FILE] [--profile NAME]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	const char *listing = NULL, *dot = NULL;
+	quirk_profile_t profile = PROFILE_DEFAULT;
+	for(int i = 2; i < argc; i++){
+		if(strcmp(argv[i], "--listing") == 0 && i + 1 < argc){
+			listing = argv[++i];
+		}
+		else if(strcmp(argv[i], "--dot") == 0 && i + 1 < argc){
+			dot = argv[++i];
+		}
+		else if(strcmp(argv[i], "--profile") == 0 && i + 1 < argc){
+			profile = profile_from_name(argv[++i]);
+			if(profile == PROFILE_COUNT){
+				printf("unknown profile %s\n", argv[i]);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else{
+			printf("unknown option %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	chip8_t *chip8 = chip8_create(1);
+	analysis_t *analysis = malloc(sizeof *analysis);
+	if(!chip8 || !analysis || !init_chip8(chip8, argv[1])){
+		exit(EXIT_FAILURE);
+	}
+	chip8_set_quirks(chip8, profile_quirks(profile));
+
+	const double start = host_ms();
+	for(uint32_t run = 0; run < TIMING_RUNS; run++){
+		analysis_run(chip8, analysis);
+	}
+	const double us = (host_ms() - start) * 1000 / TIMING_RUNS;
+	const uint32_t fused = analysis_fused_sites(analysis, chip8);
+
+	uint32_t unknown_stores = 0;
+	for(uint32_t i = 0; i < analysis->store_count; i++){
+		unknown_stores += analysis->stores[i].address == ANALYSIS_I_UNKNOWN;
+	}
+	printf("%s: %u bytes analysed in %.0f us\n", argv[1], analysis->rom_end - CHIP8_ENTRY_POINT, us);
+	printf("%u instructions in %u blocks, %u edges\n", analysis->instructions, analysis->block_count, analysis->edge_count);
+	printf("%u code bytes, %u data bytes (%u unreferenced)\n", analysis->code_bytes, analysis->data_bytes,
+		analysis->unreferenced_bytes);
+	printf("%u stores write code, %u more store through an unknown I\n", analysis->store_count - unknown_stores, unknown_stores);
+	printf("%u reachable instructions start a superinstruction\n", fused);
+	if(analysis->truncated){
+		printf("more edges or stores than fit, some were dropped\n");
+	}
+
+	int status = EXIT_SUCCESS;
+	if(listing && !write_file(listing, chip8, analysis, write_listing)){
+		status = EXIT_FAILURE;
+	}
+	if(dot && !write_file(dot, chip8, analysis, write_dot)){
+		status = EXIT_FAILURE;
+	}
+
+	free(analysis);
+	chip8_destroy(chip8);
+	return status;
+}
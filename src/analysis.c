@@ -0,0 +1,368 @@
+#include "analysis.h"
+#include "fusion.h"
+
+#define I_UNVISITED 0xFFFE // no path has reached the instruction yet
+#define LAST_START (CHIP8_RAM_SIZE - 2) // an instruction has to fit in ram
+
+typedef struct {
+	uint16_t to;
+	analysis_edge_kind_t kind;
+	uint16_t index; // I on the way in
+} successor_t;
+
+// Addresses still to visit, each queued at most once at a time
+typedef struct {
+	uint16_t items[CHIP8_RAM_SIZE];
+	uint32_t count;
+	bool queued[CHIP8_RAM_SIZE];
+} worklist_t;
+
+static bool is_skip(uint16_t opcode){
+	switch(opcode >> 12){
+		case 0x3: case 0x4: case 0x5: case 0x9:
+			return true;
+		case 0xE:
+			return (opcode & 0xFF) == 0x9E || (opcode & 0xFF) == 0xA1;
+		default:
+			return false;
+	}
+}
+
+// Jumps, calls, returns and skips end a basic block
+static bool ends_block(uint16_t opcode){
+	return opcode == 0x00EE || (opcode >> 12) == 0x1 || (opcode >> 12) == 0x2 || (opcode >> 12) == 0xB || is_skip(opcode);
+}
+
+// I after the instruction, for the paths that fall through or jump
+static uint16_t index_after(const chip8_t *chip8, uint16_t opcode, uint16_t index){
+	const uint8_t X = (opcode >> 8) & 0xF;
+	switch(opcode >> 12){
+		case 0xA:
+			return opcode & 0xFFF;
+		case 0xF:
+			switch(opcode & 0xFF){
+				case 0x1E: case 0x29:
+					return ANALYSIS_I_UNKNOWN; // depends on VX
+				case 0x55: case 0x65:
+					if((chip8->quirks & QUIRK_LOAD_STORE_I) && index != ANALYSIS_I_UNKNOWN){
+						return (index + X + 1) & CHIP8_RAM_MASK;
+					}
+					return index;
+				default:
+					return index;
+			}
+		default:
+			return index;
+	}
+}
+
+// Where control can go after the instruction at pc, returns how many places
+static uint32_t successors(const chip8_t *chip8, uint16_t pc, uint16_t index, successor_t *out){
+	const uint16_t opcode = ram_read16(chip8, pc);
+	const uint16_t NNN = opcode & 0xFFF;
+	const uint16_t after = index_after(chip8, opcode, index);
+	uint32_t count = 0;
+
+	if(opcode == 0x00EE){
+		return 0;
+	}
+	switch(opcode >> 12){
+		case 0x1:
+			out[count++] = (successor_t){NNN, EDGE_JUMP, after};
+			return count;
+
+		case 0x2:
+			// the callee may change I before it returns
+			out[count++] = (successor_t){NNN, EDGE_CALL, after};
+			out[count++] = (successor_t){pc + 2, EDGE_NEXT, ANALYSIS_I_UNKNOWN};
+			return count;
+
+		case 0xB:
+			// V0 (or VX) picks an entry, in practice one of a run of jumps from NNN on
+			out[count++] = (successor_t){NNN, EDGE_TABLE, after};
+			for(uint16_t entry = NNN + 2; count < ANALYSIS_MAX_TABLE && entry <= LAST_START; entry += 2){
+				const uint8_t kind = ram_read16(chip8, entry) >> 12;
+				if(kind != 0x1 && kind != 0x2){
+					break;
+				}
+				out[count++] = (successor_t){entry, EDGE_TABLE, after};
+			}
+			return count;
+
+		default:
+			out[count++] = (successor_t){pc + 2, EDGE_NEXT, after};
+			if(is_skip(opcode)){
+				out[count++] = (successor_t){pc + 4, EDGE_SKIP, after};
+			}
+			return count;
+	}
+}
+
+static void push(worklist_t *work, uint16_t pc){
+	if(!work->queued[pc]){
+		work->queued[pc] = true;
+		work->items[work->count++] = pc;
+	}
+}
+
+// Visit every reachable instruction until the I values stop changing
+static void find_code(const chip8_t *chip8, analysis_t *analysis){
+	worklist_t work = {0};
+
+	analysis->index[CHIP8_ENTRY_POINT] = 0; // I after a reset
+	push(&work, CHIP8_ENTRY_POINT);
+	while(work.count){
+		const uint16_t pc = work.items[--work.count];
+		work.queued[pc] = false;
+		analysis->flags[pc] |= BYTE_CODE | BYTE_START;
+		analysis->flags[pc + 1] |= BYTE_CODE;
+
+		successor_t next[ANALYSIS_MAX_TABLE + 1];
+		const uint32_t count = successors(chip8, pc, analysis->index[pc], next);
+		for(uint32_t i = 0; i < count; i++){
+			if(next[i].to > LAST_START){
+				continue; // runs off the end of ram
+			}
+			uint16_t *index = &analysis->index[next[i].to];
+			const uint16_t merged = *index == I_UNVISITED || *index == next[i].index ? next[i].index : ANALYSIS_I_UNKNOWN;
+			if(merged != *index){
+				*index = merged;
+				push(&work, next[i].to);
+			}
+		}
+	}
+}
+
+static void mark_leaders(const chip8_t *chip8, analysis_t *analysis){
+	analysis->flags[CHIP8_ENTRY_POINT] |= BYTE_LEADER;
+	for(uint16_t pc = 0; pc <= LAST_START; pc++){
+		if(!(analysis->flags[pc] & BYTE_START)){
+			continue;
+		}
+		const uint16_t opcode = ram_read16(chip8, pc);
+		if(!ends_block(opcode)){
+			continue;
+		}
+		successor_t next[ANALYSIS_MAX_TABLE + 1];
+		const uint32_t count = successors(chip8, pc, 0, next);
+		for(uint32_t i = 0; i < count; i++){
+			if(next[i].to > LAST_START){
+				continue;
+			}
+			analysis->flags[next[i].to] |= BYTE_LEADER;
+			if(next[i].kind == EDGE_CALL){
+				analysis->flags[next[i].to] |= BYTE_CALLED;
+			}
+			else if(next[i].kind == EDGE_TABLE){
+				analysis->flags[next[i].to] |= BYTE_TABLE;
+			}
+		}
+	}
+}
+
+static void add_edge(analysis_t *analysis, uint16_t from, uint16_t to, analysis_edge_kind_t kind){
+	if(analysis->edge_count == ANALYSIS_MAX_EDGES){
+		analysis->truncated = true;
+		return;
+	}
+	analysis->edges[analysis->edge_count++] = (analysis_edge_t){from, to, kind};
+}
+
+// Runs of instructions from each leader to the next block end, and the edges leaving them
+static void build_blocks(const chip8_t *chip8, analysis_t *analysis){
+	for(uint16_t start = 0; start <= LAST_START; start++){
+		if((analysis->flags[start] & (BYTE_START | BYTE_LEADER)) != (BYTE_START | BYTE_LEADER)){
+			continue;
+		}
+		uint16_t last = start;
+		while(!ends_block(ram_read16(chip8, last)) && last + 2 <= LAST_START
+			&& (analysis->flags[last + 2] & (BYTE_START | BYTE_LEADER)) == BYTE_START){
+			last += 2;
+		}
+		analysis->blocks[analysis->block_count++] = (analysis_block_t){start, last + 2};
+
+		successor_t next[ANALYSIS_MAX_TABLE + 1];
+		const uint32_t count = successors(chip8, last, 0, next);
+		for(uint32_t i = 0; i < count; i++){
+			if(next[i].to <= LAST_START){
+				add_edge(analysis, start, next[i].to, next[i].kind);
+			}
+		}
+	}
+}
+
+static void mark_range(analysis_t *analysis, uint16_t address, uint16_t size, uint8_t flag){
+	for(uint16_t i = 0; i < size; i++){
+		analysis->flags[(address + i) & CHIP8_RAM_MASK] |= flag;
+	}
+}
+
+static bool touches_code(const analysis_t *analysis, uint16_t address, uint16_t size){
+	for(uint16_t i = 0; i < size; i++){
+		if(analysis->flags[(address + i) & CHIP8_RAM_MASK] & BYTE_CODE){
+			return true;
+		}
+	}
+	return false;
+}
+
+// Place the memory each instruction reads and writes, now that I is known where it can be
+static void find_data(const chip8_t *chip8, analysis_t *analysis){
+	for(uint16_t pc = 0; pc <= LAST_START; pc++){
+		if(!(analysis->flags[pc] & BYTE_START)){
+			continue;
+		}
+		const uint16_t opcode = ram_read16(chip8, pc);
+		const uint16_t index = analysis->index[pc];
+		const bool known = index != ANALYSIS_I_UNKNOWN;
+		const uint8_t X = (opcode >> 8) & 0xF;
+
+		uint16_t stored = 0;
+		if((opcode >> 12) == 0xA){
+			analysis->flags[opcode & 0xFFF] |= BYTE_POINTED;
+		}
+		else if((opcode >> 12) == 0xD && known){
+			mark_range(analysis, index, opcode & 0xF, BYTE_READ);
+		}
+		else if((opcode & 0xF0FF) == 0xF065 && known){
+			mark_range(analysis, index, X + 1, BYTE_READ);
+		}
+		else if((opcode & 0xF0FF) == 0xF033){
+			stored = 3;
+		}
+		else if((opcode & 0xF0FF) == 0xF055){
+			stored = X + 1;
+		}
+
+		if(stored == 0){
+			continue;
+		}
+		if(known){
+			mark_range(analysis, index, stored, BYTE_WRITTEN);
+		}
+		if(!known || touches_code(analysis, index, stored)){
+			if(analysis->store_count == ANALYSIS_MAX_STORES){
+				analysis->truncated = true;
+				continue;
+			}
+			analysis->stores[analysis->store_count++] = (analysis_store_t){pc, index, stored};
+		}
+	}
+}
+
+void analysis_run(const chip8_t *chip8, analysis_t *analysis){
+	memset(analysis, 0, sizeof *analysis);
+	for(uint32_t i = 0; i < CHIP8_RAM_SIZE; i++){
+		analysis->index[i] = I_UNVISITED;
+	}
+	size_t rom_size = 0;
+	if(chip8->image){
+		chip8_image_rom(chip8->image, &rom_size);
+	}
+	analysis->rom_end = CHIP8_ENTRY_POINT + rom_size;
+
+	find_code(chip8, analysis);
+	mark_leaders(chip8, analysis);
+	build_blocks(chip8, analysis);
+	find_data(chip8, analysis);
+
+	for(uint32_t i = 0; i < CHIP8_RAM_SIZE; i++){
+		if(analysis->index[i] == I_UNVISITED){
+			analysis->index[i] = ANALYSIS_I_UNKNOWN;
+		}
+		analysis->instructions += (analysis->flags[i] & BYTE_START) != 0;
+	}
+	for(uint16_t a = CHIP8_ENTRY_POINT; a < analysis->rom_end; a++){
+		const uint8_t flags = analysis->flags[a];
+		if(flags & BYTE_CODE){
+			analysis->code_bytes++;
+			continue;
+		}
+		analysis->data_bytes++;
+		analysis->unreferenced_bytes += !(flags & (BYTE_POINTED | BYTE_READ | BYTE_WRITTEN));
+	}
+}
+
+void analysis_mnemonic(uint16_t opcode, char *out, size_t size){
+	const uint8_t X = (opcode >> 8) & 0xF, Y = (opcode >> 4) & 0xF, N = opcode & 0xF, NN = opcode & 0xFF;
+	const uint16_t NNN = opcode & 0xFFF;
+	static const char *alu[16] = {
+		[0x0] = "LD", [0x1] = "OR", [0x2] = "AND", [0x3] = "XOR", [0x4] = "ADD",
+		[0x5] = "SUB", [0x6] = "SHR", [0x7] = "SUBN", [0xE] = "SHL",
+	};
+
+	switch(opcode >> 12){
+		case 0x0:
+			if(opcode == 0x00E0){
+				snprintf(out, size, "CLS");
+			}
+			else if(opcode == 0x00EE){
+				snprintf(out, size, "RET");
+			}
+			else{
+				snprintf(out, size, "SYS %03X", NNN);
+			}
+			return;
+		case 0x1: snprintf(out, size, "JP %03X", NNN); return;
+		case 0x2: snprintf(out, size, "CALL %03X", NNN); return;
+		case 0x3: snprintf(out, size, "SE V%X, %02X", X, NN); return;
+		case 0x4: snprintf(out, size, "SNE V%X, %02X", X, NN); return;
+		case 0x6: snprintf(out, size, "LD V%X, %02X", X, NN); return;
+		case 0x7: snprintf(out, size, "ADD V%X, %02X", X, NN); return;
+		case 0xA: snprintf(out, size, "LD I, %03X", NNN); return;
+		case 0xB: snprintf(out, size, "JP V0, %03X", NNN); return;
+		case 0xC: snprintf(out, size, "RND V%X, %02X", X, NN); return;
+		case 0xD: snprintf(out, size, "DRW V%X, V%X, %X", X, Y, N); return;
+		case 0x5:
+			if(N == 0){
+				snprintf(out, size, "SE V%X, V%X", X, Y);
+				return;
+			}
+			break;
+		case 0x9:
+			if(N == 0){
+				snprintf(out, size, "SNE V%X, V%X", X, Y);
+				return;
+			}
+			break;
+		case 0x8:
+			if(alu[N]){
+				snprintf(out, size, "%s V%X, V%X", alu[N], X, Y);
+				return;
+			}
+			break;
+		case 0xE:
+			if(NN == 0x9E || NN == 0xA1){
+				snprintf(out, size, "%s V%X", NN == 0x9E ? "SKP" : "SKNP", X);
+				return;
+			}
+			break;
+		case 0xF:
+			switch(NN){
+				case 0x07: snprintf(out, size, "LD V%X, DT", X); return;
+				case 0x0A: snprintf(out, size, "LD V%X, K", X); return;
+				case 0x15: snprintf(out, size, "LD DT, V%X", X); return;
+				case 0x18: snprintf(out, size, "LD ST, V%X", X); return;
+				case 0x1E: snprintf(out, size, "ADD I, V%X", X); return;
+				case 0x29: snprintf(out, size, "LD F, V%X", X); return;
+				case 0x33: snprintf(out, size, "LD B, V%X", X); return;
+				case 0x55: snprintf(out, size, "LD [I], V%X", X); return;
+				case 0x65: snprintf(out, size, "LD V%X, [I]", X); return;
+				default: break;
+			}
+			break;
+		default:
+			break;
+	}
+	snprintf(out, size, "DW %04X", opcode); // not an instruction
+}
+
+uint32_t analysis_fused_sites(const analysis_t *analysis, const chip8_t *chip8){
+	uint32_t sites = 0;
+	for(uint16_t pc = 0; pc <= LAST_START; pc++){
+		if(analysis->flags[pc] & BYTE_START){
+			sites += fusion_decode(chip8, pc) != FUSE_NONE;
+		}
+	}
+	return sites;
+}
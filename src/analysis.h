@@ -0,0 +1,90 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "chip8.h"
+
+/*
+Static analysis of a loaded ROM, without running it. Every instruction
+reachable from 0x200 is found by following fall through, 1NNN jumps, 2NNN
+calls (and their return), both ways out of the skips, and BNNN jump tables
+(the NNN entry and the jumps laid out after it). The value of I before
+each instruction is worked out where every path agrees on it, so sprite
+reads, FX65 loads and FX33/FX55 stores can be placed: bytes that are read
+are data, and a store over reachable code is self-modifying. The
+reachable instructions are split into basic blocks joined by edges, the
+control-flow graph.
+*/
+
+#define ANALYSIS_I_UNKNOWN 0xFFFF // I differs between the paths reaching an instruction
+#define ANALYSIS_MAX_BLOCKS CHIP8_RAM_SIZE // instructions can start at odd addresses too
+#define ANALYSIS_MAX_EDGES (CHIP8_RAM_SIZE * 2)
+#define ANALYSIS_MAX_STORES 256
+#define ANALYSIS_MAX_TABLE 128 // BNNN entries followed, V0 can only reach 128 jumps
+
+// Per byte of ram
+typedef enum {
+	BYTE_CODE = 1 << 0, // part of a reachable instruction
+	BYTE_START = 1 << 1, // a reachable instruction starts here
+	BYTE_LEADER = 1 << 2, // a basic block starts here
+	BYTE_CALLED = 1 << 3, // 2NNN target
+	BYTE_POINTED = 1 << 4, // ANNN target
+	BYTE_READ = 1 << 5, // read by DXYN or FX65 with I known
+	BYTE_WRITTEN = 1 << 6, // stored to by FX33 or FX55 with I known
+	BYTE_TABLE = 1 << 7, // BNNN jump table entry
+} analysis_byte_t;
+
+typedef enum {
+	EDGE_NEXT, // falls through, or returns from a call
+	EDGE_JUMP, // 1NNN
+	EDGE_CALL, // 2NNN
+	EDGE_SKIP, // a skip taken
+	EDGE_TABLE, // BNNN into its table
+} analysis_edge_kind_t;
+
+typedef struct {
+	uint16_t from; // start of the block it leaves
+	uint16_t to; // start of the block it enters
+	analysis_edge_kind_t kind;
+} analysis_edge_t;
+
+typedef struct {
+	uint16_t start;
+	uint16_t end; // one past its last instruction
+} analysis_block_t;
+
+// FX33 or FX55 that hits reachable code, or whose I isn't known and so might
+typedef struct {
+	uint16_t pc;
+	uint16_t address; // first byte stored, ANALYSIS_I_UNKNOWN if not known
+	uint16_t size;
+} analysis_store_t;
+
+typedef struct {
+	uint8_t flags[CHIP8_RAM_SIZE]; // analysis_byte_t
+	uint16_t index[CHIP8_RAM_SIZE]; // I before each reachable instruction
+	uint16_t rom_end; // one past the last ROM byte
+
+	analysis_block_t blocks[ANALYSIS_MAX_BLOCKS];
+	uint32_t block_count;
+	analysis_edge_t edges[ANALYSIS_MAX_EDGES];
+	uint32_t edge_count;
+	analysis_store_t stores[ANALYSIS_MAX_STORES];
+	uint32_t store_count;
+
+	uint32_t instructions;
+	uint32_t code_bytes; // ROM bytes in reachable instructions
+	uint32_t data_bytes; // the rest of the ROM
+	uint32_t unreferenced_bytes; // data no instruction is known to touch: dead code, or tables reached through FX1E
+	bool truncated; // more edges or stores than fit, the rest were dropped
+} analysis_t;
+
+// Analyse the ROM loaded in chip8 under its quirks
+void analysis_run(const chip8_t *chip8, analysis_t *analysis);
+
+// Cowgod style mnemonic such as "LD V3, 0A"
+void analysis_mnemonic(uint16_t opcode, char *out, size_t size);
+
+// Reachable instructions that start a superinstruction
+uint32_t analysis_fused_sites(const analysis_t *analysis, const chip8_t *chip8);
+
+#endif
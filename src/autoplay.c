@@ -0,0 +1,287 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+#include "quirks.h"
+#include "replay.h"
+#include "search.h"
+#include "timing.h"
+
+// Plays a ROM headless by searching keypad inputs for the best score
+
+/*
+usage: autoplay <rom> [options]
+
+	--score TERMS		what to maximise, comma separated TERM[*WEIGHT] (default alive)
+				vX: register VX, ram:ADDR: byte at hex ADDR, pixels: lit pixels,
+				alive: 1 while the machine hasn't faulted
+	--keys MASKS		comma separated hex keypad masks to try (default none and every single key)
+	--width W		states kept after each step (default 64)
+	--depth D		steps (default 100)
+	--frames F		frames each input is held (default 6)
+	--rollouts R		score states by R random playouts (default 0)
+	--rollout-steps S	steps in each playout (default 10)
+	--threads N		worker threads (default one per core)
+	--profile NAME		quirks profile (default default)
+	--seed N		CXNN and playout seed (default 1)
+	--record FILE		write the best input sequence as a replay, watch it with --replay
+
+Brix: --score vE*1000,v5 --keys 0,10,40 keeps the balls and scores the bricks.
+*/
+
+#define MAX_TERMS 16
+
+typedef enum {
+	TERM_REGISTER,
+	TERM_RAM,
+	TERM_PIXELS,
+	TERM_ALIVE,
+} term_kind_t;
+
+typedef struct {
+	term_kind_t kind;
+	uint16_t address; // register or ram address
+	int64_t weight;
+} term_t;
+
+typedef struct {
+	term_t terms[MAX_TERMS];
+	uint32_t count;
+} score_t;
+
+static int64_t score_machine(const chip8_t *chip8, void *user){
+	const score_t *score = user;
+	int64_t total = 0;
+	for(uint32_t i = 0; i < score->count; i++){
+		const term_t *term = &score->terms[i];
+		int64_t value = 0;
+		switch(term->kind){
+			case TERM_REGISTER:
+				value = chip8->V[term->address];
+				break;
+			case TERM_RAM:
+				value = ram_read(chip8, term->address);
+				break;
+			case TERM_PIXELS:
+				for(uint32_t y = 0; y < CHIP8_HEIGHT; y++){
+					value += __builtin_popcountll(chip8->display[y]);
+				}
+				break;
+			case TERM_ALIVE:
+				value = chip8->state != FAULTED;
+				break;
+		}
+		total += value * term->weight;
+	}
+	return total;
+}
+
+static bool parse_score(char *spec, score_t *score){
+	score->count = 0;
+	for(char *save, *token = strtok_r(spec, ",", &save); token; token = strtok_r(NULL, ",", &save)){
+		if(score->count == MAX_TERMS){
+			return false;
+		}
+		term_t *term = &score->terms[score->count++];
+		term->weight = 1;
+		char *star = strchr(token, '*');
+		if(star){
+			*star = '\0';
+			term->weight = strtoll(star + 1, NULL, 10);
+		}
+
+		char *end;
+		if(strcmp(token, "pixels") == 0){
+			term->kind = TERM_PIXELS;
+		}
+		else if(strcmp(token, "alive") == 0){
+			term->kind = TERM_ALIVE;
+		}
+		else if(strncmp(token, "ram:", 4) == 0){
+			term->kind = TERM_RAM;
+			term->address = strtoul(token + 4, &end, 16);
+			if(*end || end == token + 4 || term->address >= CHIP8_RAM_SIZE){
+				return false;
+			}
+		}
+		else if((token[0] == 'v' || token[0] == 'V') && token[1] && !token[2]){
+			term->kind = TERM_REGISTER;
+			term->address = strtoul(token + 1, &end, 16);
+			if(*end){
+				return false;
+			}
+		}
+		else{
+			return false;
+		}
+	}
+	return score->count > 0;
+}
+
+static uint32_t parse_keys(char *list, uint16_t *actions, uint32_t max){
+	uint32_t count = 0;
+	for(char *save, *token = strtok_r(list, ",", &save); token && count < max; token = strtok_r(NULL, ",", &save)){
+		char *end;
+		actions[count++] = strtoul(token, &end, 16);
+		if(*end){
+			return 0;
+		}
+	}
+	return count;
+}
+
+// Play the inputs from the start again, recording them if path is set
+static bool play_inputs(chip8_t *chip8, const search_config_t *config, const search_result_t *result, const char *path){
+	replay_recorder_t recorder = {0};
+	if(path && !replay_record_start(&recorder, path, chip8, 1)){
+		return false;
+	}
+	for(uint32_t s = 0; s < result->steps; s++){
+		chip8_set_keys(chip8, result->inputs[s]);
+		for(uint32_t f = 0; f < config->frames_per_step && chip8->state == RUNNING; f++){
+			replay_record_frame(&recorder, chip8);
+			replay_record_keys(&recorder, chip8);
+			chip8_run_frame_part(chip8, 0, 1);
+			chip8_update_timers(chip8);
+			replay_record_end_frame(&recorder, chip8);
+		}
+	}
+	return !recorder.file || replay_record_stop(&recorder, chip8);
+}
+
+static void print_inputs(const search_result_t *result){
+	printf("inputs (keys x steps):");
+	for(uint32_t s = 0; s < result->steps;){
+		uint32_t run = 1;
+		while(s + run < result->steps && result->inputs[s + run] == result->inputs[s]){
+			run++;
+		}
+		printf(" %04X x%u", result->inputs[s], run);
+		s += run;
+	}
+	printf("\n");
+}
+
+int main(int argc, char **argv){
+	if(argc < 2){
+		printf("usage: %s <rom> [--score TERMS] [--keys MASKS] [--width W] [--depth D] [--frames F]\n"
+			"\t[--rollouts R] [--rollout-steps S] [--threads N] [--profile NAME] [--seed N] [--record FILE]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	uint16_t actions[17] = {0};
+	for(uint32_t key = 0; key < 16; key++){
+		actions[key + 1] = 1 << key;
+	}
+	score_t score;
+	char default_score[] = "alive";
+	parse_score(default_score, &score);
+	search_config_t config = {
+		.width = 64,
+		.depth = 100,
+		.frames_per_step = 6,
+		.actions = actions,
+		.action_count = 17,
+		.rollout_steps = 10,
+		.threads = cores > 0 ? cores : 1,
+		.seed = 1,
+		.score = score_machine,
+		.user = &score,
+	};
+	quirk_profile_t profile = PROFILE_DEFAULT;
+	const char *record = NULL;
+
+	for(int i = 2; i < argc; i++){
+		if(i + 1 == argc){
+			printf("%s needs a value\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+		const char *option = argv[i];
+		char *value = argv[++i];
+		bool ok = true;
+
+		if(strcmp(option, "--score") == 0){
+			ok = parse_score(value, &score);
+		}
+		else if(strcmp(option, "--keys") == 0){
+			ok = (config.action_count = parse_keys(value, actions, 17)) > 0;
+		}
+		else if(strcmp(option, "--width") == 0){
+			ok = (config.width = strtoul(value, NULL, 10)) > 0;
+		}
+		else if(strcmp(option, "--depth") == 0){
+			ok = (config.depth = strtoul(value, NULL, 10)) > 0;
+		}
+		else if(strcmp(option, "--frames") == 0){
+			ok = (config.frames_per_step = strtoul(value, NULL, 10)) > 0;
+		}
+		else if(strcmp(option, "--rollouts") == 0){
+			config.rollouts = strtoul(value, NULL, 10);
+		}
+		else if(strcmp(option, "--rollout-steps") == 0){
+			config.rollout_steps = strtoul(value, NULL, 10);
+		}
+		else if(strcmp(option, "--threads") == 0){
+			ok = (config.threads = strtoul(value, NULL, 10)) > 0;
+		}
+		else if(strcmp(option, "--profile") == 0){
+			ok = (profile = profile_from_name(value)) != PROFILE_COUNT;
+		}
+		else if(strcmp(option, "--seed") == 0){
+			config.seed = strtoul(value, NULL, 10);
+		}
+		else if(strcmp(option, "--record") == 0){
+			record = value;
+		}
+		else{
+			printf("unknown option %s\n", option);
+			exit(EXIT_FAILURE);
+		}
+
+		if(!ok){
+			printf("bad value for %s: %s\n", option, value);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	chip8_t *chip8 = chip8_create(config.seed);
+	if(!chip8 || !init_chip8(chip8, argv[1])){
+		exit(EXIT_FAILURE);
+	}
+	chip8_set_quirks(chip8, profile_quirks(profile));
+
+	search_result_t result;
+	const double start = host_ms();
+	if(!search_run(chip8, &config, &result)){
+		exit(EXIT_FAILURE);
+	}
+	const double seconds = (host_ms() - start) / 1000;
+
+	printf("width %u, depth %u, %u actions, %u frames a step, %u threads\n", config.width, config.depth,
+		config.action_count, config.frames_per_step, config.threads);
+	printf("%llu states in %.2f s: %.0f states/s, %.0f frames/s, %llu duplicates dropped\n",
+		(unsigned long long)result.states, seconds, result.states / seconds, result.frames / seconds,
+		(unsigned long long)result.duplicates);
+	printf("%u machines held, %zu bytes each on average (%zu KB)\n", result.nodes, result.node_bytes,
+		result.nodes * result.node_bytes / 1024);
+	printf("best score %lld after %u steps (%u frames)\n", (long long)result.score, result.steps,
+		result.steps * config.frames_per_step);
+	print_inputs(&result);
+
+	// the search holds no inputs history per machine, so check the path really gets there
+	int status = EXIT_SUCCESS;
+	if(!play_inputs(chip8, &config, &result, record)){
+		status = EXIT_FAILURE;
+	}
+	else if(config.rollouts == 0 && score_machine(chip8, &score) != result.score){
+		printf("playing the inputs back scores %lld\n", (long long)score_machine(chip8, &score));
+		status = EXIT_FAILURE;
+	}
+	else if(record){
+		printf("recorded to %s\n", record);
+	}
+
+	search_result_free(&result);
+	chip8_destroy(chip8);
+	return status;
+}
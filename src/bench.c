@@ -0,0 +1,635 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "scaler.h"
+#include "persist.h"
+#include "text.h"
+#include "chip8.h"
+#include "journal.h"
+#include "replay.h"
+#include "search.h"
+#include "timing.h"
+
+// Micro benchmarks for the hot paths, run with `make bench`
+
+// Time every upscaling filter at a few output sizes
+static void bench_scaler(void){
+	const uint32_t frames = 500;
+	const uint32_t scales[] = {10, 20, 30}; // 640x320, 1280x640, 1920x960
+
+	uint8_t display[64*32];
+	for(uint32_t i = 0; i < sizeof display; i++){
+		display[i] = rand() % 2;
+	}
+
+	uint32_t palette[256];
+	palette[0] = 0x000000FF;
+	for(uint32_t i = 1; i < 256; i++){
+		palette[i] = 0xFFFFFFFF;
+	}
+
+	printf("scaler (ms per frame)\n");
+	for(uint32_t s = 0; s < sizeof scales / sizeof scales[0]; s++){
+		const uint32_t scale = scales[s];
+		uint32_t *out = malloc(64*scale * 32*scale * sizeof(uint32_t));
+		if(!out){
+			exit(EXIT_FAILURE);
+		}
+
+		for(filter_t f = 0; f < FILTER_COUNT; f++){
+			scaler_t scaler;
+			if(!scaler_init(&scaler, f, 64, 32, scale, true)){
+				exit(EXIT_FAILURE);
+			}
+
+			const double start = host_ms();
+			for(uint32_t i = 0; i < frames; i++){
+				display[i % sizeof display] ^= 1;
+				scaler_run(&scaler, display, palette, out, 64*scale);
+			}
+			const double elapsed = host_ms() - start;
+
+			printf("  %4ux%-4u %-9s %.4f\n", 64*scale, 32*scale, filter_name(f), elapsed / frames);
+			scaler_free(&scaler);
+		}
+		free(out);
+	}
+}
+
+// Time the flicker reduction stages
+static void bench_persist(void){
+	const uint32_t frames = 20000;
+	static persist_t persist;
+
+	uint8_t display[PERSIST_PIXELS];
+	for(uint32_t i = 0; i < sizeof display; i++){
+		display[i] = rand() % 2;
+	}
+
+	printf("persistence (us per frame)\n");
+	const struct {persist_mode_t mode; const char *name;} modes[] = {
+		{PERSIST_PHOSPHOR, "phosphor"},
+		{PERSIST_BLEND, "blend x2"},
+		{PERSIST_BLEND, "blend x8"},
+	};
+	for(uint32_t m = 0; m < sizeof modes / sizeof modes[0]; m++){
+		persist_init(&persist, modes[m].mode, 160, m == 2 ? 8 : 2);
+
+		uint32_t sum = 0;
+		const double start = host_ms();
+		for(uint32_t i = 0; i < frames; i++){
+			display[i % sizeof display] ^= 1;
+			sum += persist_apply(&persist, display)[i % sizeof display];
+		}
+		const double elapsed = host_ms() - start;
+
+		printf("  %-9s %.3f (%u)\n", modes[m].name, elapsed * 1000 / frames, sum & 1);
+	}
+}
+
+/*
+The HUD's CPU side: format its seven lines and draw them into its 104x45
+texture buffer, done once every 30 frames while it is shown. Copying the
+texture onto the window is left to the GPU.
+*/
+static void bench_hud(void){
+	const uint32_t updates = 20000, period = 30, width = 104, height = 45;
+	static uint32_t pixels[104 * 45];
+
+	const double start = host_ms();
+	for(uint32_t u = 0; u < updates; u++){
+		for(uint32_t i = 0; i < width * height; i++){
+			pixels[i] = 0x000000B0;
+		}
+		char line[24];
+		for(uint32_t i = 0; i < 7; i++){
+			snprintf(line, sizeof line, "FRAME MS %5.2f %5.2f", 16.0 + u % 7, 1.0 / (i + 1));
+			text_draw(pixels, width, 2, 2 + i*TEXT_LINE, line, 0xFFFFFFFF);
+		}
+	}
+	const double update_us = (host_ms() - start) * 1000 / updates;
+
+	printf("hud (us per update, %u frames apart)\n", period);
+	printf("  %.2f, %.4f%% of a 16.67 ms frame (%u)\n", update_us, update_us / period / 16667 * 100, pixels[width * 3 + 3] & 1);
+}
+
+// Interpreter throughput on the bundled ROMs, headless
+static const char *bench_roms[] = {
+	"roms/test_opcode.ch8",
+	"roms/BC_test.ch8",
+	"roms/Brix [Andreas Gustafsson, 1990].ch8",
+	"roms/Tank.ch8",
+	"roms/Tetris [Fran Dachille, 1991].ch8",
+};
+
+static size_t read_rom(const char *path, uint8_t *rom, size_t max){
+	FILE *file = fopen(path, "rb");
+	if(!file){
+		return 0;
+	}
+	const size_t size = fread(rom, 1, max, file);
+	fclose(file);
+	return size;
+}
+
+// Run frames of a ROM, returns the best MIPS of 3 runs and leaves the last machine in *out
+static double run_interpreter(const uint8_t *rom, size_t size, uint32_t frames, bool fusion, journal_t *journal, chip8_t **out){
+	double best = 0;
+	for(uint32_t run = 0; run < 3; run++){
+		chip8_t *chip8 = chip8_create(1);
+		chip8_set_fusion(chip8, fusion);
+		chip8->journal = journal;
+		chip8_load_rom_mem(chip8, rom, size);
+		chip8_set_clock(chip8, 10000);
+
+		const double start = host_ms();
+		for(uint32_t i = 0; i < frames; i++){
+			chip8_set_keys(chip8, (i / 60) % 7 == 0 ? 1 << ((i / 420) % 16) : 0);
+			chip8_run_frame(chip8);
+		}
+		const double mips = chip8->cycles / (host_ms() - start) / 1000;
+		best = mips > best ? mips : best;
+
+		if(run < 2){
+			chip8_destroy(chip8);
+		}
+		else{
+			*out = chip8;
+		}
+	}
+	return best;
+}
+
+static bool same_ram(const chip8_t *a, const chip8_t *b){
+	for(uint32_t page = 0; page < CHIP8_PAGES; page++){
+		if(memcmp(a->pages[page], b->pages[page], CHIP8_PAGE_SIZE) != 0){
+			return false;
+		}
+	}
+	return true;
+}
+
+// Same registers, timers, memory and screen, and the same instruction and idle counts
+static bool same_machine(const chip8_t *a, const chip8_t *b){
+	return a->PC == b->PC && a->I == b->I && a->SP == b->SP && a->cycles == b->cycles
+		&& a->idle_cycles == b->idle_cycles && a->delay_timer == b->delay_timer
+		&& memcmp(a->V, b->V, sizeof a->V) == 0 && same_ram(a, b)
+		&& memcmp(a->display, b->display, sizeof a->display) == 0 && memcmp(a->stack, b->stack, sizeof a->stack) == 0;
+}
+
+static void bench_interpreter(void){
+	const uint32_t frames = 20000;
+
+	printf("interpreter (million instructions per second, %u frames at 10000 IPS)\n", frames);
+	printf("  %-42s %8s %8s %8s %8s\n", "", "plain", "fused", "speedup", "fused %");
+	for(uint32_t r = 0; r < sizeof bench_roms / sizeof bench_roms[0]; r++){
+		uint8_t rom[4096];
+		const size_t size = read_rom(bench_roms[r], rom, sizeof rom);
+		if(size == 0){
+			printf("  could not read %s\n", bench_roms[r]);
+			continue;
+		}
+
+		chip8_t *plain, *fused;
+		const double plain_mips = run_interpreter(rom, size, frames, false, NULL, &plain);
+		const double fused_mips = run_interpreter(rom, size, frames, true, NULL, &fused);
+
+		printf("  %-42s %8.2f %8.2f %7.2fx %7.1f%%%s\n", bench_roms[r], plain_mips, fused_mips,
+			fused_mips / plain_mips, 100.0 * fused->fused_cycles / fused->cycles,
+			same_machine(plain, fused) ? "" : "  MISMATCH");
+		chip8_destroy(plain);
+		chip8_destroy(fused);
+	}
+}
+
+/*
+Cost of the address and stack masking. The same mix of guest accesses, an
+opcode fetch, a DXY5 sprite read, FX33 stores, an FX65 load and a 2NNN/00EE
+pair, runs once through the masked accessors the interpreter uses and once
+through copies of them without the masks. Addresses and stack depths come
+from a table filled at run time and always in range, so the compiler can't
+drop the masks and the raw copies never leave ram.
+*/
+static inline uint8_t raw_read(const chip8_t *chip8, uint16_t address){
+	return chip8->pages[address >> CHIP8_PAGE_SHIFT][address & CHIP8_PAGE_MASK];
+}
+
+static inline uint16_t raw_read16(const chip8_t *chip8, uint16_t address){
+	const uint8_t *page = chip8->pages[address >> CHIP8_PAGE_SHIFT];
+	const uint16_t offset = address & CHIP8_PAGE_MASK;
+	if(offset == CHIP8_PAGE_MASK){
+		return (page[offset] << 8) | raw_read(chip8, address + 1);
+	}
+	return (page[offset] << 8) | page[offset + 1];
+}
+
+static inline void raw_write(chip8_t *chip8, uint16_t address, uint8_t value){
+	const uint8_t page = address >> CHIP8_PAGE_SHIFT;
+	if(!(chip8->private_pages & (1u << page)) && !chip8_own_page(chip8, page)){
+		return;
+	}
+	chip8->owned[page][address & CHIP8_PAGE_MASK] = value;
+}
+
+// inlined into each wrapper below, so masked is a constant and each gets its own loop
+__attribute__((always_inline))
+static inline uint32_t access_mix(chip8_t *chip8, const uint16_t *addresses, const uint8_t *depths, uint32_t count, bool masked){
+	uint32_t sum = 0;
+	for(uint32_t i = 0; i + 1 < count; i++){
+		const uint16_t pc = addresses[i], I = addresses[i + 1];
+		sum += masked ? ram_read16(chip8, pc) : raw_read16(chip8, pc);
+		for(uint16_t row = 0; row < 5; row++){
+			sum += masked ? ram_read(chip8, I + row) : raw_read(chip8, I + row);
+		}
+		const uint8_t value = I; // not sum, so every pass after the first leaves ram the same
+		const uint8_t digits[3] = {value / 100, value / 10 % 10, value % 10};
+		for(uint16_t d = 0; d < 3; d++){
+			if(masked){
+				ram_write(chip8, I + d, digits[d]);
+			}
+			else{
+				raw_write(chip8, I + d, digits[d]);
+			}
+		}
+		for(uint16_t r = 0; r < 4; r++){
+			sum += masked ? ram_read(chip8, I + r) : raw_read(chip8, I + r);
+		}
+
+		chip8->SP = depths[i];
+		if(masked){
+			chip8->stack[chip8->SP & CHIP8_STACK_MASK] = pc;
+			chip8->SP = (chip8->SP + 1) & CHIP8_STACK_MASK;
+			chip8->SP = (chip8->SP - 1) & CHIP8_STACK_MASK;
+		}
+		else{
+			chip8->stack[chip8->SP++] = pc;
+			chip8->SP--;
+		}
+		sum += chip8->stack[chip8->SP];
+	}
+	return sum;
+}
+
+__attribute__((noinline))
+static uint32_t access_mix_masked(chip8_t *chip8, const uint16_t *addresses, const uint8_t *depths, uint32_t count){
+	return access_mix(chip8, addresses, depths, count, true);
+}
+
+__attribute__((noinline))
+static uint32_t access_mix_raw(chip8_t *chip8, const uint16_t *addresses, const uint8_t *depths, uint32_t count){
+	return access_mix(chip8, addresses, depths, count, false);
+}
+
+static void bench_masking(void){
+	const uint32_t count = 1 << 16, passes = 16, runs = 15;
+
+	uint16_t *addresses = malloc(count * sizeof *addresses);
+	uint8_t *depths = malloc(count);
+	chip8_t *chip8 = chip8_create(1);
+	if(!addresses || !depths || !chip8){
+		exit(EXIT_FAILURE);
+	}
+	for(uint32_t i = 0; i < count; i++){
+		addresses[i] = CHIP8_ENTRY_POINT + rand() % (CHIP8_RAM_SIZE - CHIP8_ENTRY_POINT - 16);
+		depths[i] = rand() % CHIP8_STACK_DEPTH;
+	}
+
+	access_mix_raw(chip8, addresses, depths, count);
+
+	// alternate the two so drift in the host's clock speed hits both alike, keep the best of each
+	double best[2] = {1e9, 1e9};
+	uint32_t sums[2] = {0, 0};
+	for(uint32_t run = 0; run < runs; run++){
+		for(uint32_t masked = 0; masked < 2; masked++){
+			const double start = host_ms();
+			uint32_t sum = 0;
+			for(uint32_t pass = 0; pass < passes; pass++){
+				sum += masked ? access_mix_masked(chip8, addresses, depths, count) : access_mix_raw(chip8, addresses, depths, count);
+			}
+			const double ns = (host_ms() - start) * 1e6 / ((double)passes * (count - 1));
+			best[masked] = ns < best[masked] ? ns : best[masked];
+			sums[masked] = sum;
+		}
+	}
+
+	printf("masking (ns per fetch, DXY5, FX33, FX65, 2NNN and 00EE, best of %u)\n", runs);
+	printf("  %8s %8s %8s\n", "raw", "masked", "cost");
+	printf("  %8.2f %8.2f %7.1f%%%s\n", best[0], best[1], (best[1] / best[0] - 1) * 100,
+		sums[0] == sums[1] ? "" : "  MISMATCH");
+
+	chip8_destroy(chip8);
+	free(depths);
+	free(addresses);
+}
+
+// Undo journal cost against the plain interpreter, superinstructions off in both
+static void bench_journal(void){
+	const uint32_t frames = 20000;
+
+	journal_t journal;
+	if(!journal_open(&journal, JOURNAL_DEFAULT_ENTRIES)){
+		exit(EXIT_FAILURE);
+	}
+
+	printf("journal (million instructions per second, %u frames at 10000 IPS)\n", frames);
+	printf("  %-42s %8s %8s %8s\n", "", "plain", "journal", "bytes/op");
+	for(uint32_t r = 0; r < sizeof bench_roms / sizeof bench_roms[0]; r++){
+		uint8_t rom[4096];
+		const size_t size = read_rom(bench_roms[r], rom, sizeof rom);
+		if(size == 0){
+			continue;
+		}
+
+		chip8_t *plain, *journaled;
+		const double plain_mips = run_interpreter(rom, size, frames, false, NULL, &plain);
+		const uint64_t written = journal.head;
+		const double journal_mips = run_interpreter(rom, size, frames, false, &journal, &journaled);
+
+		// 3 identical runs went into the journal
+		printf("  %-42s %8.2f %8.2f %8.2f\n", bench_roms[r], plain_mips, journal_mips,
+			(double)(journal.head - written) * sizeof(journal_entry_t) / (3.0 * journaled->cycles));
+		chip8_destroy(plain);
+		chip8_destroy(journaled);
+	}
+
+	journal_close(&journal);
+}
+
+/*
+Perceived input latency with run-ahead: frames from a key press to the
+first shown frame that differs from the same run without the press. Every
+key is pressed at several points of the ROM, so sprite flicker phases even
+out. The mean is over the presses that change the screen within the window
+without run-ahead.
+*/
+static void bench_runahead(void){
+	const uint32_t warmup = 120, points = 8, spacing = 37, window = 30, max_ahead = 3;
+
+	printf("run-ahead (mean frames from key press to visible change, at %u IPS)\n", CHIP8_DEFAULT_IPS);
+	printf("  %-42s", "");
+	for(uint32_t ahead = 0; ahead <= max_ahead; ahead++){
+		printf(" %7u", ahead);
+	}
+	printf(" %10s\n", "us/frame");
+
+	chip8_t *base = chip8_create(1), *idle = chip8_create(1), *pressed = chip8_create(1);
+	chip8_t *idle_ahead = chip8_create(1), *pressed_ahead = chip8_create(1);
+	if(!base || !idle || !pressed || !idle_ahead || !pressed_ahead){
+		exit(EXIT_FAILURE);
+	}
+
+	for(uint32_t r = 0; r < sizeof bench_roms / sizeof bench_roms[0]; r++){
+		uint8_t rom[4096];
+		const size_t size = read_rom(bench_roms[r], rom, sizeof rom);
+		if(size == 0){
+			continue;
+		}
+
+		chip8_load_rom_mem(base, rom, size);
+		for(uint32_t i = 0; i < warmup; i++){
+			chip8_run_frame(base);
+		}
+
+		uint32_t total[max_ahead + 1];
+		memset(total, 0, sizeof total);
+		uint32_t reacting = 0;
+		for(uint32_t point = 0; point < points; point++){
+			for(uint8_t key = 0; key < 16; key++){
+				uint32_t latency[max_ahead + 1];
+				for(uint32_t ahead = 0; ahead <= max_ahead; ahead++){
+					chip8_snapshot(base, idle);
+					chip8_snapshot(base, pressed);
+					chip8_set_keys(pressed, 1 << key);
+
+					latency[ahead] = window; // no change seen
+					for(uint32_t f = 0; f < window; f++){
+						chip8_run_frame(idle);
+						chip8_run_frame(pressed);
+						chip8_run_ahead(idle, idle_ahead, ahead);
+						chip8_run_ahead(pressed, pressed_ahead, ahead);
+
+						if(memcmp(idle_ahead->display, pressed_ahead->display, sizeof idle->display) != 0){
+							latency[ahead] = f + 1;
+							break;
+						}
+					}
+				}
+
+				if(latency[0] < window){
+					for(uint32_t ahead = 0; ahead <= max_ahead; ahead++){
+						total[ahead] += latency[ahead];
+					}
+					reacting++;
+				}
+			}
+
+			for(uint32_t i = 0; i < spacing; i++){
+				chip8_run_frame(base);
+			}
+		}
+
+		printf("  %-42s", bench_roms[r]);
+		for(uint32_t ahead = 0; ahead <= max_ahead; ahead++){
+			if(reacting){
+				printf(" %7.2f", (double)total[ahead] / reacting);
+			}
+			else{
+				printf(" %7s", "-");
+			}
+		}
+
+		// what running max_ahead frames ahead costs every host frame
+		const uint32_t repeats = 1000;
+		const double start = host_ms();
+		for(uint32_t i = 0; i < repeats; i++){
+			chip8_run_ahead(base, idle_ahead, max_ahead);
+		}
+		printf(" %10.2f\n", (host_ms() - start) * 1000 / repeats);
+	}
+
+	chip8_destroy(base);
+	chip8_destroy(idle);
+	chip8_destroy(pressed);
+	chip8_destroy(idle_ahead);
+	chip8_destroy(pressed_ahead);
+}
+
+/*
+Memory held by a farm of machines running one ROM, each with a different
+key held: pages of ram and of superinstructions they wrote to are private,
+the rest (font, code, unused ram and the decoded superinstructions) is
+shared through one image. Compared with a machine before paged ram, which
+had flat ram, its own superinstruction cache and a bool a pixel.
+*/
+#define FLAT_MACHINE_BYTES 10640 // sizeof(chip8_t) then
+
+static void bench_pages(void){
+	const uint32_t machines = 64, frames = 600;
+
+	printf("paged ram (%u machines, %u frames each, %zu B a machine struct)\n", machines, frames, sizeof(chip8_t));
+	printf("  %-42s %8s %10s %8s\n", "", "private", "resident B", "flat B");
+	for(uint32_t r = 0; r < sizeof bench_roms / sizeof bench_roms[0]; r++){
+		uint8_t rom[4096];
+		const size_t size = read_rom(bench_roms[r], rom, sizeof rom);
+		chip8_image_t *image = size ? chip8_image_create(rom, size) : NULL;
+		if(!image){
+			continue;
+		}
+
+		uint32_t private_pages = 0;
+		size_t resident = 0;
+		for(uint32_t m = 0; m < machines; m++){
+			chip8_t *chip8 = chip8_create(m + 1);
+			if(!chip8){
+				exit(EXIT_FAILURE);
+			}
+			chip8_load_image(chip8, image);
+			set_keypad(chip8, m % 16, true);
+			for(uint32_t f = 0; f < frames; f++){
+				chip8_run_frame(chip8);
+			}
+
+			chip8_memory_t stats;
+			chip8_memory_stats(chip8, &stats);
+			private_pages += stats.private_pages;
+			resident += stats.resident_bytes;
+			chip8_destroy(chip8);
+		}
+		chip8_image_release(image);
+
+		// the ROM pages and the superinstructions decoded from them are stored once for the whole farm
+		const double image_bytes = (double)((size + CHIP8_PAGE_MASK) & ~(size_t)CHIP8_PAGE_MASK) + CHIP8_RAM_SIZE;
+		printf("  %-42s %8.2f %10.0f %8u\n", bench_roms[r], (double)private_pages / machines,
+			(double)resident / machines + image_bytes / machines, FLAT_MACHINE_BYTES);
+	}
+}
+
+/*
+Record an hour of Tank with scripted keys, then verify the replay segment
+by segment on more and more threads, and seek to its middle
+*/
+static void bench_replay(void){
+	const uint64_t frames = 60 * 60 * 60;
+	const uint32_t slices = 4;
+
+	uint8_t rom[4096];
+	const size_t size = read_rom("roms/Tank.ch8", rom, sizeof rom);
+	char path[] = "/tmp/chip8-bench-XXXXXX";
+	const int fd = mkstemp(path);
+	chip8_t *chip8 = chip8_create(1);
+	if(size == 0 || fd < 0 || !chip8 || !chip8_load_rom_mem(chip8, rom, size)){
+		printf("replay: could not set up\n");
+		exit(EXIT_FAILURE);
+	}
+	close(fd);
+
+	replay_recorder_t recorder;
+	if(!replay_record_start(&recorder, path, chip8, slices)){
+		exit(EXIT_FAILURE);
+	}
+	double start = host_ms();
+	for(uint64_t f = 0; f < frames; f++){
+		replay_record_frame(&recorder, chip8);
+		for(uint32_t slice = 0; slice < slices; slice++){
+			chip8_set_keys(chip8, (f / 60) % 7 == 0 && slice < 2 ? 1 << ((f / 420) % 16) : 0);
+			replay_record_keys(&recorder, chip8);
+			chip8_run_frame_part(chip8, slice, slices);
+		}
+		chip8_update_timers(chip8);
+		replay_record_end_frame(&recorder, chip8);
+	}
+	replay_record_stop(&recorder, chip8);
+	const double record_ms = host_ms() - start;
+	chip8_destroy(chip8);
+
+	replay_t replay;
+	if(!replay_open(&replay, path)){
+		exit(EXIT_FAILURE);
+	}
+	printf("replay (an hour of Tank, %u keyframes, %ld cores)\n", replay.header->keyframe_count, sysconf(_SC_NPROCESSORS_ONLN));
+	printf("  record %.0f ms\n", record_ms);
+
+	double serial_ms = 0;
+	for(uint32_t threads = 1; threads <= 8; threads *= 2){
+		uint32_t first_bad;
+		start = host_ms();
+		const uint32_t bad = replay_verify(&replay, threads, &first_bad);
+		const double elapsed = host_ms() - start;
+		if(threads == 1){
+			serial_ms = elapsed;
+		}
+		printf("  verify on %u threads %8.0f ms %6.2fx%s\n", threads, elapsed, serial_ms / elapsed, bad ? "  MISMATCH" : "");
+	}
+
+	chip8 = chip8_create(1);
+	replay_cursor_t cursor;
+	start = host_ms();
+	replay_seek(&replay, frames / 2, chip8, &cursor);
+	printf("  seek to the middle %.2f ms, from frame 0 it would be %.0f ms\n", host_ms() - start, serial_ms / 2);
+	chip8_destroy(chip8);
+
+	replay_close(&replay);
+	unlink(path);
+}
+
+// Brix: balls left in VE, bricks hit in V5
+static int64_t brix_score(const chip8_t *chip8, void *user){
+	(void)user;
+	return chip8->V[0xE] * 1000 + chip8->V[5];
+}
+
+// Beam search through Brix on more and more threads, states expanded per second and what each costs
+static void bench_search(void){
+	const uint16_t actions[] = {0x0000, 0x0010, 0x0040}; // nothing, left, right
+
+	uint8_t rom[4096];
+	const size_t size = read_rom("roms/Brix [Andreas Gustafsson, 1990].ch8", rom, sizeof rom);
+	chip8_t *chip8 = chip8_create(1);
+	if(size == 0 || !chip8 || !chip8_load_rom_mem(chip8, rom, size)){
+		printf("search: could not set up\n");
+		exit(EXIT_FAILURE);
+	}
+
+	search_config_t config = {
+		.width = 64, .depth = 200, .frames_per_step = 6, .actions = actions, .action_count = 3,
+		.score = brix_score,
+	};
+	printf("search (Brix, beam of %u, %u steps of %u frames, %ld cores)\n", config.width, config.depth,
+		config.frames_per_step, sysconf(_SC_NPROCESSORS_ONLN));
+
+	double serial = 0;
+	for(uint32_t threads = 1; threads <= 8; threads *= 2){
+		config.threads = threads;
+		search_result_t result;
+		const double start = host_ms();
+		if(!search_run(chip8, &config, &result)){
+			exit(EXIT_FAILURE);
+		}
+		const double rate = result.states / ((host_ms() - start) / 1000);
+		if(threads == 1){
+			serial = rate;
+		}
+		printf("  %u threads %9.0f states/s %6.2fx, %u nodes of %zu B, best %lld\n", threads, rate, rate / serial,
+			result.nodes, result.node_bytes, (long long)result.score);
+		search_result_free(&result);
+	}
+	chip8_destroy(chip8);
+}
+
+int main(void){
+	srand(1);
+	bench_scaler();
+	bench_persist();
+	bench_hud();
+	bench_interpreter();
+	bench_masking();
+	bench_journal();
+	bench_runahead();
+	bench_pages();
+	bench_replay();
+	bench_search();
+	return 0;
+}
@@ -0,0 +1,265 @@
+#include "capture.h"
+
+// PNG CRC-32 and zlib Adler-32
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len){
+	crc = ~crc;
+	for(size_t i = 0; i < len; i++){
+		crc ^= data[i];
+		for(uint8_t k = 0; k < 8; k++){
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+	return ~crc;
+}
+
+static uint32_t adler32(const uint8_t *data, size_t len){
+	uint32_t a = 1, b = 0;
+	for(size_t i = 0; i < len; i++){
+		a = (a + data[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	return (b << 16) | a;
+}
+
+static void put_be32(uint8_t *out, uint32_t value){
+	out[0] = value >> 24;
+	out[1] = value >> 16;
+	out[2] = value >> 8;
+	out[3] = value;
+}
+
+static void write_chunk(FILE *file, const char type[4], const uint8_t *data, uint32_t len){
+	uint8_t header[8];
+	put_be32(header, len);
+	memcpy(&header[4], type, 4);
+
+	uint8_t crc[4];
+	put_be32(crc, crc32_update(crc32_update(0, (const uint8_t *)type, 4), data, len));
+
+	fwrite(header, sizeof header, 1, file);
+	fwrite(data, len, 1, file);
+	fwrite(crc, sizeof crc, 1, file);
+}
+
+// One frame as 1 bit greyscale scanlines (filter byte + 8 bytes per row), wrapped in an uncompressed zlib stream
+#define PNG_RAW_SIZE (CAPTURE_HEIGHT * (1 + CAPTURE_WIDTH / 8))
+#define PNG_ZLIB_SIZE (2 + 5 + PNG_RAW_SIZE + 4)
+
+static void png_zlib_frame(const uint8_t *frame, uint8_t *out){
+	uint8_t raw[PNG_RAW_SIZE] = {0};
+	for(uint32_t y = 0; y < CAPTURE_HEIGHT; y++){
+		uint8_t *row = &raw[y * (1 + CAPTURE_WIDTH / 8)];
+		row[0] = 0; // no filter
+		for(uint32_t x = 0; x < CAPTURE_WIDTH; x++){
+			if(frame[y*CAPTURE_WIDTH + x]){
+				row[1 + x/8] |= 0x80 >> (x % 8);
+			}
+		}
+	}
+
+	out[0] = 0x78; // deflate, 32K window
+	out[1] = 0x01;
+	out[2] = 0x01; // final stored block
+	const uint16_t len = PNG_RAW_SIZE;
+	out[3] = len & 0xFF; // LEN and its complement, little endian
+	out[4] = len >> 8;
+	out[5] = ~len & 0xFF;
+	out[6] = (uint16_t)~len >> 8;
+	memcpy(&out[7], raw, PNG_RAW_SIZE);
+	put_be32(&out[7 + PNG_RAW_SIZE], adler32(raw, PNG_RAW_SIZE));
+}
+
+static void apng_actl(uint8_t out[8], uint32_t frames){
+	put_be32(&out[0], frames);
+	put_be32(&out[4], 0); // loop forever
+}
+
+static void apng_begin(capture_t *capture){
+	static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	fwrite(signature, sizeof signature, 1, capture->file);
+
+	uint8_t ihdr[13];
+	put_be32(&ihdr[0], CAPTURE_WIDTH);
+	put_be32(&ihdr[4], CAPTURE_HEIGHT);
+	ihdr[8] = 1; // bit depth
+	ihdr[9] = 0; // greyscale
+	ihdr[10] = 0; // deflate
+	ihdr[11] = 0; // adaptive filtering
+	ihdr[12] = 0; // no interlace
+	write_chunk(capture->file, "IHDR", ihdr, sizeof ihdr);
+
+	uint8_t actl[8];
+	apng_actl(actl, 0);
+	capture->actl_offset = ftell(capture->file);
+	write_chunk(capture->file, "acTL", actl, sizeof actl);
+}
+
+static void apng_frame(capture_t *capture, const uint8_t *frame){
+	uint8_t fctl[26] = {0};
+	put_be32(&fctl[0], capture->sequence++);
+	put_be32(&fctl[4], CAPTURE_WIDTH);
+	put_be32(&fctl[8], CAPTURE_HEIGHT);
+	// x/y offset 0
+	fctl[20] = 0; fctl[21] = 1; // delay 1/60s
+	fctl[22] = 0; fctl[23] = 60;
+	fctl[24] = 0; // dispose none
+	fctl[25] = 0; // blend source
+	write_chunk(capture->file, "fcTL", fctl, sizeof fctl);
+
+	// the first frame is the default image (IDAT), the rest are fdAT with a sequence number
+	uint8_t data[4 + PNG_ZLIB_SIZE];
+	png_zlib_frame(frame, &data[4]);
+	if(capture->written == 0){
+		write_chunk(capture->file, "IDAT", &data[4], PNG_ZLIB_SIZE);
+	}
+	else{
+		put_be32(data, capture->sequence++);
+		write_chunk(capture->file, "fdAT", data, sizeof data);
+	}
+}
+
+static void apng_end(capture_t *capture){
+	// a PNG needs its IDAT, a capture stopped before the first frame gets a blank one
+	if(capture->written == 0){
+		static const uint8_t blank[CAPTURE_WIDTH * CAPTURE_HEIGHT];
+		apng_frame(capture, blank);
+		capture->written++;
+	}
+
+	write_chunk(capture->file, "IEND", NULL, 0);
+
+	// now the frame count is known
+	uint8_t actl[8];
+	apng_actl(actl, capture->written);
+	fseek(capture->file, capture->actl_offset, SEEK_SET);
+	write_chunk(capture->file, "acTL", actl, sizeof actl);
+}
+
+static void write_frame(capture_t *capture, const uint8_t *frame){
+	switch(capture->format){
+		case CAPTURE_PBM:{
+			uint8_t bits[CAPTURE_WIDTH / 8 * CAPTURE_HEIGHT] = {0};
+			for(uint32_t i = 0; i < CAPTURE_WIDTH * CAPTURE_HEIGHT; i++){
+				if(frame[i]){
+					bits[i / 8] |= 0x80 >> (i % 8); // 1 is black in PBM
+				}
+			}
+			fprintf(capture->file, "P4\n%d %d\n", CAPTURE_WIDTH, CAPTURE_HEIGHT);
+			fwrite(bits, sizeof bits, 1, capture->file);
+			break;
+		}
+
+		case CAPTURE_Y4M:{
+			uint8_t luma[CAPTURE_WIDTH * CAPTURE_HEIGHT];
+			for(uint32_t i = 0; i < sizeof luma; i++){
+				luma[i] = frame[i] ? 235 : 16;
+			}
+			fputs("FRAME\n", capture->file);
+			fwrite(luma, sizeof luma, 1, capture->file);
+			break;
+		}
+
+		case CAPTURE_APNG:
+			apng_frame(capture, frame);
+			break;
+	}
+	capture->written++;
+}
+
+// Writer thread, sleeps until frames are queued
+static int capture_thread(void *data){
+	capture_t *capture = data;
+
+	while(true){
+		SDL_SemWait(capture->ready);
+
+		uint32_t tail = atomic_load_explicit(&capture->tail, memory_order_relaxed);
+		const uint32_t head = atomic_load_explicit(&capture->head, memory_order_acquire);
+
+		for(; tail != head; tail++){
+			write_frame(capture, capture->frames[tail % CAPTURE_QUEUE_SIZE]);
+			atomic_store_explicit(&capture->tail, tail + 1, memory_order_release);
+		}
+
+		if(atomic_load(&capture->stop) && tail == atomic_load_explicit(&capture->head, memory_order_acquire)){
+			return 0;
+		}
+	}
+}
+
+bool capture_start(capture_t *capture, const char *path){
+	memset(capture, 0, sizeof(capture_t));
+
+	const char *ext = strrchr(path, '.');
+	if(ext && strcmp(ext, ".pbm") == 0){
+		capture->format = CAPTURE_PBM;
+	}
+	else if(ext && strcmp(ext, ".y4m") == 0){
+		capture->format = CAPTURE_Y4M;
+	}
+	else if(ext && (strcmp(ext, ".png") == 0 || strcmp(ext, ".apng") == 0)){
+		capture->format = CAPTURE_APNG;
+	}
+	else{
+		SDL_Log("capture file needs a .pbm, .y4m or .png extension\n");
+		return false;
+	}
+
+	capture->file = fopen(path, "wb");
+	if(!capture->file){
+		SDL_Log("could not open capture file %s\n", path);
+		return false;
+	}
+
+	if(capture->format == CAPTURE_Y4M){
+		fprintf(capture->file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 Cmono\n", CAPTURE_WIDTH, CAPTURE_HEIGHT);
+	}
+	else if(capture->format == CAPTURE_APNG){
+		apng_begin(capture);
+	}
+
+	capture->ready = SDL_CreateSemaphore(0);
+	capture->thread = SDL_CreateThread(capture_thread, "capture", capture);
+	if(!capture->ready || !capture->thread){
+		SDL_Log("could not start capture thread %s\n", SDL_GetError());
+		fclose(capture->file);
+		capture->file = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+void capture_frame(capture_t *capture, const chip8_t *chip8){
+	const uint32_t head = atomic_load_explicit(&capture->head, memory_order_relaxed);
+	const uint32_t tail = atomic_load_explicit(&capture->tail, memory_order_acquire);
+
+	if(head - tail == CAPTURE_QUEUE_SIZE){
+		capture->dropped++; // writer is behind, never wait for it
+		return;
+	}
+
+	chip8_get_framebuffer(chip8, capture->frames[head % CAPTURE_QUEUE_SIZE]);
+	atomic_store_explicit(&capture->head, head + 1, memory_order_release);
+	capture->queued++;
+	SDL_SemPost(capture->ready);
+}
+
+void capture_stop(capture_t *capture){
+	if(!capture->file){
+		return;
+	}
+
+	atomic_store(&capture->stop, true);
+	SDL_SemPost(capture->ready);
+	SDL_WaitThread(capture->thread, NULL);
+	SDL_DestroySemaphore(capture->ready);
+
+	if(capture->format == CAPTURE_APNG){
+		apng_end(capture);
+	}
+	fclose(capture->file);
+	capture->file = NULL;
+
+	SDL_Log("captured %llu frames, dropped %llu\n", (unsigned long long)capture->written, (unsigned long long)capture->dropped);
+}
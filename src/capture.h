@@ -0,0 +1,48 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdatomic.h>
+#include "frontend.h"
+
+#define CAPTURE_QUEUE_SIZE 256 // frames buffered for the writer, power of 2
+#define CAPTURE_WIDTH 64
+#define CAPTURE_HEIGHT 32
+
+typedef enum {
+	CAPTURE_PBM, // concatenated raw (P4) PBM images
+	CAPTURE_Y4M, // YUV4MPEG2, monochrome
+	CAPTURE_APNG, // animated PNG, 1 bit greyscale
+} capture_format_t;
+
+// Video capture, frames are queued by the emulator and encoded on a writer thread
+typedef struct {
+	capture_format_t format;
+	FILE *file;
+
+	// single producer/single consumer queue
+	uint8_t frames[CAPTURE_QUEUE_SIZE][CAPTURE_WIDTH * CAPTURE_HEIGHT];
+	_Atomic uint32_t head; // next slot the emulator writes
+	_Atomic uint32_t tail; // next slot the writer reads
+	_Atomic bool stop;
+	SDL_sem *ready;
+	SDL_Thread *thread;
+
+	uint64_t queued; // emulator thread only
+	uint64_t dropped; // emulator thread only, frames lost because the queue was full
+	uint64_t written; // writer thread only
+
+	// APNG
+	uint32_t sequence; // fcTL/fdAT sequence number
+	long actl_offset; // acTL chunk, frame count is patched in at the end
+} capture_t;
+
+// Start capturing to path, the format comes from its extension (.pbm, .y4m, .png)
+bool capture_start(capture_t *capture, const char *path);
+
+// Queue the machine's display as one frame, never blocks
+void capture_frame(capture_t *capture, const chip8_t *chip8);
+
+// Drain the queue, finish the file and report frame counts
+void capture_stop(capture_t *capture);
+
+#endif
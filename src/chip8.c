@@ -1,164 +1,465 @@
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdatomic.h>
 #include "chip8.h"
-#include "sound.h"
+#include "instructions.h"
+#include "timing.h"
+#include "journal.h"
+#include "fusion.h"
+
+const uint8_t chip8_font[CHIP8_PAGE_SIZE] = {
+	0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+	0x20, 0x60, 0x20, 0x20, 0x70, // 1
+	0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+	0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+	0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+	0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+	0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+	0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+	0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+	0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+	0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+	0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+	0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+	0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+	0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+	0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+// Every page no ROM byte lands in
+static const uint8_t zero_page[CHIP8_PAGE_SIZE];
+
+struct chip8_image {
+	atomic_uint refs;
+	size_t rom_size;
+	const uint8_t *pages[CHIP8_PAGES];
+	uint8_t fused[CHIP8_RAM_SIZE]; // fuse_kind_t at every address, decoded up front so it is never written
+	uint8_t rom[]; // the pages the ROM covers, from CHIP8_ENTRY_POINT
+};
+
+// Decode the superinstructions of the whole of ram as a machine on the image sees it
+static void decode_image(chip8_image_t *image){
+	chip8_t view = {0};
+	memcpy(view.pages, image->pages, sizeof view.pages);
+	for(uint16_t address = 0; address < CHIP8_RAM_SIZE; address++){
+		image->fused[address] = fusion_decode(&view, address);
+	}
+}
 
+chip8_image_t *chip8_image_create(const uint8_t *rom, size_t size){
+	if(size > CHIP8_RAM_SIZE - CHIP8_ENTRY_POINT){
+		fprintf(stderr, "ROM FILE is Too Large to Handle\n");
+		return NULL;
+	}
 
-bool init_chip8(chip8_t *chip8, const char rom_name[]){
-	const uint32_t entry_point = 0x200;
-	const uint8_t font[] = {
-		0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-    	0x20, 0x60, 0x20, 0x20, 0x70, // 1
-    	0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-    	0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-    	0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-    	0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-    	0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-    	0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-    	0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-    	0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-    	0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-    	0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-    	0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-    	0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-    	0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-    	0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-	};
+	const size_t rom_pages = (size + CHIP8_PAGE_MASK) >> CHIP8_PAGE_SHIFT;
+	chip8_image_t *image = calloc(1, sizeof(chip8_image_t) + rom_pages * CHIP8_PAGE_SIZE);
+	if(!image){
+		fprintf(stderr, "Out of memory loading the ROM\n");
+		return NULL;
+	}
+
+	atomic_init(&image->refs, 1);
+	image->rom_size = size;
+	memcpy(image->rom, rom, size);
+	for(uint32_t page = 0; page < CHIP8_PAGES; page++){
+		image->pages[page] = zero_page;
+	}
+	image->pages[0] = chip8_font;
+	for(size_t i = 0; i < rom_pages; i++){
+		image->pages[(CHIP8_ENTRY_POINT >> CHIP8_PAGE_SHIFT) + i] = &image->rom[i * CHIP8_PAGE_SIZE];
+	}
+	decode_image(image);
+	return image;
+}
+
+const uint8_t *chip8_image_rom(const chip8_image_t *image, size_t *size){
+	*size = image->rom_size;
+	return image->rom;
+}
+
+static chip8_image_t *image_retain(chip8_image_t *image){
+	if(image){
+		atomic_fetch_add_explicit(&image->refs, 1, memory_order_relaxed);
+	}
+	return image;
+}
+
+void chip8_image_release(chip8_image_t *image){
+	if(image && atomic_fetch_sub_explicit(&image->refs, 1, memory_order_acq_rel) == 1){
+		free(image);
+	}
+}
+
+bool chip8_own_page(chip8_t *chip8, uint8_t page){
+	page &= CHIP8_PAGES - 1;
+	if(!chip8->owned[page]){
+		chip8->owned[page] = malloc(CHIP8_PAGE_SIZE);
+		if(!chip8->owned[page]){
+			fprintf(stderr, "Out of memory copying ram page %X\n", page);
+			chip8->fault = (chip8_fault_t){FAULT_MEMORY, chip8->PC, chip8->inst.opcode, page << CHIP8_PAGE_SHIFT};
+			chip8->state = FAULTED;
+			return false;
+		}
+	}
+
+	memcpy(chip8->owned[page], chip8->pages[page], CHIP8_PAGE_SIZE);
+	chip8->pages[page] = chip8->owned[page];
+	chip8->private_pages |= 1u << page;
+	chip8->code_page = CHIP8_PAGES;
+	return true;
+}
+
+bool chip8_own_fused_page(chip8_t *chip8, uint8_t page){
+	page &= CHIP8_PAGES - 1;
+	if(!chip8->owned_fused[page]){
+		chip8->owned_fused[page] = malloc(CHIP8_PAGE_SIZE);
+		if(!chip8->owned_fused[page]){
+			// the shared kinds may no longer match this machine's ram, stop using them
+			fprintf(stderr, "Out of memory copying superinstruction page %X, fusion is off\n", page);
+			chip8->fusion = false;
+			return false;
+		}
+	}
 
-	// Initialize chip8 machine
+	memcpy(chip8->owned_fused[page], chip8->fused[page], CHIP8_PAGE_SIZE);
+	chip8->fused[page] = chip8->owned_fused[page];
+	chip8->private_fused |= 1u << page;
+	return true;
+}
+
+// Map every page to the image (or zeros when there is none), dropping private copies.
+// Without an image every superinstruction is FUSE_UNKNOWN and decoded on each lookup
+static void map_image(chip8_t *chip8, chip8_image_t *image){
+	for(uint32_t page = 0; page < CHIP8_PAGES; page++){
+		chip8->pages[page] = image ? image->pages[page] : zero_page;
+		chip8->fused[page] = image ? &image->fused[page << CHIP8_PAGE_SHIFT] : zero_page;
+	}
+	chip8->private_pages = 0;
+	chip8->private_fused = 0;
+	chip8->image = image;
+	chip8->code_page = CHIP8_PAGES;
+}
+
+void chip8_memory_stats(const chip8_t *chip8, chip8_memory_t *stats){
+	*stats = (chip8_memory_t){0};
+	stats->resident_bytes = sizeof(chip8_t);
+	for(uint32_t page = 0; page < CHIP8_PAGES; page++){
+		if(chip8->private_pages & (1u << page)){
+			stats->private_pages++;
+		}
+		else{
+			stats->shared_pages++;
+		}
+		if(chip8->owned[page]){
+			stats->resident_bytes += CHIP8_PAGE_SIZE;
+		}
+		if(chip8->owned_fused[page]){
+			stats->resident_bytes += CHIP8_PAGE_SIZE;
+		}
+	}
+}
+
+chip8_t *chip8_create(uint32_t seed){
+	chip8_t *chip8 = calloc(1, sizeof(chip8_t));
+	if(!chip8){
+		return NULL;
+	}
+
+	chip8->inst_per_frame = CHIP8_DEFAULT_IPS / 60;
+	chip8->rng = seed ? seed : 1; // xorshift state must not be 0
+	chip8->fusion = true;
+	map_image(chip8, NULL);
+	return chip8;
+}
+
+void chip8_destroy(chip8_t *chip8){
+	if(!chip8){
+		return;
+	}
+
+	for(uint32_t page = 0; page < CHIP8_PAGES; page++){
+		free(chip8->owned[page]);
+		free(chip8->owned_fused[page]);
+	}
+	chip8_image_release(chip8->image);
+	free(chip8);
+}
+
+bool chip8_load_rom_mem(chip8_t *chip8, const uint8_t *rom, size_t size){
+	chip8_image_t *image = chip8_image_create(rom, size);
+	if(!image){
+		return false;
+	}
+
+	chip8_load_image(chip8, image);
+	chip8_image_release(image);
+	return true;
+}
+
+void chip8_load_image(chip8_t *chip8, chip8_image_t *image){
+	// Initialize chip8 machine, keeping attached hooks, settings and page buffers across resets
+	trace_t *trace = chip8->trace;
+	debugger_t *debugger = chip8->debugger;
+	heatmap_t *heatmap = chip8->heatmap;
+	journal_t *journal = chip8->journal;
+	const char *rom_name = chip8->rom_name;
+	const uint32_t inst_per_frame = chip8->inst_per_frame;
+	const uint32_t rng = chip8->rng;
+	const timing_t timing = chip8->timing;
+	const bool strict = chip8->strict;
+	const bool fusion = chip8->fusion;
+	const uint8_t quirks = chip8->quirks;
+	chip8_image_t *old_image = chip8->image;
+	uint8_t *owned[CHIP8_PAGES], *owned_fused[CHIP8_PAGES];
+	memcpy(owned, chip8->owned, sizeof owned);
+	memcpy(owned_fused, chip8->owned_fused, sizeof owned_fused);
 	memset(chip8, 0, sizeof(chip8_t));
+	memcpy(chip8->owned, owned, sizeof owned);
+	memcpy(chip8->owned_fused, owned_fused, sizeof owned_fused);
+	chip8->trace = trace;
+	chip8->debugger = debugger;
+	chip8->heatmap = heatmap;
+	chip8->journal = journal;
+	if(journal){
+		journal_clear(journal); // the old program's history can't be undone into this one
+	}
+	chip8->rom_name = rom_name;
+	chip8->inst_per_frame = inst_per_frame ? inst_per_frame : CHIP8_DEFAULT_IPS / 60;
+	chip8->rng = rng ? rng : 1;
+	chip8->timing = timing;
+	chip8->strict = strict;
+	chip8->fusion = fusion; // the cache and hit counts start over
+	chip8->quirks = quirks;
+
+	// Font and ROM
+	map_image(chip8, image_retain(image));
+	chip8_image_release(old_image);
 
-	// Load Font
-	memcpy(&chip8 -> ram[0], font, sizeof(font));
+	// Defaults
+	chip8 -> state = RUNNING;
+	chip8 -> PC = CHIP8_ENTRY_POINT;
+}
 
+bool init_chip8(chip8_t *chip8, const char rom_name[]){
 	// Open ROM
 	FILE *rom = fopen(rom_name, "rb");
 	if(!rom){
-		SDL_Log("ROM FILE is Invalid\n");
+		fprintf(stderr, "ROM FILE is Invalid\n");
 		return false;
 	}
 
-
 	// ROM Size
 	fseek(rom, 0, SEEK_END);
-	const size_t rom_size = ftell(rom);
-	const size_t max_size = sizeof chip8->ram - entry_point;
+	const long rom_size = ftell(rom);
+	const size_t max_size = CHIP8_RAM_SIZE - CHIP8_ENTRY_POINT;
 	rewind(rom);
 
-	if(rom_size > max_size){
-		SDL_Log("ROM FILE is Too Large to Handle\n");
+	if(rom_size < 0 || (size_t)rom_size > max_size){
+		fprintf(stderr, "ROM FILE is Too Large to Handle\n");
+		fclose(rom);
 		return false;
 	}
 
 	// Read ROM
-	if(fread(&chip8->ram[entry_point], rom_size, 1, rom) != 1){
-		SDL_Log("Can't Read the ROM \n");
+	uint8_t data[CHIP8_RAM_SIZE - CHIP8_ENTRY_POINT];
+	if(rom_size > 0 && fread(data, rom_size, 1, rom) != 1){
+		fprintf(stderr, "Can't Read the ROM \n");
+		fclose(rom);
 		return false;
 	};
 
 	// Close ROM
 	fclose(rom);
 
-	// Defaults
-	chip8 -> state = RUNNING;
-	chip8 -> PC = entry_point;
 	chip8 -> rom_name = rom_name;
-	chip8 -> SP = chip8->stack;
-
-	return true; //Sucess
+	return chip8_load_rom_mem(chip8, data, rom_size);
 }
 
-bool init_sdl(sdl_t *sdl, config_t *config){
-	if(SDL_Init(SDL_INIT_VIDEO|SDL_INIT_AUDIO|SDL_INIT_TIMER) != 0){
-		SDL_Log("Can't Initialize SDL Subsystem %s \n", SDL_GetError());
-		return false; // Initialization Failed
+void chip8_run_cycles(chip8_t *chip8, uint32_t n){
+	// superinstructions bypass the per instruction hooks
+	if(chip8->fusion && !chip8->trace && !chip8->debugger && !chip8->heatmap && !chip8->journal){
+		for(uint32_t i = 0; i < n && chip8->state == RUNNING;){
+			i += emulate_fused(chip8, n - i);
+		}
+		return;
 	}
 
+	for(uint32_t i = 0; i < n && chip8->state == RUNNING; i++){
+		emulate_instructions(chip8);
+	}
+}
 
-	sdl -> window = SDL_CreateWindow("CHIP-8 Emulator", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, config->window_width * config->scale_factor, config->window_height * config->scale_factor, 0);
+void chip8_update_timers(chip8_t *chip8){
+	if(chip8->journal){
+		journal_timers(chip8->journal, chip8);
+	}
 
-	if(!sdl -> window){
-		SDL_Log("could not create window %s\n", SDL_GetError());
-		return false;
+	if(chip8->delay_timer > 0){
+		chip8->delay_timer--;
 	}
 
-	sdl -> renderer = SDL_CreateRenderer(sdl -> window, -1, SDL_RENDERER_ACCELERATED);
+	if(chip8->sound_timer > 0){
+		chip8->sound_timer--;
+	}
+}
 
-	if(!sdl->renderer){
-		SDL_Log("could not create renderer %s\n", SDL_GetError());
-		return false;
+// Spend machine cycles until the budget runs out or a sprite draw waits for vblank
+static void run_vip_cycles(chip8_t *chip8, int32_t budget){
+	chip8->cycle_budget += budget;
+
+	while(chip8->cycle_budget > 0 && !chip8->vblank_wait && chip8->state == RUNNING){
+		const uint16_t pc = chip8->PC;
+		uint8_t V[16]; // costs depend on operands the instruction may overwrite
+		memcpy(V, chip8->V, sizeof V);
+		emulate_instructions(chip8);
+		if(chip8->state == PAUSED){
+			break; // a remote breakpoint stopped it before the instruction ran
+		}
+
+		const bool skipped = chip8->PC == (uint16_t)(pc + 4);
+		chip8->cycle_budget -= vip_instruction_cycles(chip8, V, skipped);
+
+		if((chip8->inst.opcode >> 12) == 0x0D){
+			chip8->vblank_wait = true;
+		}
 	}
+}
 
-	sdl->want = (SDL_AudioSpec){
-		.freq = 44100,
-		.format = AUDIO_S16LSB, //signed 16 bit little indian
-		.channels = 1, //mono 1 channel
-		.samples = 512,
-		.callback = audio_callback,
-		.userdata = config
-	};
+void chip8_run_frame_part(chip8_t *chip8, uint32_t part, uint32_t parts){
+	if(chip8->timing == TIMING_VIP){
+		if(part == 0){
+			// a new frame, cycles left over when the last one stopped at vblank are gone
+			chip8->vblank_wait = false;
+			if(chip8->cycle_budget > 0){
+				chip8->cycle_budget = 0;
+			}
+		}
+		run_vip_cycles(chip8, VIP_FRAME_BUDGET*(part+1)/parts - VIP_FRAME_BUDGET*part/parts);
+		return;
+	}
 
-	sdl->dev = SDL_OpenAudioDevice(NULL,0, &sdl->want, &sdl->have, 0);
+	const uint32_t count = chip8->inst_per_frame*(part+1)/parts - chip8->inst_per_frame*part/parts;
+	chip8_run_cycles(chip8, count);
+}
 
-	if(sdl->dev == 0){
-		SDL_Log("could not get any audio device %s\n", SDL_GetError());
-		return false;
-	}
+void chip8_run_frame(chip8_t *chip8){
+	chip8_run_frame_part(chip8, 0, 1);
+	chip8_update_timers(chip8);
+}
 
-	if((sdl->want.format != sdl->have.format)||(sdl->want.channels != sdl->have.channels)){
-		SDL_Log("could not get desired audio spec\n");
-		return false;
+void chip8_set_timing(chip8_t *chip8, timing_t timing){
+	chip8->timing = timing;
+	chip8->cycle_budget = 0;
+	chip8->vblank_wait = false;
+}
+
+void chip8_set_clock(chip8_t *chip8, uint32_t inst_per_sec){
+	chip8->inst_per_frame = inst_per_sec / 60 ? inst_per_sec / 60 : 1;
+}
+
+void set_keypad(chip8_t *chip8, uint8_t key, bool pressed){
+	key &= 0xF;
+	if(chip8->keypad[key] == pressed){
+		return;
 	}
 
-	return true; // Initialization Done
+	chip8->keypad[key] = pressed;
+	chip8->keypad_cycle[key] = chip8->cycles;
 }
 
-// Initial Emulator Config from actual args
-bool set_config(config_t *config, int argc, char **argv){
-	// Defaults
-	*config = (config_t){
-		.window_width = 64,
-		.window_height = 32, //OG CHIP8 Resolution
-		.foreground_color = 0xFFFFFFFF, //White 
-		.background_color = 0x000000FF,  //Yellow
-		.scale_factor = 20, // Scale 20x
-		.pixel_outlines = true, // Draw pixel outlines
-		.inst_per_sec = 700, // Default Clock Rate
-		.square_wave_freq = 440, 
-		.audio_sample_rate = 44100,
-		.volume = 3000,
-	};
+void chip8_set_keys(chip8_t *chip8, uint16_t mask){
+	for(uint8_t key = 0; key < 16; key++){
+		set_keypad(chip8, key, mask & (1 << key));
+	}
+}
 
-	// Change Defaults
-	for(int i = 0; i < argc; i++){
-		(void)argv[i];
+void chip8_get_framebuffer(const chip8_t *chip8, uint8_t *pixels){
+	for(uint32_t y = 0; y < CHIP8_HEIGHT; y++){
+		for(uint32_t x = 0; x < CHIP8_WIDTH; x++){
+			pixels[y * CHIP8_WIDTH + x] = (chip8->display[y] >> (CHIP8_WIDTH - 1 - x)) & 1;
+		}
 	}
+}
 
-	return true;
+void chip8_set_strict(chip8_t *chip8, bool strict){
+	chip8->strict = strict;
 }
 
-// Initialize CHIP8 machine
+const char *chip8_fault_name(fault_kind_t kind){
+	switch(kind){
+		case FAULT_MEMORY: return "memory access out of range";
+		case FAULT_STACK_OVERFLOW: return "stack overflow";
+		case FAULT_STACK_UNDERFLOW: return "stack underflow";
+		default: return "no fault";
+	}
+}
 
-void final_cleanup(sdl_t sdl){
-	SDL_DestroyRenderer(sdl.renderer);
-	SDL_DestroyWindow(sdl.window);
-	SDL_CloseAudioDevice(sdl.dev);
-	SDL_Quit(); // Quit SDL Subsystem
+void chip8_set_quirks(chip8_t *chip8, uint8_t quirks){
+	chip8->quirks = quirks;
 }
 
+void chip8_set_fusion(chip8_t *chip8, bool fusion){
+	const bool was_on = chip8->fusion;
+	chip8->fusion = fusion;
 
+	// writes while it was off left the sequences they broke, drop them on every page written since the image
+	for(uint8_t page = 0; fusion && !was_on && page < CHIP8_PAGES; page++){
+		if(chip8->private_pages & (1u << page)){
+			fusion_invalidate(chip8, page << CHIP8_PAGE_SHIFT, CHIP8_PAGE_SIZE);
+		}
+	}
+}
 
-void update_timers(const sdl_t sdl, chip8_t *chip8){
-	if(chip8->delay_timer > 0){
-		chip8->delay_timer--;
+void chip8_snapshot(const chip8_t *chip8, chip8_t *snapshot){
+	if(snapshot == chip8){
+		return;
 	}
 
-	if(chip8->sound_timer > 0){
-		chip8->sound_timer--;
-		SDL_PauseAudioDevice(sdl.dev, 0); // Play Audio
+	// the copy keeps its own page buffers and shares the image
+	chip8_image_t *old_image = snapshot->image;
+	uint8_t *owned[CHIP8_PAGES], *owned_fused[CHIP8_PAGES];
+	memcpy(owned, snapshot->owned, sizeof owned);
+	memcpy(owned_fused, snapshot->owned_fused, sizeof owned_fused);
+	memcpy(snapshot, chip8, sizeof *snapshot);
+	memcpy(snapshot->owned, owned, sizeof owned);
+	memcpy(snapshot->owned_fused, owned_fused, sizeof owned_fused);
+	image_retain(snapshot->image);
+	chip8_image_release(old_image);
+	snapshot->code_page = CHIP8_PAGES;
+
+	for(uint32_t page = 0; page < CHIP8_PAGES; page++){
+		if(!(chip8->private_pages & (1u << page))){
+			continue;
+		}
+		snapshot->private_pages &= ~(1u << page);
+		if(!chip8_own_page(snapshot, page)){ // copies from chip8's page
+			snapshot->pages[page] = zero_page; // FAULTED, but must not write through to chip8
+		}
 	}
-	else{
-		SDL_PauseAudioDevice(sdl.dev, 1); //Pause Audio
+	for(uint32_t page = 0; page < CHIP8_PAGES; page++){
+		if(!(chip8->private_fused & (1u << page))){
+			continue;
+		}
+		snapshot->private_fused &= ~(1u << page);
+		if(!chip8_own_fused_page(snapshot, page)){
+			snapshot->fused[page] = zero_page; // fusion is off, and nothing writes to a page that isn't private
+		}
 	}
 }
 
+void chip8_restore(chip8_t *chip8, const chip8_t *snapshot){
+	chip8_snapshot(snapshot, chip8);
+}
+
+void chip8_run_ahead(const chip8_t *chip8, chip8_t *ahead, uint32_t frames){
+	chip8_snapshot(chip8, ahead);
+	ahead->trace = NULL;
+	ahead->debugger = NULL;
+	ahead->heatmap = NULL;
+	ahead->journal = NULL;
+
+	for(uint32_t i = 0; i < frames && ahead->state == RUNNING; i++){
+		chip8_run_frame(ahead);
+	}
+}
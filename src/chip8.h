@@ -5,36 +5,30 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include <time.h>
-#include "SDL2/SDL.h"
+#include <string.h>
 
+/*
+CHIP-8 core, no SDL and no global state, so any number of machines can
+run side by side on different threads. Build with `make lib` for
+libchip8.a/libchip8.so.
+*/
 
-typedef struct {
-	uint32_t window_width;
-	uint32_t window_height;
-	uint32_t foreground_color; // foreground color R-8 G-8 B-8 A-8
-	uint32_t background_color; // bg color R-8 G-8 B-8 A-8
-
-	uint32_t scale_factor; // Scale CHIP-8 px
-
-	bool pixel_outlines; // does the user want pixel outlines or not
-
-	uint32_t inst_per_sec; // cpu clock rate
-
-	uint32_t square_wave_freq;  //frequency of square wave sound
-
-	uint32_t audio_sample_rate;
+#define CHIP8_WIDTH 64 // a display row is one uint64_t
+#define CHIP8_HEIGHT 32
+#define CHIP8_ENTRY_POINT 0x200
+#define CHIP8_DEFAULT_IPS 700 // instructions per second
+#define CHIP8_RAM_SIZE 4096
+#define CHIP8_RAM_MASK (CHIP8_RAM_SIZE - 1) // guest addresses wrap instead of leaving ram
+#define CHIP8_STACK_DEPTH 12 // subroutine levels on the original interpreter
+#define CHIP8_STACK_MASK 0xF // stack storage is rounded up to 16 so SP can be masked
+#define CHIP8_FONT_SIZE 80 // 16 hex digit sprites, 4x5 pixels in the high nibbles
+#define CHIP8_PAGE_SHIFT 8
+#define CHIP8_PAGE_SIZE (1 << CHIP8_PAGE_SHIFT) // unit of copy on write sharing
+#define CHIP8_PAGE_MASK (CHIP8_PAGE_SIZE - 1)
+#define CHIP8_PAGES (CHIP8_RAM_SIZE / CHIP8_PAGE_SIZE)
 
-	int16_t volume;
-}config_t;
-
-typedef struct 
-{
-	SDL_Window *window;
-	SDL_Renderer *renderer;
-	SDL_AudioSpec want, have;
-	SDL_AudioDeviceID dev;
-}sdl_t;
+// Built in hex digit sprites, padded with zeros to a whole page: ram page 0 of every machine
+extern const uint8_t chip8_font[CHIP8_PAGE_SIZE];
 
 typedef struct{
 	uint16_t opcode;
@@ -45,42 +39,241 @@ typedef struct{
 	uint8_t Y;
 }instruction_t;
 
+// How instructions are paced within a 60Hz frame
+typedef enum {
+	TIMING_FIXED, // inst_per_frame instructions, whatever they are
+	TIMING_VIP, // COSMAC VIP machine cycle budget, DXYN waits for vblank
+} timing_t;
+
+// Behaviour that differs between CHIP-8 interpreters, none set is this emulator's original behaviour
+enum {
+	QUIRK_VF_RESET = 1 << 0, // 8XY1/8XY2/8XY3 clear VF
+	QUIRK_SHIFT_VY = 1 << 1, // 8XY6/8XYE shift VY into VX instead of VX in place
+	QUIRK_LOAD_STORE_I = 1 << 2, // FX55/FX65 leave I just past the last register
+	QUIRK_JUMP_VX = 1 << 3, // BXNN jumps to XNN + VX instead of NNN + V0
+	QUIRK_WRAP = 1 << 4, // sprites wrap around the screen edges instead of clipping
+};
+
 // Emulator States
 typedef enum {
 	QUIT,
 	RUNNING,
-	PAUSED
+	PAUSED,
+	FAULTED // strict mode caught a bad access, see chip8->fault
 } emulator_state_t;
 
+typedef enum {
+	FAULT_NONE,
+	FAULT_MEMORY, // access past the end of ram
+	FAULT_STACK_OVERFLOW, // 2NNN with all CHIP8_STACK_DEPTH levels in use
+	FAULT_STACK_UNDERFLOW, // 00EE with nothing on the stack
+} fault_kind_t;
+
+typedef struct {
+	fault_kind_t kind;
+	uint16_t PC; // address of the faulting instruction
+	uint16_t opcode;
+	uint16_t address; // first ram address touched, for FAULT_MEMORY
+} chip8_fault_t;
+
+// Superinstructions: common opcode sequences run as one handler, see fusion.h
+typedef enum {
+	FUSE_UNKNOWN, // not decoded yet, only in a machine's own copy of a page after a write over code
+	FUSE_NONE, // no sequence starts here
+	FUSE_LOAD_LOAD_DRAW, // 6XNN 6YNN DXYN
+	FUSE_INDEX_DRAW, // ANNN DXYN
+	FUSE_INDEX_LOAD, // ANNN FX65
+	FUSE_COUNT_LOOP, // 7XNN 3XNN 1NNN
+	FUSE_TIMER_WAIT, // FX07 3X00 1NNN
+	FUSE_SPIN, // 1NNN jumping to itself, how most programs halt
+	FUSE_COUNT
+} fuse_kind_t;
+
+typedef struct trace trace_t;
+typedef struct debugger debugger_t;
+typedef struct heatmap heatmap_t;
+typedef struct journal journal_t;
+
+// Font and ROM pages shared read only by every machine loaded from them, see chip8_image_create
+typedef struct chip8_image chip8_image_t;
+
 // CHIP8 Obj
 typedef struct{
 	emulator_state_t state;
-	uint8_t ram[4096];
-	bool display[64*32]; // CHIP-8 resolution pixels
-	uint16_t stack[12]; // CHIP-8 Stack
-	uint16_t *SP;
+	const uint8_t *pages[CHIP8_PAGES]; // where each page of ram is read from, use ram_read/ram_write
+	uint8_t *owned[CHIP8_PAGES]; // private copies, made on the first write to a page and kept until destroy
+	uint16_t private_pages; // bit n set: pages[n] is owned[n] instead of a shared page
+	chip8_image_t *image; // the shared pages, NULL before a ROM is loaded
+	const uint8_t *code; // the page opcodes were last fetched from, see fetch_opcode
+	uint8_t code_page; // its number, CHIP8_PAGES after pages[] changes
+	uint64_t display[CHIP8_HEIGHT]; // a row of CHIP8_WIDTH pixels each, top bit leftmost, see chip8_pixel
+	uint16_t stack[CHIP8_STACK_MASK + 1]; // CHIP-8 Stack
+	uint8_t SP; // stack entries in use
 	uint8_t V[16]; // CHIP-8 Registers V0-VF
 	uint16_t I; // Memory Address Register
 	uint8_t delay_timer; //subtract 1 from the value of DT(Delay Timer Register) at a rate of 60Hz
 	uint8_t sound_timer; //subtract 1 from the value of ST(Sound Timer Register) at a rate of 60Hz
 	bool keypad[16]; //0-F
+	uint64_t keypad_cycle[16]; // cycle each key last changed state, exported with the shared state
+	uint64_t cycles; // instructions executed since reset
+	uint64_t idle_cycles; // instructions spent waiting: FX0A, jumps to self, loops polling the delay timer
+	uint16_t wait_jump_pc; // last backward jump taken while waiting
+	uint64_t wait_jump_cycle; // cycle it was taken at
 	const char *rom_name; //Name of ROM
 	uint16_t PC; //Program Counter
 	instruction_t inst; //instruction currently executing
 	bool draw; //update screen
+	uint32_t inst_per_frame; // instructions run by chip8_run_frame
+	timing_t timing;
+	int32_t cycle_budget; // TIMING_VIP: machine cycles left this frame, negative if overrun
+	bool vblank_wait; // TIMING_VIP: DXYN is waiting for the next frame
+	bool strict; // fault on out of range memory and stack use instead of wrapping
+	uint8_t quirks; // QUIRK_* flags
+	chip8_fault_t fault; // why the machine stopped, when state is FAULTED
+	uint32_t rng; // xorshift state for CXNN
+	bool fusion; // run common opcode sequences as superinstructions
+	const uint8_t *fused[CHIP8_PAGES]; // fuse_kind_t of the sequence starting at each address, by page, see fusion.h
+	uint8_t *owned_fused[CHIP8_PAGES]; // private copies, made when a write drops sequences from a page and kept until destroy
+	uint16_t private_fused; // bit n set: fused[n] is owned_fused[n] instead of the image's
+	uint64_t fused_hits[FUSE_COUNT]; // times each superinstruction ran
+	uint64_t fused_cycles; // instructions executed inside superinstructions
+	trace_t *trace; // instruction trace, NULL when tracing is off
+	debugger_t *debugger; // breakpoints/watchpoints, NULL when not debugging
+	heatmap_t *heatmap; // ram access counters, NULL when nobody is watching
+	journal_t *journal; // undo log for stepping backwards, NULL when off
 } chip8_t;
 
 
 
-// Initialize CHIP8 machine
+// Allocate a machine with no ROM loaded, seed picks the CXNN random sequence
+chip8_t *chip8_create(uint32_t seed);
+
+void chip8_destroy(chip8_t *chip8);
+
+// Reset the machine and load a ROM image at 0x200
+bool chip8_load_rom_mem(chip8_t *chip8, const uint8_t *rom, size_t size);
+
+/*
+Build the read only ram of a ROM once for many machines: the font page and
+the zero pages are shared by every image, the ROM pages by every machine
+loaded from this one. A machine copies a page privately the first time
+FX33/FX55 write to it. The superinstructions starting at every address are
+decoded here too and shared the same way. Images are reference counted and
+safe to share across threads.
+*/
+chip8_image_t *chip8_image_create(const uint8_t *rom, size_t size);
+
+void chip8_image_release(chip8_image_t *image);
+
+// The ROM the image was built from
+const uint8_t *chip8_image_rom(const chip8_image_t *image, size_t *size);
+
+// Reset the machine onto a shared image, the machine takes its own reference
+void chip8_load_image(chip8_t *chip8, chip8_image_t *image);
+
+typedef struct {
+	uint32_t shared_pages; // ram pages still read from the image
+	uint32_t private_pages; // ram pages this machine has written to
+	size_t resident_bytes; // the machine and every ram and superinstruction page it owns, shared pages not included
+} chip8_memory_t;
+
+void chip8_memory_stats(const chip8_t *chip8, chip8_memory_t *stats);
+
+// Initialize CHIP8 machine from a ROM file
 bool init_chip8(chip8_t *chip8, const char rom_name[]);
 
-bool init_sdl(sdl_t *sdl, config_t *config);
+// Run up to n instructions, stops early if the machine leaves RUNNING
+void chip8_run_cycles(chip8_t *chip8, uint32_t n);
+
+// Decrement the delay and sound timers, call at 60Hz
+void chip8_update_timers(chip8_t *chip8);
+
+// One 60Hz frame: inst_per_frame instructions then a timer tick
+void chip8_run_frame(chip8_t *chip8);
+
+/*
+Run part of a frame, for frontends that interleave input polling: call with
+part = 0..parts-1, then chip8_update_timers. Under TIMING_VIP each part gets
+its share of the machine cycle budget.
+*/
+void chip8_run_frame_part(chip8_t *chip8, uint32_t part, uint32_t parts);
+
+void chip8_set_timing(chip8_t *chip8, timing_t timing);
+
+// Set the instruction rate used by chip8_run_frame
+void chip8_set_clock(chip8_t *chip8, uint32_t inst_per_sec);
+
+// Set the whole keypad at once, bit n = key n held
+void chip8_set_keys(chip8_t *chip8, uint16_t mask);
+
+// Unpack the display into CHIP8_WIDTH*CHIP8_HEIGHT pixels, row major, 1 = lit
+void chip8_get_framebuffer(const chip8_t *chip8, uint8_t *pixels);
+
+static inline bool chip8_pixel(const chip8_t *chip8, uint32_t x, uint32_t y){
+	return (chip8->display[y % CHIP8_HEIGHT] >> (CHIP8_WIDTH - 1 - x % CHIP8_WIDTH)) & 1;
+}
+
+// Trap bad memory and stack accesses (FAULTED) instead of wrapping them
+void chip8_set_strict(chip8_t *chip8, bool strict);
+
+const char *chip8_fault_name(fault_kind_t kind);
+
+/*
+Snapshots are copies of the machine: a few KB plus the pages it has
+written to, so taking one every frame is cheap. Shared pages are not
+copied, hooks (trace, debugger) are copied as pointers. Both machines must
+come from chip8_create.
+*/
+void chip8_snapshot(const chip8_t *chip8, chip8_t *snapshot);
+
+void chip8_restore(chip8_t *chip8, const chip8_t *snapshot);
+
+/*
+Run ahead: copy the machine into ahead and run it frames more frames with
+the keys held now. ahead then shows what the program will have drawn by
+then, while chip8 itself is untouched. The copy runs without any of
+the trace, debugger, heatmap or journal hooks.
+*/
+void chip8_run_ahead(const chip8_t *chip8, chip8_t *ahead, uint32_t frames);
+
+void chip8_set_quirks(chip8_t *chip8, uint8_t quirks);
+
+// Superinstructions are on by default, they are skipped while tracing or debugging
+void chip8_set_fusion(chip8_t *chip8, bool fusion);
+
+// Give the machine its own copy of a shared page, false (and FAULTED) if out of memory
+bool chip8_own_page(chip8_t *chip8, uint8_t page);
+
+// Same for a page of superinstructions, out of memory turns fusion off instead
+bool chip8_own_fused_page(chip8_t *chip8, uint8_t page);
+
+// Guest memory accessors, addresses are masked so they can never leave ram
+static inline uint8_t ram_read(const chip8_t *chip8, uint16_t address){
+	address &= CHIP8_RAM_MASK;
+	return chip8->pages[address >> CHIP8_PAGE_SHIFT][address & CHIP8_PAGE_MASK];
+}
 
-bool set_config(config_t *config, int argc, char **argv);
+// Big endian word, how opcodes are fetched
+static inline uint16_t ram_read16(const chip8_t *chip8, uint16_t address){
+	address &= CHIP8_RAM_MASK;
+	const uint8_t *page = chip8->pages[address >> CHIP8_PAGE_SHIFT];
+	const uint16_t offset = address & CHIP8_PAGE_MASK;
+	if(offset == CHIP8_PAGE_MASK){
+		return (page[offset] << 8) | ram_read(chip8, address + 1); // second byte is on the next page
+	}
+	return (page[offset] << 8) | page[offset + 1];
+}
 
-void final_cleanup(sdl_t sdl);
+static inline void ram_write(chip8_t *chip8, uint16_t address, uint8_t value){
+	address &= CHIP8_RAM_MASK;
+	const uint8_t page = address >> CHIP8_PAGE_SHIFT;
+	if(!(chip8->private_pages & (1u << page)) && !chip8_own_page(chip8, page)){
+		return;
+	}
+	chip8->owned[page][address & CHIP8_PAGE_MASK] = value;
+}
 
-void update_timers(const sdl_t sdl, chip8_t *chip8);
+// Press or release a CHIP-8 key
+void set_keypad(chip8_t *chip8, uint8_t key, bool pressed);
 
 #endif
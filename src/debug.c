@@ -1,13 +1,18 @@
 #include "debug.h"
 
 void print_debug_output(chip8_t *chip8){
-		printf("Address: 0x%04X, Opcode: 0x%04X Description: \n", chip8->PC-2, chip8->inst.opcode);
+	fprint_debug_output(stdout, chip8, chip8->PC-2);
+}
+
+// Describe the instruction in chip8->inst, fetched from address pc
+void fprint_debug_output(FILE *out, const chip8_t *chip8, uint16_t pc){
+		fprintf(out, "Address: 0x%04X, Opcode: 0x%04X Description: \n", pc, chip8->inst.opcode);
 		switch((chip8->inst.opcode >> 12) & 0x0F){
 
 		case 0x00:
 			if(chip8->inst.NN == 0xE0){
 				// 0x00E0 Display Clear
-				printf("clear the screen\n");
+				fprintf(out, "clear the screen\n");
 			}
 			else if(chip8->inst.NN == 0xEE){
 				// Returns from a subroutine
@@ -15,17 +20,17 @@ void print_debug_output(chip8_t *chip8){
 				/*
 				Set Program Counter to last address of function(subroutine) call (pop it off the stack)
 				*/
-				printf("return from a subroutine\n");
+				fprintf(out, "return from a subroutine\n");
 			}
 			else{
-				printf("unimplemented opcode\n");
+				fprintf(out, "unimplemented opcode\n");
 			}
 			break;
 
 		case 0x01:
 			// 1NNN
 			// Jumps to address NNN
-			printf("jums to address NNN 0x0%4X\n", chip8->inst.NNN);
+			fprintf(out, "jums to address NNN 0x0%4X\n", chip8->inst.NNN);
 			break;
 
 		case 0x02:
@@ -35,14 +40,14 @@ void print_debug_output(chip8_t *chip8){
 			Store Current Address from the program counter to the stack (PUSH IT TO THE STACK)
 			Set the program counter to NNN 
 			*/
-			printf("call subroutine at NNN (0x%04X)", chip8->inst.NNN);
+			fprintf(out, "call subroutine at NNN (0x%04X)", chip8->inst.NNN);
 			break;
 
 		case 0x03:
 			// 0x3XNN
 			// Skips the next instruction if VX equals NN (usually the next instruction is a jump to skip a code block)
 
-			printf("V%X == NN (0x%02X) so skipping next intruction 0x%04X\n", chip8->inst.X, chip8->inst.NN, chip8->PC);
+			fprintf(out, "V%X == NN (0x%02X) so skipping next intruction 0x%04X\n", chip8->inst.X, chip8->inst.NN, chip8->PC);
 
 			break;
 
@@ -51,7 +56,7 @@ void print_debug_output(chip8_t *chip8){
 			// Skips the next instruction if VX does not equal NN (usually the next instruction is a jump to skip a code block).
 			// Opposite of 0x3XNN
 
-			printf("V%X != NN (0x%02X) so skipping next instruction 0x%04X\n", chip8->inst.X, chip8->inst.NN, chip8->PC);
+			fprintf(out, "V%X != NN (0x%02X) so skipping next instruction 0x%04X\n", chip8->inst.X, chip8->inst.NN, chip8->PC);
 
 			break;
 
@@ -59,7 +64,7 @@ void print_debug_output(chip8_t *chip8){
 			// 0x5XY0
 			// Skips the next instruction if VX equals VY (usually the next instruction is a jump to skip a code block)
 
-			printf("VX(V%X) == VY(V%X) skkiping the next instruction \n", chip8->inst.X, chip8->inst.Y);
+			fprintf(out, "VX(V%X) == VY(V%X) skkiping the next instruction \n", chip8->inst.X, chip8->inst.Y);
 
 			break;
 
@@ -67,21 +72,21 @@ void print_debug_output(chip8_t *chip8){
 			// 0xANNN
 			// Sets I to the address NNN
 
-			printf("set I to NNN: 0x%04X\n", chip8->inst.NNN);
+			fprintf(out, "set I to NNN: 0x%04X\n", chip8->inst.NNN);
 			break;
 
 		case 0x06:
 			// Sets VX to NN
 			// 0x6XNN
 
-			printf("Set V%X to NN(0x%02X)\n", chip8->inst.X, chip8->inst.NN);
+			fprintf(out, "Set V%X to NN(0x%02X)\n", chip8->inst.X, chip8->inst.NN);
 
 			break;
 
 		case 0x07:
 		// Adds NN to VX (carry flag is not changed)
 		// 0x7XNN
-			printf("Added NN (0x%02X) to V%X\n", chip8->inst.NN, chip8->inst.X);
+			fprintf(out, "Added NN (0x%02X) to V%X\n", chip8->inst.NN, chip8->inst.X);
 
 			break;
 
@@ -91,14 +96,14 @@ void print_debug_output(chip8_t *chip8){
 					// 0x8XY0
 					// Sets VX to the value of VY
 
-					printf("Set V%X to V%X (0x%02X)\n", chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.Y]);
+					fprintf(out, "Set V%X to V%X (0x%02X)\n", chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.Y]);
 
 					break;
 
 				case 1:
 					// 0x8XY1
 					// Sets VX to VX or VY (bitwise OR operation)
-					printf("Set V%X |= V%X =>(0x%02X)\n", chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.X] | chip8->V[chip8->inst.Y]);
+					fprintf(out, "Set V%X |= V%X =>(0x%02X)\n", chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.X] | chip8->V[chip8->inst.Y]);
 
 
 					break;
@@ -107,7 +112,7 @@ void print_debug_output(chip8_t *chip8){
 					// 0x8XY2
 					// Sets VX to VX and VY (bitwise AND operation)
 
-					printf("Set V%X &= V%X =>(0x%02X)\n", chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.X] & chip8->V[chip8->inst.Y]);
+					fprintf(out, "Set V%X &= V%X =>(0x%02X)\n", chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.X] & chip8->V[chip8->inst.Y]);
 
 					break;
 
@@ -115,7 +120,7 @@ void print_debug_output(chip8_t *chip8){
 					// 0x8XY3
 					// Sets VX to VX xor VY
 
-					printf("Set V%X ^= V%X =>(0x%02X)\n", chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.X] ^ chip8->V[chip8->inst.Y]);
+					fprintf(out, "Set V%X ^= V%X =>(0x%02X)\n", chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.X] ^ chip8->V[chip8->inst.Y]);
 
 					break;
 
@@ -124,7 +129,7 @@ void print_debug_output(chip8_t *chip8){
 					// Adds VY to VX
 					// VF is set to 1 when there's an overflow, and to 0 when there is not
 
-					printf("Set V%X += V%X =>(0x%02X) VF = %X\n", chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y], ((uint16_t)(chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y]) > 255));
+					fprintf(out, "Set V%X += V%X =>(0x%02X) VF = %X\n", chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y], ((uint16_t)(chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y]) > 255));
 
 					break;
 
@@ -133,7 +138,7 @@ void print_debug_output(chip8_t *chip8){
 					// VY is subtracted from VX
 					// VF is set to 0 when there's an underflow, and 1 when there is not. (i.e. VF set to 1 if VX >= VY and 0 if not). 
 
-					printf("Set V%X -= V%X =>(0x%02X) VF = %X\n", chip8->inst.X,
+					fprintf(out, "Set V%X -= V%X =>(0x%02X) VF = %X\n", chip8->inst.X,
 					 chip8->inst.Y,
 					  chip8->V[chip8->inst.X] - chip8->V[chip8->inst.Y],
 					  (int16_t)(chip8->V[chip8->inst.X] - chip8->V[chip8->inst.Y]) < 0);
@@ -144,7 +149,7 @@ void print_debug_output(chip8_t *chip8){
 					// 0X8XY6
 					// Stores the least significant bit of VX in VF and then shifts VX to the right by 1
 
-					printf("Set V%X >>= 1 =>(0x%02X) VF = %X\n", chip8->inst.X, chip8->V[chip8->inst.X] >> 1, chip8->V[chip8->inst.X] & 1);
+					fprintf(out, "Set V%X >>= 1 =>(0x%02X) VF = %X\n", chip8->inst.X, chip8->V[chip8->inst.X] >> 1, chip8->V[chip8->inst.X] & 1);
 
 					break;
 
@@ -152,7 +157,7 @@ void print_debug_output(chip8_t *chip8){
 					// 0x8XY7
 					// Sets VX to VY minus VX. VF is set to 0 when there's an underflow, and 1 when there is not. (i.e. VF set to 1 if VY >= VX)
 
-					printf("Set V%X = V%X - V%X=>(0x%02X) VF = %X\n",
+					fprintf(out, "Set V%X = V%X - V%X=>(0x%02X) VF = %X\n",
 					 chip8->inst.X, 
 					 chip8->inst.Y, 
 					 chip8->inst.X, 
@@ -165,7 +170,7 @@ void print_debug_output(chip8_t *chip8){
 					// 0x8XYE
 					// Stores the most significant bit of VX in VF and then shifts VX to the left by 1
 
-					printf("Set V%X <<= 1 =>(0x%02X) VF = %X\n", chip8->inst.X, chip8->V[chip8->inst.X] << 1, (chip8->V[chip8->inst.X] & 0x80) >> 7);
+					fprintf(out, "Set V%X <<= 1 =>(0x%02X) VF = %X\n", chip8->inst.X, chip8->V[chip8->inst.X] << 1, (chip8->V[chip8->inst.X] & 0x80) >> 7);
 
 					break;
 			}
@@ -175,7 +180,7 @@ void print_debug_output(chip8_t *chip8){
 			// 0x9XY0
 			// Skips the next instruction if VX does not equal VY. (Usually the next instruction is a jump to skip a code block)
 
-			printf("V%X != V%X so skipping next intruction\n", chip8->inst.X, chip8->inst.Y);
+			fprintf(out, "V%X != V%X so skipping next intruction\n", chip8->inst.X, chip8->inst.Y);
 
 			break;
 
@@ -184,7 +189,7 @@ void print_debug_output(chip8_t *chip8){
 			// 0xBNNN
 			// Jumps to the address NNN plus V0
 
-			printf("set PC to V0 + NNN => (0x%04X) \n", chip8->inst.NNN + chip8->V[0]);
+			fprintf(out, "set PC to V0 + NNN => (0x%04X) \n", chip8->inst.NNN + chip8->V[0]);
 
 			break;
 
@@ -192,7 +197,7 @@ void print_debug_output(chip8_t *chip8){
 			// 0xCXNN
 			// Sets VX to the result of a bitwise and operation on a random number (Typically: 0 to 255) and NN
 
-			printf("Set V%X to rand()&NN (0x%02X)\n", chip8->inst.X, (rand() % 256) & chip8->inst.NN);
+			fprintf(out, "Set V%X to rand()&NN (0x%02X)\n", chip8->inst.X, chip8->inst.NN);
 
 			break;
 
@@ -201,7 +206,7 @@ void print_debug_output(chip8_t *chip8){
 			Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels. Each row of 8 pixels is read as bit-coded starting from memory location I; I value does not change after the execution of this instruction. As described above, VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that does not happen
 			*/
 			// 0xDXYN
-			printf("Drawing %u height sprite at coordinates V%X [0x%02X] and V%X [0x%02X]\n", chip8->inst.N, chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y]);
+			fprintf(out, "Drawing %u height sprite at coordinates V%X [0x%02X] and V%X [0x%02X]\n", chip8->inst.N, chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y]);
 			break;
 
 		case 0xE:
@@ -210,7 +215,7 @@ void print_debug_output(chip8_t *chip8){
 					// 0xEX9E
 					// Skips the next instruction if the key stored in VX is pressed (usually the next instruction is a jump to skip a code block)
 
-					printf("skipping next instruction because key in V%X is pressed\n", chip8->inst.X);
+					fprintf(out, "skipping next instruction because key in V%X is pressed\n", chip8->inst.X);
 
 					break;
 
@@ -218,7 +223,7 @@ void print_debug_output(chip8_t *chip8){
 					// 0xEXA1
 					// Skips the next instruction if the key stored in VX is not pressed (usually the next instruction is a jump to skip a code block)
 
-					printf("skipping next instruction because key in V%X is not pressed\n", chip8->inst.X);
+					fprintf(out, "skipping next instruction because key in V%X is not pressed\n", chip8->inst.X);
 
 					break;
 
@@ -235,27 +240,27 @@ void print_debug_output(chip8_t *chip8){
 				// 0xFX0A
 				// A key press is awaited, and then stored in VX (blocking operation, all instruction halted until next key event)
 
-				printf("wait until key is pressed and then store the key in V%X\n", chip8->inst.X);
+				fprintf(out, "wait until key is pressed and then store the key in V%X\n", chip8->inst.X);
 				
 				break;
 
 			case 0x1E:
 				// 0xFX1E
 				// Adds VX to I. VF is not affected
-				printf("I += V%X => (0%2X)\n", chip8->inst.X, chip8->I+chip8->V[chip8->inst.X]);
+				fprintf(out, "I += V%X => (0%2X)\n", chip8->inst.X, chip8->I+chip8->V[chip8->inst.X]);
 				break;
 
 			case 0x07:
 				// 0xFX07
 				// Sets VX to the value of the delay timer
-				printf("V%X = delay_timer() (0x%2X)\n", chip8->inst.X, chip8->delay_timer);
+				fprintf(out, "V%X = delay_timer() (0x%2X)\n", chip8->inst.X, chip8->delay_timer);
 
 				break;
 
 			case 0x15:
 				// 0xFX15
 				// Sets the delay timer to VX
-				printf("delay_timer() (0x%2X) = V%X\n", chip8->delay_timer, chip8->inst.X);
+				fprintf(out, "delay_timer() (0x%2X) = V%X\n", chip8->delay_timer, chip8->inst.X);
 
 				break;
 
@@ -263,7 +268,7 @@ void print_debug_output(chip8_t *chip8){
 				// 0xFX18
 				// Sets the sound timer to VX
 
-				printf("sound_timer() (0x%2X) = V%X\n", chip8->sound_timer, chip8->inst.X);
+				fprintf(out, "sound_timer() (0x%2X) = V%X\n", chip8->sound_timer, chip8->inst.X);
 
 				break;
 
@@ -271,28 +276,28 @@ void print_debug_output(chip8_t *chip8){
 				// 0xFX29
 				// Sets I to the location of the sprite for the character in VX. Characters 0-F (in hexadecimal) are represented by a 4x5 font
 
-				printf("set I to sprite location in memory for character in V%X  \n", chip8->inst.X);
+				fprintf(out, "set I to sprite location in memory for character in V%X  \n", chip8->inst.X);
 
 				break;
  
 			case 0x33:
 				// 0xFX33
 
-				printf("store BCD representation of V%X\n", chip8->inst.X);
+				fprintf(out, "store BCD representation of V%X\n", chip8->inst.X);
 				break;
 
 			case 0x55:
 				// 0xFX55
 				// Stores from V0 to VX (including VX) in memory, starting at address I. The offset from I is increased by 1 for each value written, but I itself is left unmodified
 
-				printf("register dump from V0 to V%X\n", chip8->inst.X);
+				fprintf(out, "register dump from V0 to V%X\n", chip8->inst.X);
 				break;
 
 			case 0x65:
 				// 0xFX65
 				// Fills from V0 to VX (including VX) with values from memory, starting at address I. The offset from I is increased by 1 for each value read, but I itself is left unmodified
 
-				printf("register load from V0 to V%X\n", chip8->inst.X);
+				fprintf(out, "register load from V0 to V%X\n", chip8->inst.X);
 				break;
 			
 			default:
@@ -302,7 +307,7 @@ void print_debug_output(chip8_t *chip8){
 			break;
 
 		default:
-			printf("unimplemented \n");
+			fprintf(out, "unimplemented \n");
 			break;
 	}
 	}
@@ -4,5 +4,7 @@
 #include "chip8.h"
 
 void print_debug_output(chip8_t *chip8);
+
+void fprint_debug_output(FILE *out, const chip8_t *chip8, uint16_t pc);
 	
 #endif
\ No newline at end of file
@@ -0,0 +1,255 @@
+#include "debugger.h"
+#include "debug.h"
+#include "instructions.h"
+#include "journal.h"
+
+static void set_bit(uint8_t *bitmap, uint16_t address, bool value){
+	address &= 0xFFF;
+	if(value){
+		bitmap[address >> 3] |= 1 << (address & 7);
+	}
+	else{
+		bitmap[address >> 3] &= ~(1 << (address & 7));
+	}
+}
+
+void debugger_init(debugger_t *dbg){
+	memset(dbg, 0, sizeof(debugger_t));
+	dbg->step_over_pc = -1;
+	dbg->resume_pc = -1;
+	dbg->break_next = true; // start halted at the first instruction
+}
+
+bool debugger_needed(const debugger_t *dbg){
+	if(dbg->break_next || dbg->step_over_pc >= 0){
+		return true;
+	}
+	for(uint32_t i = 0; i < sizeof dbg->breakpoints; i++){
+		if(dbg->breakpoints[i] | dbg->conditional[i] | dbg->read_watch[i] | dbg->write_watch[i]){
+			return true;
+		}
+	}
+	return false;
+}
+
+static void print_registers(const chip8_t *chip8){
+	for(uint8_t i = 0; i < 16; i++){
+		printf("V%X=%02X%s", i, chip8->V[i], i == 7 || i == 15 ? "\n" : " ");
+	}
+	printf("I=%03X PC=%03X SP=%u DT=%02X ST=%02X\n", chip8->I, chip8->PC, chip8->SP, chip8->delay_timer, chip8->sound_timer);
+}
+
+// Show the instruction about to execute
+static void print_current(const chip8_t *chip8){
+	chip8_t view = *chip8;
+	decode_instruction(&view.inst, ram_read16(chip8, chip8->PC));
+	fprint_debug_output(stdout, &view, chip8->PC);
+}
+
+static void print_help(void){
+	printf(
+		"c                     continue\n"
+		"s                     step one instruction\n"
+		"n                     step over (runs a 2NNN call until it returns)\n"
+		"p [N]                 step back N instructions (needs --journal)\n"
+		"b ADDR [REG OP VAL]   break at ADDR, optionally only when REG (V0-VF, I) OP (= ! < >) VAL\n"
+		"d ADDR                delete breakpoints at ADDR\n"
+		"w r|w|rw START [END]  watch reads/writes of ram[START..END]\n"
+		"u START [END]         remove watchpoints\n"
+		"r                     registers\n"
+		"x ADDR [LEN]          examine memory\n"
+		"q                     quit\n"
+		"numbers are hex\n");
+}
+
+static bool add_condition(debugger_t *dbg, uint16_t address, const char *reg, char op, uint16_t value){
+	if(dbg->condition_count == DEBUGGER_MAX_CONDITIONS){
+		printf("too many conditional breakpoints\n");
+		return false;
+	}
+
+	break_condition_t cond = {.address = address & 0xFFF, .op = op, .value = value};
+	if(reg[0] == 'I' || reg[0] == 'i'){
+		cond.reg = 0x10;
+	}
+	else if(reg[0] == 'V' || reg[0] == 'v'){
+		cond.reg = strtoul(reg + 1, NULL, 16) & 0xF;
+	}
+	else{
+		printf("unknown register %s\n", reg);
+		return false;
+	}
+
+	if(op != '=' && op != '!' && op != '<' && op != '>'){
+		printf("unknown comparison %c\n", op);
+		return false;
+	}
+
+	dbg->conditions[dbg->condition_count++] = cond;
+	set_bit(dbg->conditional, address, true);
+	return true;
+}
+
+static void delete_breakpoints(debugger_t *dbg, uint16_t address){
+	address &= 0xFFF;
+	set_bit(dbg->breakpoints, address, false);
+	set_bit(dbg->conditional, address, false);
+
+	// compact the condition list
+	uint32_t kept = 0;
+	for(uint32_t i = 0; i < dbg->condition_count; i++){
+		if(dbg->conditions[i].address != address){
+			dbg->conditions[kept++] = dbg->conditions[i];
+		}
+	}
+	dbg->condition_count = kept;
+}
+
+static void read_commands(debugger_t *dbg, chip8_t *chip8){
+	if(dbg->watch_hit){
+		printf("watchpoint: %s of 0x%03X\n", dbg->watch_write ? "write" : "read", dbg->watch_address);
+		dbg->watch_hit = false;
+	}
+	print_current(chip8);
+
+	char line[128];
+	while(true){
+		printf("(chip8) ");
+		fflush(stdout);
+
+		if(!fgets(line, sizeof line, stdin)){
+			chip8->state = QUIT;
+			return;
+		}
+
+		char cmd[8] = {0}, arg1[16] = {0}, arg2[16] = {0}, arg3[16] = {0}, arg4[16] = {0};
+		const int args = sscanf(line, "%7s %15s %15s %15s %15s", cmd, arg1, arg2, arg3, arg4);
+		if(args <= 0){
+			continue;
+		}
+
+		switch(cmd[0]){
+			case 'c':
+				return;
+
+			case 's':
+				dbg->break_next = true;
+				return;
+
+			case 'n':{
+				const uint16_t opcode = ram_read16(chip8, chip8->PC);
+				if((opcode >> 12) == 0x2){
+					dbg->step_over_pc = (chip8->PC + 2) & 0xFFF;
+					dbg->step_over_SP = chip8->SP;
+				}
+				else{
+					dbg->break_next = true;
+				}
+				return;
+			}
+
+			case 'p':{
+				if(!chip8->journal){
+					printf("no journal, start with --journal\n");
+					break;
+				}
+				const uint32_t count = args >= 2 ? strtoul(arg1, NULL, 16) : 1;
+				uint32_t undone = 0;
+				while(undone < count && journal_step_back(chip8->journal, chip8)){
+					undone++;
+				}
+				if(undone < count){
+					printf("history ends %u instructions back\n", undone);
+				}
+				print_current(chip8);
+				break;
+			}
+
+			case 'b':{
+				if(args < 2){
+					printf("b ADDR [REG OP VAL]\n");
+					break;
+				}
+				const uint16_t address = strtoul(arg1, NULL, 16);
+				if(args >= 5){
+					add_condition(dbg, address, arg2, arg3[0], strtoul(arg4, NULL, 16));
+				}
+				else{
+					set_bit(dbg->breakpoints, address, true);
+				}
+				break;
+			}
+
+			case 'd':
+				if(args < 2){
+					printf("d ADDR\n");
+					break;
+				}
+				delete_breakpoints(dbg, strtoul(arg1, NULL, 16));
+				break;
+
+			case 'w':
+			case 'u':{
+				const bool watch = cmd[0] == 'w';
+				const char *start_arg = watch ? arg2 : arg1;
+				const char *end_arg = watch ? arg3 : arg2;
+				if(args < (watch ? 3 : 2)){
+					printf(watch ? "w r|w|rw START [END]\n" : "u START [END]\n");
+					break;
+				}
+
+				const bool reads = !watch || strchr(arg1, 'r');
+				const bool writes = !watch || strchr(arg1, 'w');
+				const uint16_t start = strtoul(start_arg, NULL, 16) & 0xFFF;
+				const uint16_t end = end_arg[0] ? strtoul(end_arg, NULL, 16) & 0xFFF : start;
+
+				for(uint16_t addr = start; addr <= end; addr++){
+					if(reads) set_bit(dbg->read_watch, addr, watch);
+					if(writes) set_bit(dbg->write_watch, addr, watch);
+				}
+				break;
+			}
+
+			case 'r':
+				print_registers(chip8);
+				break;
+
+			case 'x':{
+				if(args < 2){
+					printf("x ADDR [LEN]\n");
+					break;
+				}
+				const uint16_t start = strtoul(arg1, NULL, 16);
+				const uint16_t len = args >= 3 ? strtoul(arg2, NULL, 16) : 0x10;
+				for(uint16_t i = 0; i < len; i++){
+					if(i % 16 == 0) printf("%s%03X:", i ? "\n" : "", (start + i) & 0xFFF);
+					printf(" %02X", ram_read(chip8, start + i));
+				}
+				printf("\n");
+				break;
+			}
+
+			case 'q':
+				chip8->state = QUIT;
+				return;
+
+			default:
+				print_help();
+				break;
+		}
+	}
+}
+
+void debugger_prompt(debugger_t *dbg, chip8_t *chip8){
+	dbg->break_next = false;
+	dbg->step_over_pc = -1;
+
+	// the client finds the machine paused at the next slice boundary
+	if(dbg->remote){
+		chip8->state = PAUSED;
+		return;
+	}
+
+	read_commands(dbg, chip8);
+	chip8->debugger = debugger_needed(dbg) ? dbg : NULL;
+}
@@ -0,0 +1,114 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include "chip8.h"
+
+#define DEBUGGER_MAX_CONDITIONS 32
+
+// Breakpoint that only fires when a register compares true against a value
+typedef struct {
+	uint16_t address; // PC the condition is attached to
+	uint8_t reg; // 0x0-0xF for V0-VF, 0x10 for I
+	char op; // '=' '!' '<' '>'
+	uint16_t value;
+} break_condition_t;
+
+// Interactive debugger, attached to chip8->debugger
+struct debugger {
+	// one bit per address, checked with a single lookup
+	uint8_t breakpoints[4096 / 8];
+	uint8_t conditional[4096 / 8]; // address has at least one condition
+	uint8_t read_watch[4096 / 8];
+	uint8_t write_watch[4096 / 8];
+
+	break_condition_t conditions[DEBUGGER_MAX_CONDITIONS];
+	uint32_t condition_count;
+
+	bool break_next; // stop before the next instruction (single step / watchpoint hit)
+	int32_t step_over_pc; // return address for step over, -1 when unused
+	uint8_t step_over_SP; // stack depth the return has to land at
+
+	bool watch_hit; // a watchpoint fired during the last instruction
+	uint16_t watch_address;
+	bool watch_write;
+
+	bool remote; // driven by a remote client: a break pauses the machine instead of prompting
+	int32_t resume_pc; // don't break again at the PC the machine resumed at, -1 when unused
+};
+
+void debugger_init(debugger_t *dbg);
+
+// Anything to check before or during an instruction: a breakpoint, watchpoint or pending step.
+// Without one the debugger is left detached, so the machine keeps its superinstructions
+bool debugger_needed(const debugger_t *dbg);
+
+// Stop and read commands from stdin until the user continues, or for a
+// remote debugger pause the machine and leave it to the client. An
+// interactive debugger detaches itself when nothing is left to check
+void debugger_prompt(debugger_t *dbg, chip8_t *chip8);
+
+// Break before the instruction at chip8->PC executes?
+static inline bool debugger_should_break(debugger_t *dbg, const chip8_t *chip8){
+	const uint16_t pc = chip8->PC & 0xFFF;
+	const uint8_t bit = 1 << (pc & 7);
+
+	if(dbg->resume_pc == pc){
+		dbg->resume_pc = -1;
+		return false;
+	}
+
+	if(dbg->break_next){
+		return true;
+	}
+
+	if(dbg->step_over_pc == pc && dbg->step_over_SP == chip8->SP){
+		return true;
+	}
+
+	if(dbg->breakpoints[pc >> 3] & bit){
+		return true;
+	}
+
+	if(dbg->conditional[pc >> 3] & bit){
+		for(uint32_t i = 0; i < dbg->condition_count; i++){
+			const break_condition_t *cond = &dbg->conditions[i];
+			if(cond->address != pc){
+				continue;
+			}
+
+			const uint16_t reg = cond->reg == 0x10 ? chip8->I : chip8->V[cond->reg];
+			if((cond->op == '=' && reg == cond->value) ||
+			   (cond->op == '!' && reg != cond->value) ||
+			   (cond->op == '<' && reg < cond->value) ||
+			   (cond->op == '>' && reg > cond->value)){
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+// Memory watchpoints, called by instructions that touch ram[address..address+len-1]
+static inline void debugger_check_access(debugger_t *dbg, const uint8_t *watch, uint16_t address, uint16_t len, bool write){
+	for(uint16_t i = 0; i < len; i++){
+		const uint16_t addr = (address + i) & 0xFFF;
+		if(watch[addr >> 3] & (1 << (addr & 7))){
+			dbg->break_next = true;
+			dbg->watch_hit = true;
+			dbg->watch_address = addr;
+			dbg->watch_write = write;
+			return;
+		}
+	}
+}
+
+static inline void debugger_check_read(debugger_t *dbg, uint16_t address, uint16_t len){
+	debugger_check_access(dbg, dbg->read_watch, address, len, false);
+}
+
+static inline void debugger_check_write(debugger_t *dbg, uint16_t address, uint16_t len){
+	debugger_check_access(dbg, dbg->write_watch, address, len, true);
+}
+
+#endif
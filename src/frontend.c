@@ -0,0 +1,291 @@
+#include "frontend.h"
+#include "sound.h"
+#include "keyboard.h"
+
+bool init_sdl(sdl_t *sdl, config_t *config){
+	// audio waits for the first beep and game controllers for the first frame, probing them is most of a cold start
+	if(SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER) != 0){
+		SDL_Log("Can't Initialize SDL Subsystem %s \n", SDL_GetError());
+		return false; // Initialization Failed
+	}
+
+
+	sdl -> window = SDL_CreateWindow("CHIP-8 Emulator", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, config->window_width * config->scale_factor, config->window_height * config->scale_factor, 0);
+
+	if(!sdl -> window){
+		SDL_Log("could not create window %s\n", SDL_GetError());
+		return false;
+	}
+
+	sdl -> renderer = SDL_CreateRenderer(sdl -> window, -1, SDL_RENDERER_ACCELERATED);
+
+	if(!sdl->renderer){
+		SDL_Log("could not create renderer %s\n", SDL_GetError());
+		return false;
+	}
+
+	sdl -> texture = SDL_CreateTexture(sdl -> renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, config->window_width * config->scale_factor, config->window_height * config->scale_factor);
+
+	if(!sdl->texture){
+		SDL_Log("could not create texture %s\n", SDL_GetError());
+		return false;
+	}
+
+	if(!scaler_init(&sdl->scaler, config->filter, config->window_width, config->window_height, config->scale_factor, config->pixel_outlines)){
+		SDL_Log("could not allocate scaler buffers\n");
+		return false;
+	}
+
+	if(config->persist != PERSIST_OFF){
+		sdl->persist = malloc(sizeof(persist_t));
+		if(!sdl->persist){
+			SDL_Log("could not allocate persistence buffers\n");
+			return false;
+		}
+		persist_init(sdl->persist, config->persist, config->phosphor_decay, config->blend_frames);
+	}
+
+	sdl->want = (SDL_AudioSpec){
+		.freq = 44100,
+		.format = AUDIO_S16LSB, //signed 16 bit little indian
+		.channels = 1, //mono 1 channel
+		.samples = 512,
+		.callback = audio_callback,
+		.userdata = config
+	};
+	sdl->timings = config->timings;
+
+	return true; // Initialization Done
+}
+
+// Initial Emulator Config from actual args
+bool set_config(config_t *config, int argc, char **argv){
+	// Defaults
+	*config = (config_t){
+		.window_width = 64,
+		.window_height = 32, //OG CHIP8 Resolution
+		.foreground_color = 0xFFFFFFFF, //White 
+		.background_color = 0x000000FF,  //Yellow
+		.scale_factor = 20, // Scale 20x
+		.pixel_outlines = true, // Draw pixel outlines
+		.filter = FILTER_NEAREST, // Plain pixels
+		.persist = PERSIST_OFF, // Show frames as drawn
+		.phosphor_decay = 160,
+		.blend_frames = 2,
+		.inst_per_sec = 700, // Default Clock Rate
+		.timing = TIMING_FIXED,
+		.input_slices = 4, // Poll input every ~4ms
+		.keymap = DEFAULT_KEYMAP,
+		.square_wave_freq = 440, 
+		.audio_sample_rate = 44100,
+		.volume = 3000,
+		.fusion = true,
+		.quirks = PROFILE_COUNT, // Detect from the ROM
+		.metrics_interval = METRICS_DEFAULT_INTERVAL,
+	};
+
+	// Change Defaults, argv[1] is the ROM
+	for(int i = 2; i < argc; i++){
+		if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc){
+			config->trace_file = argv[++i];
+		}
+		else if(strcmp(argv[i], "--filter") == 0 && i + 1 < argc){
+			config->filter = filter_from_name(argv[++i]);
+			if(config->filter == FILTER_COUNT){
+				SDL_Log("unknown filter %s, use nearest, scale2x, scanline or crt\n", argv[i]);
+				return false;
+			}
+		}
+		else if(strcmp(argv[i], "--phosphor") == 0 && i + 1 < argc){
+			config->persist = PERSIST_PHOSPHOR;
+			config->phosphor_decay = strtoul(argv[++i], NULL, 10);
+		}
+		else if(strcmp(argv[i], "--blend-frames") == 0 && i + 1 < argc){
+			config->persist = PERSIST_BLEND;
+			config->blend_frames = strtoul(argv[++i], NULL, 10);
+		}
+		else if(strcmp(argv[i], "--keymap") == 0 && i + 1 < argc){
+			config->keymap = argv[++i];
+		}
+		else if(strcmp(argv[i], "--input-slices") == 0 && i + 1 < argc){
+			config->input_slices = strtoul(argv[++i], NULL, 10);
+			if(config->input_slices == 0){
+				config->input_slices = 1;
+			}
+		}
+		else if(strcmp(argv[i], "--capture") == 0 && i + 1 < argc){
+			config->capture_file = argv[++i];
+		}
+		else if(strcmp(argv[i], "--shm") == 0 && i + 1 < argc){
+			config->shared_name = argv[++i];
+		}
+		else if(strcmp(argv[i], "--ips") == 0 && i + 1 < argc){
+			config->inst_per_sec = strtoul(argv[++i], NULL, 10);
+			if(config->inst_per_sec < 60){
+				config->inst_per_sec = 60;
+			}
+		}
+		else if(strcmp(argv[i], "--adaptive") == 0){
+			config->adaptive = true;
+		}
+		else if(strcmp(argv[i], "--vip-timing") == 0){
+			config->timing = TIMING_VIP;
+		}
+		else if(strcmp(argv[i], "--debug") == 0){
+			config->debugger = true;
+		}
+		else if(strcmp(argv[i], "--journal") == 0){
+			config->journal = true;
+		}
+		else if(strcmp(argv[i], "--viewer") == 0){
+			config->viewer = true;
+		}
+		else if(strcmp(argv[i], "--hud") == 0){
+			config->hud = true;
+		}
+		else if(strcmp(argv[i], "--metrics") == 0 && i + 1 < argc){
+			config->metrics_target = argv[++i];
+		}
+		else if(strcmp(argv[i], "--metrics-interval") == 0 && i + 1 < argc){
+			config->metrics_interval = strtoul(argv[++i], NULL, 10);
+			if(config->metrics_interval == 0){
+				SDL_Log("--metrics-interval needs a whole number of seconds\n");
+				return false;
+			}
+		}
+		else if(strcmp(argv[i], "--remote") == 0 && i + 1 < argc){
+			config->remote_path = argv[++i];
+		}
+		else if(strcmp(argv[i], "--timings") == 0){
+			config->timings = true;
+		}
+		else if(strcmp(argv[i], "--strict") == 0){
+			config->strict = true;
+		}
+		else if(strcmp(argv[i], "--no-fusion") == 0){
+			config->fusion = false;
+		}
+		else if(strcmp(argv[i], "--quirks") == 0 && i + 1 < argc){
+			config->quirks = strcmp(argv[++i], "auto") == 0 ? PROFILE_COUNT : profile_from_name(argv[i]);
+			if(config->quirks == PROFILE_COUNT && strcmp(argv[i], "auto") != 0){
+				SDL_Log("unknown quirks %s, use auto, default, vip, schip or xochip\n", argv[i]);
+				return false;
+			}
+		}
+		else if(strcmp(argv[i], "--run-ahead") == 0 && i + 1 < argc){
+			config->run_ahead = strtoul(argv[++i], NULL, 10);
+			if(config->run_ahead > MAX_RUN_AHEAD){
+				config->run_ahead = MAX_RUN_AHEAD;
+			}
+		}
+		else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc){
+			config->record_file = argv[++i];
+		}
+		else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc){
+			config->replay_file = argv[++i];
+		}
+		else{
+			SDL_Log("unknown option %s\n", argv[i]);
+			return false;
+		}
+	}
+
+	// the debugger changes the machine in ways a recording can't replay
+	if(config->record_file && (config->debugger || config->remote_path || config->replay_file)){
+		SDL_Log("--record is off under --debug, --remote and --replay\n");
+		config->record_file = NULL;
+	}
+
+	// scale2x doubles the display before the rest of the scale, an odd one would leave it at nearest
+	if(config->filter == FILTER_SCALE2X && config->scale_factor % 2 != 0){
+		SDL_Log("--filter scale2x needs an even scale, %u is odd\n", config->scale_factor);
+		return false;
+	}
+
+	if(config->debugger && config->remote_path){
+		SDL_Log("--debug and --remote can't share the machine, use one\n");
+		return false;
+	}
+
+	if(config->replay_file && config->adaptive){
+		SDL_Log("--adaptive is off under --replay, the recording sets the clock\n");
+		config->adaptive = false;
+	}
+
+	if(config->run_ahead && config->debugger){
+		SDL_Log("--run-ahead is off under --debug\n");
+		config->run_ahead = 0;
+	}
+
+	if(config->adaptive && config->timing == TIMING_VIP){
+		SDL_Log("--adaptive has no effect with --vip-timing\n");
+		config->adaptive = false;
+	}
+
+	return true;
+}
+
+void select_quirks(chip8_t *chip8, const config_t *config){
+	quirk_profile_t profile = config->quirks;
+
+	if(profile == PROFILE_COUNT){
+		char cache[4096] = "";
+		const char *home = getenv("HOME");
+		if(home){
+			snprintf(cache, sizeof cache, "%s/.chip8-quirks", home);
+		}
+
+		const uint64_t hash = quirks_rom_hash(chip8);
+		if(!cache[0] || !quirks_cache_find(cache, hash, &profile)){
+			const uint64_t start = SDL_GetPerformanceCounter();
+			int32_t scores[PROFILE_COUNT];
+			profile = quirks_detect(chip8, scores);
+			const double elapsed = (double)((SDL_GetPerformanceCounter() - start)*1000)/SDL_GetPerformanceFrequency();
+
+			SDL_Log("quirks: %s in %.1fms (default %d, vip %d, schip %d, xochip %d)\n", profile_name(profile), elapsed,
+				scores[PROFILE_DEFAULT], scores[PROFILE_VIP], scores[PROFILE_SCHIP], scores[PROFILE_XOCHIP]);
+			if(cache[0] && !quirks_cache_store(cache, hash, profile)){
+				SDL_Log("could not write %s\n", cache);
+			}
+		}
+	}
+
+	chip8_set_quirks(chip8, profile_quirks(profile));
+}
+
+void final_cleanup(sdl_t sdl){
+	free(sdl.persist);
+	scaler_free(&sdl.scaler);
+	SDL_DestroyTexture(sdl.texture);
+	SDL_DestroyRenderer(sdl.renderer);
+	SDL_DestroyWindow(sdl.window);
+	if(sdl.dev){
+		SDL_CloseAudioDevice(sdl.dev);
+	}
+	SDL_Quit(); // Quit SDL Subsystem
+}
+
+
+
+void update_timers(sdl_t *sdl, chip8_t *chip8){
+	const bool beep = chip8->sound_timer > 0;
+	chip8_update_timers(chip8);
+
+	audio_play(sdl, beep);
+}
+
+void timings_start(timings_t *timings){
+	*timings = (timings_t){0};
+	timings->start = timings->last = SDL_GetPerformanceCounter();
+}
+
+void timings_mark(timings_t *timings, const char *phase){
+	if(!timings->enabled){
+		return;
+	}
+	const uint64_t now = SDL_GetPerformanceCounter();
+	const double frequency = SDL_GetPerformanceFrequency();
+	SDL_Log("startup: %-12s %8.2f ms, %8.2f ms in total\n", phase,
+		(now - timings->last) * 1000 / frequency, (now - timings->start) * 1000 / frequency);
+	timings->last = now;
+}
@@ -0,0 +1,119 @@
+#ifndef FRONTEND_H
+#define FRONTEND_H
+
+#include "SDL2/SDL.h"
+#include "chip8.h"
+#include "scaler.h"
+#include "persist.h"
+#include "quirks.h"
+
+// SDL frontend, built on the core in chip8.h
+
+#define MAX_RUN_AHEAD 8 // frames, each one is emulated again every host frame
+#define PAUSED_WAIT_MS 100 // longest the loop sleeps between input checks while paused or faulted
+
+typedef struct {
+	uint32_t window_width;
+	uint32_t window_height;
+	uint32_t foreground_color; // foreground color R-8 G-8 B-8 A-8
+	uint32_t background_color; // bg color R-8 G-8 B-8 A-8
+
+	uint32_t scale_factor; // Scale CHIP-8 px
+
+	bool pixel_outlines; // does the user want pixel outlines or not
+
+	filter_t filter; // upscaling filter
+
+	persist_mode_t persist; // flicker reduction
+	uint8_t phosphor_decay; // brightness kept per frame with PERSIST_PHOSPHOR, out of 256
+	uint32_t blend_frames; // frames ORed together with PERSIST_BLEND
+
+	uint32_t inst_per_sec; // cpu clock rate
+
+	timing_t timing; // fixed instruction count or COSMAC VIP cycle timing
+
+	bool adaptive; // tune inst_per_sec to the ROM and host load
+
+	uint32_t input_slices; // times input is polled per 60Hz frame
+
+	const char *keymap; // keyboard keys for CHIP-8 keys 0-F
+
+	uint32_t square_wave_freq;  //frequency of square wave sound
+
+	uint32_t audio_sample_rate;
+
+	int16_t volume;
+
+	const char *trace_file; // binary instruction trace output, NULL for none
+
+	bool debugger; // start under the interactive debugger
+
+	bool strict; // stop on out of range memory and stack use instead of wrapping
+
+	bool fusion; // run common opcode sequences as superinstructions
+
+	uint32_t run_ahead; // frames to emulate ahead of the shown frame, 0 = off
+
+	quirk_profile_t quirks; // PROFILE_COUNT = detect
+
+	bool viewer; // open the memory heatmap and register window
+
+	bool journal; // keep an undo log so the debugger can step backwards
+
+	const char *capture_file; // video capture output, NULL for none
+
+	const char *shared_name; // POSIX shared memory segment for state export, NULL for none
+
+	const char *record_file; // input recording output, NULL for none
+
+	const char *replay_file; // input recording to play back instead of the keyboard, NULL for none
+
+	bool hud; // start with the performance overlay shown, F1 toggles it
+
+	const char *metrics_target; // counters export, a file or unix:PATH, NULL for none
+
+	uint32_t metrics_interval; // seconds between exports to a file
+
+	const char *remote_path; // Unix socket for the remote debugger, NULL for none
+
+	bool timings; // log how long each startup phase took
+}config_t;
+
+typedef struct 
+{
+	SDL_Window *window;
+	SDL_Renderer *renderer;
+	SDL_Texture *texture; // streaming texture the scaled frame is written into
+	scaler_t scaler;
+	persist_t *persist; // frame persistence state, NULL when off
+	SDL_AudioSpec want, have;
+	SDL_AudioDeviceID dev; // 0 until the first beep opens it
+	bool audio_failed; // the device could not be opened, the beeps stay silent
+	bool timings; // log how long opening the device took
+}sdl_t;
+
+// Startup phases logged with --timings
+typedef struct {
+	bool enabled;
+	uint64_t start; // performance counter when main started
+	uint64_t last; // at the previous mark
+} timings_t;
+
+bool init_sdl(sdl_t *sdl, config_t *config);
+
+bool set_config(config_t *config, int argc, char **argv);
+
+void final_cleanup(sdl_t sdl);
+
+// Apply --quirks, or look the ROM up in ~/.chip8-quirks and detect it if it is not there
+void select_quirks(chip8_t *chip8, const config_t *config);
+
+// Tick the CHIP-8 timers and play or pause the beep to match
+void update_timers(sdl_t *sdl, chip8_t *chip8);
+
+void timings_start(timings_t *timings);
+
+// Log the time since the previous mark as phase, when enabled
+void timings_mark(timings_t *timings, const char *phase);
+
+#endif
@@ -0,0 +1,70 @@
+#include "fusion.h"
+
+fuse_kind_t fusion_decode(const chip8_t *chip8, uint16_t pc){
+	// sequences never wrap around the end of ram
+	const uint16_t room = (CHIP8_RAM_SIZE - pc) / 2;
+	if(room < 1){
+		return FUSE_NONE;
+	}
+
+	const uint16_t first = fusion_fetch(chip8, pc);
+	if(first == (0x1000 | pc)){
+		return FUSE_SPIN;
+	}
+	if(room < 2){
+		return FUSE_NONE;
+	}
+
+	const uint16_t second = fusion_fetch(chip8, pc + 2);
+	const uint16_t third = room >= 3 ? fusion_fetch(chip8, pc + 4) : 0;
+
+	if(room >= 3 && (first >> 12) == 0x6 && (second >> 12) == 0x6 && (third >> 12) == 0xD){
+		return FUSE_LOAD_LOAD_DRAW;
+	}
+	if(room >= 3 && (first >> 12) == 0x7 && (second >> 12) == 0x3 && (third >> 12) == 0x1){
+		return FUSE_COUNT_LOOP;
+	}
+	if(room >= 3 && (first & 0xF0FF) == 0xF007 && (second & 0xF0FF) == 0x3000 && (third >> 12) == 0x1){
+		return FUSE_TIMER_WAIT;
+	}
+	if((first >> 12) == 0xA && (second >> 12) == 0xD){
+		return FUSE_INDEX_DRAW;
+	}
+	if((first >> 12) == 0xA && (second & 0xF0FF) == 0xF065){
+		return FUSE_INDEX_LOAD;
+	}
+
+	return FUSE_NONE;
+}
+
+fuse_kind_t fusion_refill(chip8_t *chip8, uint16_t address){
+	const fuse_kind_t kind = fusion_decode(chip8, address);
+	const uint8_t page = address >> CHIP8_PAGE_SHIFT;
+	if(chip8->private_fused & (1u << page)){
+		chip8->owned_fused[page][address & CHIP8_PAGE_MASK] = kind;
+	}
+	return kind;
+}
+
+uint32_t fusion_length(fuse_kind_t kind){
+	switch(kind){
+		case FUSE_LOAD_LOAD_DRAW:
+		case FUSE_COUNT_LOOP:
+		case FUSE_TIMER_WAIT: return 3;
+		case FUSE_INDEX_DRAW:
+		case FUSE_INDEX_LOAD: return 2;
+		default: return 1;
+	}
+}
+
+const char *fusion_name(fuse_kind_t kind){
+	switch(kind){
+		case FUSE_LOAD_LOAD_DRAW: return "6XNN 6YNN DXYN";
+		case FUSE_INDEX_DRAW: return "ANNN DXYN";
+		case FUSE_INDEX_LOAD: return "ANNN FX65";
+		case FUSE_COUNT_LOOP: return "7XNN 3XNN 1NNN";
+		case FUSE_TIMER_WAIT: return "FX07 3X00 1NNN";
+		case FUSE_SPIN: return "1NNN to itself";
+		default: return "none";
+	}
+}
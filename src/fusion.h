@@ -0,0 +1,65 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include "chip8.h"
+
+/*
+Superinstruction fusion. Most ROMs spend their time in a handful of idioms:
+loading coordinates then drawing, pointing I at a sprite or table then using
+it, small counter or delay timer loops, and jumps to self. The kind of sequence starting at
+each address is decoded once, for every machine loaded from a ROM image,
+and run by emulate_fused as one handler with the same effect, instruction
+count and idle accounting as stepping through it. A skip that lands inside
+a sequence lands on an address with its own entry, so nothing ever resumes
+half way through a handler. chip8->fused reads each page of kinds from the
+image until a write over code makes the machine copy it, and the
+overwritten entries are decoded again on their next lookup.
+*/
+
+#define FUSE_MAX_LENGTH 3 // instructions in the longest sequence
+
+static inline uint16_t fusion_fetch(const chip8_t *chip8, uint16_t address){
+	return ram_read16(chip8, address);
+}
+
+// Pattern match the instructions at pc
+fuse_kind_t fusion_decode(const chip8_t *chip8, uint16_t pc);
+
+// Decode an entry a write dropped, and cache it if the page is the machine's own
+fuse_kind_t fusion_refill(chip8_t *chip8, uint16_t address);
+
+// Cached kind of the sequence starting at pc
+static inline fuse_kind_t fusion_lookup(chip8_t *chip8, uint16_t pc){
+	const uint16_t address = pc & CHIP8_RAM_MASK;
+	const fuse_kind_t kind = chip8->fused[address >> CHIP8_PAGE_SHIFT][address & CHIP8_PAGE_MASK];
+	return kind == FUSE_UNKNOWN ? fusion_refill(chip8, address) : kind;
+}
+
+// Forget every sequence that overlaps ram[address..address+len) after a write to it.
+// A shared page only needs copying when a sequence there overlaps the write,
+// entries with none run the instructions one by one, which stays correct
+static inline void fusion_invalidate(chip8_t *chip8, uint16_t address, uint16_t len){
+	if(!chip8->fusion){
+		return; // chip8_set_fusion drops the stale sequences when it turns fusion back on
+	}
+	for(uint16_t i = 0; i < len + 2*FUSE_MAX_LENGTH - 1; i++){
+		const uint16_t a = (address - (2*FUSE_MAX_LENGTH - 1) + i) & CHIP8_RAM_MASK;
+		const uint8_t page = a >> CHIP8_PAGE_SHIFT;
+		if(!(chip8->private_fused & (1u << page))){
+			if(chip8->fused[page][a & CHIP8_PAGE_MASK] <= FUSE_NONE){
+				continue;
+			}
+			if(!chip8_own_fused_page(chip8, page)){
+				return; // fusion is off now
+			}
+		}
+		chip8->owned_fused[page][a & CHIP8_PAGE_MASK] = FUSE_UNKNOWN;
+	}
+}
+
+// Instructions in a sequence of this kind
+uint32_t fusion_length(fuse_kind_t kind);
+
+const char *fusion_name(fuse_kind_t kind);
+
+#endif
@@ -0,0 +1,346 @@
+#include "chip8.h"
+#include "heatmap.h"
+#include "journal.h"
+#include "quirks.h"
+#include "timing.h"
+
+// Regression harness: runs the bundled ROMs headless and checks their state against golden hashes
+
+/*
+usage: golden [--update] [golden-file]
+
+The golden file (roms/golden.txt by default) is a list of scripts:
+
+	rom PROFILE PATH	start a ROM, run under a quirks profile
+	keys FRAME MASK		from FRAME on hold the keys in MASK (hex, bit n = key n)
+	check FRAME HASH	hash of the machine after FRAME frames, - if not known yet
+
+Every ROM runs under each interpreter variant in lockstep, a frame at a
+time. If a variant ends a frame different from the plain interpreter, the
+frame is replayed an instruction at a time to find the first instruction
+they disagree on. --update rewrites the hashes instead of checking them.
+*/
+
+#define MAX_LINES 1024
+#define MAX_EVENTS 64
+#define LINE_LENGTH 512
+
+typedef enum {
+	VARIANT_PLAIN, // one instruction at a time, no hooks: the reference
+	VARIANT_FUSED, // superinstructions
+	VARIANT_HOOKED, // journal and heatmap attached, the debugger's path
+	VARIANT_COUNT
+} variant_t;
+
+static const char *variant_names[VARIANT_COUNT] = {"plain", "fused", "hooked"};
+
+typedef struct {
+	uint32_t frame;
+	uint16_t value; // key mask, or the line to rewrite for a check
+	uint64_t hash;
+	bool known;
+} event_t;
+
+typedef struct {
+	char path[LINE_LENGTH];
+	quirk_profile_t profile;
+	event_t keys[MAX_EVENTS];
+	uint32_t key_count;
+	event_t checks[MAX_EVENTS];
+	uint32_t check_count;
+} script_t;
+
+static char lines[MAX_LINES][LINE_LENGTH];
+static uint32_t line_count;
+
+// FNV-1a over the display and registers
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size){
+	const uint8_t *bytes = data;
+	for(size_t i = 0; i < size; i++){
+		hash = (hash ^ bytes[i]) * 0x100000001b3;
+	}
+	return hash;
+}
+
+static uint64_t hash_machine(const chip8_t *chip8){
+	const uint8_t regs[] = {
+		chip8->I >> 8, chip8->I & 0xFF, chip8->PC >> 8, chip8->PC & 0xFF,
+		chip8->SP, chip8->delay_timer, chip8->sound_timer,
+	};
+	// a byte per pixel, so the hashes don't depend on how the display is stored
+	uint8_t pixels[CHIP8_WIDTH * CHIP8_HEIGHT];
+	chip8_get_framebuffer(chip8, pixels);
+	uint64_t hash = 0xcbf29ce484222325;
+	hash = hash_bytes(hash, pixels, sizeof pixels);
+	hash = hash_bytes(hash, chip8->V, sizeof chip8->V);
+	hash = hash_bytes(hash, regs, sizeof regs);
+	for(uint8_t i = 0; i < chip8->SP && i <= CHIP8_STACK_MASK; i++){
+		const uint8_t entry[] = {chip8->stack[i] >> 8, chip8->stack[i] & 0xFF};
+		hash = hash_bytes(hash, entry, sizeof entry);
+	}
+	return hash;
+}
+
+static bool same_ram(const chip8_t *a, const chip8_t *b){
+	for(uint32_t page = 0; page < CHIP8_PAGES; page++){
+		if(memcmp(a->pages[page], b->pages[page], CHIP8_PAGE_SIZE) != 0){
+			return false;
+		}
+	}
+	return true;
+}
+
+// Print what differs between two machines, returns false if anything does
+static bool compare_machines(const chip8_t *a, const chip8_t *b, bool print){
+	const struct {const char *name; bool same;} parts[] = {
+		{"state", a->state == b->state},
+		{"PC", a->PC == b->PC},
+		{"I", a->I == b->I},
+		{"V", memcmp(a->V, b->V, sizeof a->V) == 0},
+		{"stack", a->SP == b->SP && memcmp(a->stack, b->stack, sizeof a->stack) == 0},
+		{"timers", a->delay_timer == b->delay_timer && a->sound_timer == b->sound_timer},
+		{"cycles", a->cycles == b->cycles && a->idle_cycles == b->idle_cycles},
+		{"ram", same_ram(a, b)},
+		{"display", memcmp(a->display, b->display, sizeof a->display) == 0},
+	};
+
+	bool same = true;
+	for(uint32_t i = 0; i < sizeof parts / sizeof parts[0]; i++){
+		if(!parts[i].same){
+			if(print){
+				printf(" %s", parts[i].name);
+			}
+			same = false;
+		}
+	}
+	return same;
+}
+
+// Replay a frame that diverged one instruction at a time, from the snapshots taken before it
+static void find_divergence(const chip8_t *ref_start, const chip8_t *var_start, variant_t variant, uint16_t keys){
+	chip8_t *ref = chip8_create(1), *var = chip8_create(1);
+	if(!ref || !var){
+		exit(EXIT_FAILURE);
+	}
+
+	chip8_snapshot(ref_start, ref);
+	chip8_set_keys(ref, keys);
+	for(uint32_t k = 1; k <= ref->inst_per_frame && ref->state == RUNNING; k++){
+		const uint16_t pc = ref->PC;
+		const uint16_t opcode = ram_read16(ref, pc);
+		chip8_run_cycles(ref, 1);
+
+		// the variant runs k instructions in one go, however it likes to batch them
+		chip8_snapshot(var_start, var);
+		chip8_set_keys(var, keys);
+		chip8_run_cycles(var, k);
+
+		if(!compare_machines(ref, var, false)){
+			printf("    first difference at instruction %llu, PC %03X opcode %04X, %s differs in:",
+				(unsigned long long)ref->cycles, pc, opcode, variant_names[variant]);
+			compare_machines(ref, var, true);
+			printf("\n");
+			chip8_destroy(ref);
+			chip8_destroy(var);
+			return;
+		}
+	}
+
+	printf("    every instruction matches, the difference is in the timer update\n");
+	chip8_destroy(ref);
+	chip8_destroy(var);
+}
+
+static size_t read_rom(const char *path, uint8_t *rom, size_t max){
+	FILE *file = fopen(path, "rb");
+	if(!file){
+		return 0;
+	}
+	const size_t size = fread(rom, 1, max, file);
+	fclose(file);
+	return size;
+}
+
+// Run one script under every variant, returns the failures
+static uint32_t run_script(script_t *script, bool update, uint64_t *frames_run){
+	uint8_t rom[CHIP8_RAM_SIZE];
+	const size_t size = read_rom(script->path, rom, sizeof rom);
+	chip8_image_t *image = size ? chip8_image_create(rom, size) : NULL;
+	if(!image){
+		printf("%s: could not load\n", script->path);
+		return 1;
+	}
+
+	journal_t journal;
+	static heatmap_t heatmap;
+	if(!journal_open(&journal, 1 << 16)){
+		exit(EXIT_FAILURE);
+	}
+
+	chip8_t *machines[VARIANT_COUNT], *starts[VARIANT_COUNT];
+	for(variant_t v = 0; v < VARIANT_COUNT; v++){
+		machines[v] = chip8_create(1);
+		starts[v] = chip8_create(1);
+		if(!machines[v] || !starts[v]){
+			exit(EXIT_FAILURE);
+		}
+		chip8_set_quirks(machines[v], profile_quirks(script->profile));
+		chip8_set_fusion(machines[v], v != VARIANT_PLAIN);
+		if(v == VARIANT_HOOKED){
+			machines[v]->journal = &journal;
+			machines[v]->heatmap = &heatmap;
+		}
+		chip8_load_image(machines[v], image);
+	}
+	chip8_image_release(image);
+
+	const uint32_t last = script->check_count ? script->checks[script->check_count - 1].frame : 0;
+	uint32_t failures = 0, key_index = 0, check_index = 0;
+	uint16_t keys = 0;
+
+	for(uint32_t frame = 1; frame <= last && !failures; frame++){
+		// keys events for frame f are held while frame f runs
+		while(key_index < script->key_count && script->keys[key_index].frame <= frame){
+			keys = script->keys[key_index++].value;
+		}
+
+		for(variant_t v = 0; v < VARIANT_COUNT; v++){
+			chip8_snapshot(machines[v], starts[v]);
+			chip8_set_keys(machines[v], keys);
+			chip8_run_frame(machines[v]);
+		}
+		heatmap_decay(&heatmap);
+		(*frames_run)++;
+
+		for(variant_t v = 1; v < VARIANT_COUNT; v++){
+			if(!compare_machines(machines[VARIANT_PLAIN], machines[v], false)){
+				printf("%s: %s diverges from plain in frame %u\n", script->path, variant_names[v], frame);
+				find_divergence(starts[VARIANT_PLAIN], starts[v], v, keys);
+				failures++;
+			}
+		}
+
+		while(check_index < script->check_count && script->checks[check_index].frame == frame){
+			event_t *check = &script->checks[check_index++];
+			const uint64_t hash = hash_machine(machines[VARIANT_PLAIN]);
+			if(update){
+				snprintf(lines[check->value], LINE_LENGTH, "check %u %016llx\n", frame, (unsigned long long)hash);
+			}
+			else if(!check->known || check->hash != hash){
+				printf("%s: frame %u hash %016llx, expected %016llx%s\n", script->path, frame,
+					(unsigned long long)hash, (unsigned long long)check->hash, check->known ? "" : " (no golden hash)");
+				failures++;
+			}
+		}
+	}
+
+	for(variant_t v = 0; v < VARIANT_COUNT; v++){
+		chip8_destroy(machines[v]);
+		chip8_destroy(starts[v]);
+	}
+	journal_close(&journal);
+
+	printf("%-45s %-8s %6u frames  %s\n", script->path, profile_name(script->profile), last,
+		failures ? "FAIL" : update ? "updated" : "ok");
+	return failures;
+}
+
+// Split the golden file into scripts, false on a syntax error
+static bool parse_line(uint32_t n, script_t *scripts, uint32_t *script_count){
+	char *line = lines[n];
+	line[strcspn(line, "\r\n")] = '\0';
+	script_t *script = *script_count ? &scripts[*script_count - 1] : NULL;
+
+	char word[16], profile[16];
+	unsigned frame, value;
+	char hash[32];
+	int used = 0;
+
+	if(line[0] == '#' || sscanf(line, "%15s", word) != 1){
+		return true;
+	}
+	if(strcmp(word, "rom") == 0 && sscanf(line, "rom %15s %n", profile, &used) == 1 && used){
+		if(*script_count == MAX_LINES){
+			return false;
+		}
+		script = &scripts[(*script_count)++];
+		memset(script, 0, sizeof *script);
+		snprintf(script->path, sizeof script->path, "%s", line + used);
+		script->profile = profile_from_name(profile);
+		return script->profile != PROFILE_COUNT;
+	}
+	if(!script){
+		return false;
+	}
+	if(strcmp(word, "keys") == 0 && sscanf(line, "keys %u %x", &frame, &value) == 2 && script->key_count < MAX_EVENTS){
+		script->keys[script->key_count++] = (event_t){.frame = frame, .value = value};
+		return true;
+	}
+	if(strcmp(word, "check") == 0 && sscanf(line, "check %u %31s", &frame, hash) == 2 && script->check_count < MAX_EVENTS){
+		const uint32_t prev = script->check_count ? script->checks[script->check_count - 1].frame : 0;
+		char *end;
+		event_t *check = &script->checks[script->check_count++];
+		*check = (event_t){.frame = frame, .value = n, .hash = strtoull(hash, &end, 16)};
+		check->known = *end == '\0' && end != hash;
+		return frame > prev; // in order, so one pass can check them
+	}
+	return false;
+}
+
+int main(int argc, char **argv){
+	const char *path = "roms/golden.txt";
+	bool update = false;
+	for(int i = 1; i < argc; i++){
+		if(strcmp(argv[i], "--update") == 0){
+			update = true;
+		}
+		else{
+			path = argv[i];
+		}
+	}
+
+	FILE *file = fopen(path, "r");
+	if(!file){
+		printf("could not open %s\n", path);
+		exit(EXIT_FAILURE);
+	}
+	while(line_count < MAX_LINES && fgets(lines[line_count], LINE_LENGTH - 1, file)){
+		line_count++;
+	}
+	fclose(file);
+
+	static script_t scripts[MAX_LINES];
+	uint32_t script_count = 0;
+	for(uint32_t n = 0; n < line_count; n++){
+		if(!parse_line(n, scripts, &script_count)){
+			printf("%s:%u: can't parse \"%s\"\n", path, n + 1, lines[n]);
+			exit(EXIT_FAILURE);
+		}
+		strcat(lines[n], "\n"); // parse_line cut it off
+	}
+
+	const double start = host_ms();
+	uint32_t failures = 0;
+	uint64_t frames = 0;
+	for(uint32_t s = 0; s < script_count; s++){
+		failures += run_script(&scripts[s], update, &frames);
+	}
+
+	const double seconds = (host_ms() - start) / 1000;
+	printf("%llu frames x %u variants in %.2f s, %.0f frames/s\n", (unsigned long long)frames, VARIANT_COUNT,
+		seconds, frames / seconds);
+
+	if(update && !failures){
+		file = fopen(path, "w");
+		if(!file){
+			printf("could not write %s\n", path);
+			exit(EXIT_FAILURE);
+		}
+		for(uint32_t n = 0; n < line_count; n++){
+			fputs(lines[n], file);
+		}
+		fclose(file);
+	}
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,9 @@
+#include "heatmap.h"
+
+void heatmap_decay(heatmap_t *heatmap){
+	for(uint32_t i = 0; i < CHIP8_RAM_SIZE; i++){
+		heatmap->read[i] -= (heatmap->read[i] + 7) / 8;
+		heatmap->write[i] -= (heatmap->write[i] + 7) / 8;
+		heatmap->exec[i] -= (heatmap->exec[i] + 7) / 8;
+	}
+}
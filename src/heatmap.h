@@ -0,0 +1,37 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "chip8.h"
+
+/*
+Per address ram access counters. The interpreter bumps them while a heatmap
+is attached to chip8->heatmap, and heatmap_decay fades them once a frame, so
+each counter is a running measure of how hot that byte is.
+*/
+struct heatmap {
+	uint32_t read[CHIP8_RAM_SIZE]; // DXYN sprite data, FX65
+	uint32_t write[CHIP8_RAM_SIZE]; // FX33, FX55
+	uint32_t exec[CHIP8_RAM_SIZE]; // both opcode bytes of every instruction fetched
+};
+
+static inline void heatmap_exec(heatmap_t *heatmap, uint16_t pc){
+	heatmap->exec[pc & CHIP8_RAM_MASK]++;
+	heatmap->exec[(pc + 1) & CHIP8_RAM_MASK]++;
+}
+
+static inline void heatmap_read(heatmap_t *heatmap, uint16_t address, uint16_t len){
+	for(uint16_t i = 0; i < len; i++){
+		heatmap->read[(address + i) & CHIP8_RAM_MASK]++;
+	}
+}
+
+static inline void heatmap_write(heatmap_t *heatmap, uint16_t address, uint16_t len){
+	for(uint16_t i = 0; i < len; i++){
+		heatmap->write[(address + i) & CHIP8_RAM_MASK]++;
+	}
+}
+
+// Scale every counter by 7/8, call once a frame
+void heatmap_decay(heatmap_t *heatmap);
+
+#endif
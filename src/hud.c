@@ -0,0 +1,169 @@
+#include "hud.h"
+#include "sound.h"
+#include "text.h"
+
+#define HUD_LINES 7
+#define HUD_TEXT 0xFFFFFFFF
+#define HUD_BACKGROUND 0x000000B0 // translucent black
+
+// Clear the texture and write the lines, the only time it is touched from the CPU
+static void render(hud_t *hud, char lines[HUD_LINES][24]){
+	void *locked;
+	int pitch_bytes;
+	if(SDL_LockTexture(hud->texture, NULL, &locked, &pitch_bytes) != 0){
+		SDL_Log("could not lock HUD texture %s\n", SDL_GetError());
+		return;
+	}
+	uint32_t *pixels = locked;
+	const uint32_t pitch = pitch_bytes / sizeof(uint32_t);
+
+	for(uint32_t y = 0; y < HUD_HEIGHT; y++){
+		for(uint32_t x = 0; x < HUD_WIDTH; x++){
+			pixels[y*pitch + x] = HUD_BACKGROUND;
+		}
+	}
+	for(uint32_t i = 0; i < HUD_LINES; i++){
+		text_draw(pixels, pitch, 2, 2 + i*TEXT_LINE, lines[i], HUD_TEXT);
+	}
+
+	SDL_UnlockTexture(hud->texture);
+	hud->dirty = true;
+}
+
+// Always five characters, so the longest line still fits in HUD_WIDTH
+static void format_ms(char out[6], double ms){
+	if(ms < 99.995){
+		snprintf(out, 6, "%5.2f", ms);
+	}
+	else{
+		snprintf(out, 6, "%5.0f", ms < 99999 ? ms : 99999);
+	}
+}
+
+// Averages over the period that just ended
+static void render_figures(hud_t *hud, const chip8_t *chip8, double period_ms){
+	// a reset starts the counters again
+	const uint64_t cycles = chip8->cycles >= hud->cycles ? chip8->cycles - hud->cycles : chip8->cycles;
+	const uint64_t idle = chip8->idle_cycles >= hud->idle_cycles ? chip8->idle_cycles - hud->idle_cycles : chip8->idle_cycles;
+
+	char lines[HUD_LINES][24];
+	snprintf(lines[0], sizeof lines[0], "IPS      %7.0f", cycles * 1000 / period_ms);
+	char mean[6], max[6];
+	format_ms(mean, period_ms / hud->frames);
+	format_ms(max, hud->frame_max_ms);
+	snprintf(lines[1], sizeof lines[1], "FRAME MS %s %s", mean, max);
+	if(hud->presents){
+		format_ms(mean, hud->present_ms / hud->presents);
+		format_ms(max, hud->present_max_ms);
+		snprintf(lines[2], sizeof lines[2], "PRESENT  %s %s", mean, max);
+	}
+	else{
+		snprintf(lines[2], sizeof lines[2], "PRESENT  -");
+	}
+	snprintf(lines[3], sizeof lines[3], "INST/FRAME %5.0f", (double)cycles / hud->frames);
+	if(hud->audio_frames){
+		snprintf(lines[4], sizeof lines[4], "AUDIO    %3.0f%%", hud->audio_fill * 100 / hud->audio_frames);
+	}
+	else{
+		snprintf(lines[4], sizeof lines[4], "AUDIO    OFF");
+	}
+	snprintf(lines[5], sizeof lines[5], "DROPPED  %u", hud->dropped);
+	snprintf(lines[6], sizeof lines[6], "IDLE     %3.0f%%", cycles ? idle * 100.0 / cycles : 0.0);
+	render(hud, lines);
+}
+
+static void start_period(hud_t *hud, const chip8_t *chip8, uint64_t now){
+	hud->frames = 0;
+	hud->period_start = now;
+	hud->cycles = chip8->cycles;
+	hud->idle_cycles = chip8->idle_cycles;
+	hud->frame_max_ms = 0;
+	hud->presents = 0;
+	hud->present_ms = 0;
+	hud->present_max_ms = 0;
+	hud->audio_frames = 0;
+	hud->audio_fill = 0;
+}
+
+bool hud_open(hud_t *hud, const sdl_t *sdl, const chip8_t *chip8, bool visible){
+	*hud = (hud_t){.visible = visible};
+
+	hud->texture = SDL_CreateTexture(sdl->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, HUD_WIDTH, HUD_HEIGHT);
+	if(!hud->texture){
+		SDL_Log("could not create HUD texture %s\n", SDL_GetError());
+		return false;
+	}
+	SDL_SetTextureBlendMode(hud->texture, SDL_BLENDMODE_BLEND);
+
+	char lines[HUD_LINES][24] = {"IPS", "FRAME MS", "PRESENT", "INST/FRAME", "AUDIO", "DROPPED", "IDLE"};
+	render(hud, lines);
+	hud->dirty = visible;
+
+	hud->last_frame = SDL_GetPerformanceCounter();
+	start_period(hud, chip8, hud->last_frame);
+	return true;
+}
+
+void hud_show(hud_t *hud, bool visible){
+	if(hud->visible != visible){
+		hud->visible = visible;
+		hud->dirty = true;
+	}
+}
+
+void hud_resume(hud_t *hud, const chip8_t *chip8){
+	hud->last_frame = SDL_GetPerformanceCounter();
+	start_period(hud, chip8, hud->last_frame);
+}
+
+void hud_frame(hud_t *hud, const sdl_t *sdl, const chip8_t *chip8, double present_ms, bool dropped){
+	const uint64_t now = SDL_GetPerformanceCounter();
+	const double frequency = SDL_GetPerformanceFrequency();
+	const double frame_ms = (double)((now - hud->last_frame)*1000)/frequency;
+	hud->last_frame = now;
+
+	hud->frames++;
+	hud->dropped += dropped;
+	if(frame_ms > hud->frame_max_ms){
+		hud->frame_max_ms = frame_ms;
+	}
+	if(present_ms >= 0){
+		hud->presents++;
+		hud->present_ms += present_ms;
+		if(present_ms > hud->present_max_ms){
+			hud->present_max_ms = present_ms;
+		}
+	}
+
+	if(!hud->visible){
+		if(hud->frames >= HUD_PERIOD){
+			start_period(hud, chip8, now);
+		}
+		return;
+	}
+
+	const double fill = audio_buffer_fill(sdl);
+	if(fill >= 0){
+		hud->audio_frames++;
+		hud->audio_fill += fill;
+	}
+
+	if(hud->frames >= HUD_PERIOD){
+		render_figures(hud, chip8, (double)((now - hud->period_start)*1000)/frequency);
+		start_period(hud, chip8, now);
+	}
+}
+
+void hud_draw(const hud_t *hud, SDL_Renderer *renderer){
+	if(!hud->visible){
+		return;
+	}
+
+	const SDL_Rect rect = {HUD_SCALE, HUD_SCALE, HUD_WIDTH * HUD_SCALE, HUD_HEIGHT * HUD_SCALE};
+	SDL_RenderCopy(renderer, hud->texture, NULL, &rect);
+}
+
+void hud_close(hud_t *hud){
+	SDL_DestroyTexture(hud->texture);
+	*hud = (hud_t){0};
+}
@@ -0,0 +1,51 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include "frontend.h"
+
+/*
+Performance overlay, F1 shows and hides it. The figures are averaged over
+HUD_PERIOD frames and drawn in the CHIP-8 font into a small texture only
+then, every frame in between just copies that texture over the display.
+*/
+#define HUD_WIDTH 104
+#define HUD_HEIGHT 45
+#define HUD_SCALE 2 // window pixels per texture pixel
+#define HUD_PERIOD 30 // frames, two updates a second
+
+typedef struct {
+	SDL_Texture *texture;
+	bool visible;
+	bool dirty; // the window must be presented again: new figures, or shown or hidden
+	uint32_t frames; // in this period
+	uint32_t dropped; // frames that missed their deadline, since start
+	uint64_t period_start; // performance counter
+	uint64_t last_frame; // performance counter at the last hud_frame
+	uint64_t cycles; // machine counters at the start of the period
+	uint64_t idle_cycles;
+	double frame_max_ms;
+	uint32_t presents; // frames update_screen ran in
+	double present_ms; // summed over them
+	double present_max_ms;
+	uint32_t audio_frames; // frames the sound was on in
+	double audio_fill; // audio_buffer_fill summed over them
+} hud_t;
+
+// Create the texture, call after init_sdl
+bool hud_open(hud_t *hud, const sdl_t *sdl, const chip8_t *chip8, bool visible);
+
+void hud_show(hud_t *hud, bool visible);
+
+// Count a frame once it is shown, present_ms is how long update_screen took or -1 if it didn't run
+void hud_frame(hud_t *hud, const sdl_t *sdl, const chip8_t *chip8, double present_ms, bool dropped);
+
+// Start timing again after the machine was paused, faulted or halted by the remote
+// debugger, so the time it stood still isn't counted as a frame
+void hud_resume(hud_t *hud, const chip8_t *chip8);
+
+// Copy the overlay onto the window, between SDL_RenderCopy of the display and SDL_RenderPresent
+void hud_draw(const hud_t *hud, SDL_Renderer *renderer);
+
+void hud_close(hud_t *hud);
+
+#endif
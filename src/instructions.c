@@ -1,22 +1,134 @@
 #include "instructions.h"
+#include "trace.h"
+#include "debugger.h"
+#include "fusion.h"
+#include "heatmap.h"
+#include "journal.h"
 // #include "debug.h"
 
-// CHIP8 INSTRUCTIONS
-void emulate_instructions(chip8_t *chip8, const config_t config){
-	// Get opcode from RAM
-	chip8->inst.opcode = (chip8->ram[chip8->PC] << 8) | chip8 -> ram[chip8->PC+1];
-	chip8->PC +=2;
+// Strict mode: stop at the faulting instruction instead of wrapping the access
+static void raise_fault(chip8_t *chip8, fault_kind_t kind, uint16_t pc, uint16_t address){
+	chip8->fault = (chip8_fault_t){
+		.kind = kind,
+		.PC = pc,
+		.opcode = chip8->inst.opcode,
+		.address = address,
+	};
+	chip8->PC = pc;
+	chip8->state = FAULTED;
+}
+
+// Would touching len bytes from address leave ram?
+static inline bool out_of_range(uint16_t address, uint16_t len){
+	return address + len > CHIP8_RAM_SIZE;
+}
+
+/*
+Opcode fetch through the page the last one came from: looking up pages[]
+every time puts an extra load on the PC -> opcode -> PC dependency chain
+*/
+static inline uint16_t fetch_opcode(chip8_t *chip8, uint16_t pc){
+	pc &= CHIP8_RAM_MASK;
+	const uint8_t offset = pc & CHIP8_PAGE_MASK;
+	if((pc >> CHIP8_PAGE_SHIFT) != chip8->code_page || offset == CHIP8_PAGE_MASK){
+		chip8->code_page = pc >> CHIP8_PAGE_SHIFT;
+		chip8->code = chip8->pages[chip8->code_page];
+		return ram_read16(chip8, pc);
+	}
+	return (chip8->code[offset] << 8) | chip8->code[offset + 1];
+}
+
+// 1NNN
+static inline void jump(chip8_t *chip8, uint16_t pc, uint16_t target){
+	// a jump to itself, or going round the same loop while the delay timer
+	// runs, is the program waiting: the whole iteration counts as idle
+	if(target <= pc && (chip8->delay_timer || target == pc)){
+		if(chip8->wait_jump_pc == pc){
+			chip8->idle_cycles += chip8->cycles - chip8->wait_jump_cycle;
+		}
+		chip8->wait_jump_pc = pc;
+		chip8->wait_jump_cycle = chip8->cycles;
+	}
+	chip8->PC = target;
+}
 
-	// SYMBOLS 
-	chip8->inst.NNN = chip8->inst.opcode & 0x0FFF;
-	chip8->inst.NN = chip8->inst.opcode & 0x0FF;
-	chip8->inst.N = chip8->inst.opcode & 0x0F;
-	chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
-	chip8->inst.Y = (chip8->inst.opcode >> 4) & 0x0F;
+// DXYN
+static inline void draw_sprite(chip8_t *chip8, uint16_t pc){
+	uint8_t x = chip8->V[chip8->inst.X];
+	uint8_t y = chip8->V[chip8->inst.Y];
 
-// #ifdef DEBUG
-// 	print_debug_output(chip8);
-// #endif
+	uint8_t height = chip8->inst.N;
+	const bool wrap = chip8->quirks & QUIRK_WRAP;
+
+	// wrap the coordinates if they are bigger than the screen size
+	x %= CHIP8_WIDTH;
+	y %= CHIP8_HEIGHT;
+
+	if(chip8->strict && out_of_range(chip8->I, height)){
+		raise_fault(chip8, FAULT_MEMORY, pc, chip8->I);
+		return;
+	}
+
+	// Set carry/collision flag to 0
+	chip8->V[0xF] = 0;
+
+	if(chip8->debugger){
+		debugger_check_read(chip8->debugger, chip8->I, height);
+	}
+	if(chip8->heatmap){
+		heatmap_read(chip8->heatmap, chip8->I, height);
+	}
+
+	// Loop to iterate over N rows in the sprite, each one XORed into a display row at once
+	for(uint8_t i = 0; i < height; i++){
+		const uint64_t sprite = (uint64_t)ram_read(chip8, chip8->I + i) << (CHIP8_WIDTH - 8);
+
+		// clip at the right edge, or carry on from the left one
+		uint64_t bits = sprite >> x;
+		if(wrap && x > 0){
+			bits |= sprite << (CHIP8_WIDTH - x);
+		}
+
+		// any pixel turned off is a collision
+		if(chip8->display[y] & bits){
+			chip8->V[0xF] = 1;
+		}
+		chip8->display[y] ^= bits;
+
+		// clip at the bottom, or carry on from the top
+		if(++y >= CHIP8_HEIGHT){
+			if(!wrap) break;
+			y = 0;
+		}
+	}
+	chip8->draw = true;
+}
+
+// FX65
+static inline void load_registers(chip8_t *chip8, uint16_t pc){
+	if(chip8->strict && out_of_range(chip8->I, chip8->inst.X + 1)){
+		raise_fault(chip8, FAULT_MEMORY, pc, chip8->I);
+		return;
+	}
+
+	if(chip8->debugger){
+		debugger_check_read(chip8->debugger, chip8->I, chip8->inst.X + 1);
+	}
+	if(chip8->heatmap){
+		heatmap_read(chip8->heatmap, chip8->I, chip8->inst.X + 1);
+	}
+
+	for(uint8_t i = 0; i <= chip8->inst.X; i++){
+		chip8->V[i] = ram_read(chip8, chip8->I+i);
+	}
+
+	if(chip8->quirks & QUIRK_LOAD_STORE_I){
+		chip8->I += chip8->inst.X + 1;
+	}
+}
+
+// Run the instruction decoded into chip8->inst, fetched from pc
+static inline void execute_instruction(chip8_t *chip8, uint16_t pc){
 	// EMULATING OPCODES INSTRUCTIONS
 	switch((chip8->inst.opcode >> 12) & 0x0F){
 
@@ -32,7 +144,12 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 				/*
 				Set Program Counter to last address of function(subroutine) call (pop it off the stack)
 				*/
-				chip8->PC = *--chip8->SP;
+				if(chip8->strict && chip8->SP == 0){
+					raise_fault(chip8, FAULT_STACK_UNDERFLOW, pc, 0);
+					break;
+				}
+				chip8->SP = (chip8->SP - 1) & CHIP8_STACK_MASK;
+				chip8->PC = chip8->stack[chip8->SP];
 
 			}
 			break;
@@ -42,7 +159,7 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 
 			// Jumps to address NNN
 
-			chip8->PC = chip8->inst.NNN;
+			jump(chip8, pc, chip8->inst.NNN);
 			break;
 
 		case 0x02:
@@ -52,7 +169,12 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 			Store Current Address from the program counter to the stack (PUSH IT TO THE STACK)
 			Set the program counter to NNN 
 			*/
-			*chip8->SP++ = chip8->PC; 
+			if(chip8->strict && chip8->SP >= CHIP8_STACK_DEPTH){
+				raise_fault(chip8, FAULT_STACK_OVERFLOW, pc, 0);
+				break;
+			}
+			chip8->stack[chip8->SP & CHIP8_STACK_MASK] = chip8->PC;
+			chip8->SP = (chip8->SP + 1) & CHIP8_STACK_MASK;
 			chip8->PC = chip8->inst.NNN;
 			break;
 
@@ -121,6 +243,10 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 
 					chip8->V[chip8->inst.X] |= chip8->V[chip8->inst.Y];
 
+					if(chip8->quirks & QUIRK_VF_RESET){
+						chip8->V[0xF] = 0;
+					}
+
 					break;
 
 				case 2:
@@ -129,6 +255,10 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 
 					chip8->V[chip8->inst.X] &= chip8->V[chip8->inst.Y];
 
+					if(chip8->quirks & QUIRK_VF_RESET){
+						chip8->V[0xF] = 0;
+					}
+
 					break;
 
 				case 3:
@@ -137,6 +267,10 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 
 					chip8->V[chip8->inst.X] ^= chip8->V[chip8->inst.Y];
 
+					if(chip8->quirks & QUIRK_VF_RESET){
+						chip8->V[0xF] = 0;
+					}
+
 					break;
 
 				case 4:
@@ -171,7 +305,9 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 				case 6:
 					// 0X8XY6
 					// Stores the least significant bit of VX in VF and then shifts VX to the right by 1
-
+					if(chip8->quirks & QUIRK_SHIFT_VY){
+						chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y];
+					}
 					chip8->V[0xF] = chip8->V[chip8->inst.X] & 1;
 
 					chip8->V[chip8->inst.X] >>= 1;
@@ -196,7 +332,9 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 				case 0xE:
 					// 0x8XYE
 					// Stores the most significant bit of VX in VF and then shifts VX to the left by 1
-
+					if(chip8->quirks & QUIRK_SHIFT_VY){
+						chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y];
+					}
 					chip8->V[0xF] = (chip8->V[chip8->inst.X] & 0x80) >> 7;
 
 					chip8->V[chip8->inst.X] <<= 1;
@@ -230,14 +368,19 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 			// 0xBNNN
 			// Jumps to the address NNN plus V0
 
-			chip8->PC = chip8->inst.NNN + chip8->V[0];
+			// BXNN on SUPER-CHIP
+			chip8->PC = chip8->inst.NNN + chip8->V[(chip8->quirks & QUIRK_JUMP_VX) ? chip8->inst.X : 0];
 
 			break;
 
 		case 0x0C:
 			// 0xCXNN
 			// Sets VX to the result of a bitwise and operation on a random number (Typically: 0 to 255) and NN
-			chip8->V[chip8->inst.X] = (rand() % 256) & chip8->inst.NN;
+			// per machine xorshift32, so instances never share a generator
+			chip8->rng ^= chip8->rng << 13;
+			chip8->rng ^= chip8->rng >> 17;
+			chip8->rng ^= chip8->rng << 5;
+			chip8->V[chip8->inst.X] = (chip8->rng >> 24) & chip8->inst.NN;
 
 			break;
 
@@ -248,46 +391,7 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 			*/
 			// 0xDXYN
 
-			uint8_t x = chip8->V[chip8->inst.X];
-			uint8_t y = chip8->V[chip8->inst.Y];
-
-			uint8_t og_x = x; // original x value
-
-			uint8_t height = chip8->inst.N;
-
-			// wrap the coordinates if they are bigger than the screen size
-			x %= config.window_width;
-			y %= config.window_height;
-
-			// Set carry/collision flag to 0
-			chip8->V[0xF] = 0;
-
-			// Loop to iterate over N rows in the sprite
-			for(uint8_t i = 0; i < height; i++){
-				uint8_t sprite_data = chip8->ram[chip8->I + i];
-
-				x = og_x; //reset x for next row
-				// Loop to iterate over each bit(pixel) in the sprite
-				for(int8_t j = 7; j >= 0; j--){
-					bool *pixel = &chip8 -> display[y*config.window_width + x];
-
-					bool sprite_bit = (sprite_data&(1<<j));
-
-					if(sprite_bit && *pixel){
-						chip8->V[0xF] = 1;
-					}
-
-					// XOR display pixel with sprite pixel to set it on or off
-					*pixel ^= sprite_bit;
-
-
-					// 
-					if(++x >= config.window_width) break;
-				}
-				// 
-				if(++y >= config.window_height) break;
-			}
-			chip8->draw = true;
+			draw_sprite(chip8, pc);
 			break;
 
 
@@ -297,7 +401,7 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 					// 0xEX9E
 					// Skips the next instruction if the key stored in VX is pressed (usually the next instruction is a jump to skip a code block)
 
-					if(chip8->keypad[chip8->V[chip8->inst.X]] == true){
+					if(chip8->keypad[chip8->V[chip8->inst.X] & 0xF] == true){
 						chip8->PC += 2;
 					}
 
@@ -307,7 +411,7 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 					// 0xEXA1
 					// Skips the next instruction if the key stored in VX is not pressed (usually the next instruction is a jump to skip a code block)
 
-					if(chip8->keypad[chip8->V[chip8->inst.X]] == false){
+					if(chip8->keypad[chip8->V[chip8->inst.X] & 0xF] == false){
 						chip8->PC += 2;
 					}
 
@@ -339,6 +443,7 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 				// keep getting the current opcode and running the this instruction until a key is pressed
 				if(key_pressed == false){
 					chip8->PC -= 2;
+					chip8->idle_cycles++;
 				}
 				
 				break;
@@ -383,24 +488,53 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 
 			case 0x33:
 				// 0xFX33
+				if(chip8->strict && out_of_range(chip8->I, 3)){
+					raise_fault(chip8, FAULT_MEMORY, pc, chip8->I);
+					break;
+				}
+
+				if(chip8->debugger){
+					debugger_check_write(chip8->debugger, chip8->I, 3);
+				}
+				if(chip8->heatmap){
+					heatmap_write(chip8->heatmap, chip8->I, 3);
+				}
+
 				uint8_t bcd = chip8->V[chip8->inst.X];
 
-				chip8->ram[chip8->I + 2] = bcd % 10;
+				ram_write(chip8, chip8->I + 2, bcd % 10);
 				bcd /= 10;
 
-				chip8->ram[chip8->I + 1] = bcd % 10;
+				ram_write(chip8, chip8->I + 1, bcd % 10);
 				bcd /= 10;
 
-				chip8->ram[chip8->I] = bcd % 10;
+				ram_write(chip8, chip8->I, bcd % 10);
+				fusion_invalidate(chip8, chip8->I, 3);
 
 				break;
 
 			case 0x55:
 				// 0xFX55
 				// Stores from V0 to VX (including VX) in memory, starting at address I. The offset from I is increased by 1 for each value written, but I itself is left unmodified
+				if(chip8->strict && out_of_range(chip8->I, chip8->inst.X + 1)){
+					raise_fault(chip8, FAULT_MEMORY, pc, chip8->I);
+					break;
+				}
+
+				if(chip8->debugger){
+					debugger_check_write(chip8->debugger, chip8->I, chip8->inst.X + 1);
+				}
+				if(chip8->heatmap){
+					heatmap_write(chip8->heatmap, chip8->I, chip8->inst.X + 1);
+				}
 
 				for(uint8_t i = 0; i <= chip8->inst.X; i++){
-					chip8->ram[chip8->I+i] = chip8->V[i];
+					ram_write(chip8, chip8->I+i, chip8->V[i]);
+				}
+				fusion_invalidate(chip8, chip8->I, chip8->inst.X + 1);
+
+				if(chip8->quirks & QUIRK_LOAD_STORE_I){
+					chip8->I += chip8->inst.X + 1;
 				}
 
 				break;
@@ -408,10 +542,7 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 			case 0x65:
 				// 0xFX65
 				// Fills from V0 to VX (including VX) with values from memory, starting at address I. The offset from I is increased by 1 for each value read, but I itself is left unmodified
-
-				for(uint8_t i = 0; i <= chip8->inst.X; i++){
-					chip8->V[i] = chip8->ram[chip8->I+i];
-				}
+				load_registers(chip8, pc);
 
 				break;
 
@@ -424,5 +555,146 @@ void emulate_instructions(chip8_t *chip8, const config_t config){
 		default:
 			break;
 	}
+}
+
+// CHIP8 INSTRUCTIONS
+void emulate_instructions(chip8_t *chip8){
+	if(chip8->debugger && debugger_should_break(chip8->debugger, chip8)){
+		debugger_prompt(chip8->debugger, chip8);
+		if(chip8->state != RUNNING){
+			return;
+		}
+	}
+
+	const uint16_t pc = chip8->PC;
+	uint8_t old_V[16];
+	if(chip8->trace){
+		memcpy(old_V, chip8->V, sizeof old_V);
+	}
+
+	// Get opcode from RAM
+	if(chip8->strict && out_of_range(pc, 2)){
+		chip8->inst.opcode = 0;
+		raise_fault(chip8, FAULT_MEMORY, pc, pc);
+		return;
+	}
+	const uint16_t opcode = fetch_opcode(chip8, pc);
+	if(chip8->heatmap){
+		heatmap_exec(chip8->heatmap, pc);
+	}
+	chip8->PC +=2;
+	chip8->cycles++;
+
+	// SYMBOLS 
+	decode_instruction(&chip8->inst, opcode);
+
+	if(chip8->journal){
+		journal_record(chip8->journal, chip8, pc);
+	}
+
+// #ifdef DEBUG
+// 	print_debug_output(chip8);
+// #endif
+	execute_instruction(chip8, pc);
+
+	if(chip8->trace){
+		trace_record(chip8->trace, chip8, pc, old_V);
+	}
+}
+
+// 7XNN or FX07, then 3XNN skipping a 1NNN: counter loops and delay timer waits.
+// Loops straight back to pc while the budget lasts
+static void run_fused_loop(chip8_t *chip8, uint16_t pc, uint32_t budget){
+	const uint16_t first = fusion_fetch(chip8, pc);
+	const uint16_t test = fusion_fetch(chip8, pc + 2);
+	const uint16_t back = fusion_fetch(chip8, pc + 4);
+	const uint8_t X = (first >> 8) & 0x0F;
+	const uint8_t test_X = (test >> 8) & 0x0F;
+	const bool timer = (first >> 12) == 0x0F;
+	uint32_t executed = 0;
+
+	do{
+		if(timer){
+			chip8->V[X] = chip8->delay_timer;
+		}
+		else{
+			chip8->V[X] += first & 0xFF;
+		}
+
+		if(chip8->V[test_X] == (test & 0xFF)){
+			// the jump is skipped
+			chip8->cycles += 2;
+			chip8->PC = pc + 6;
+			decode_instruction(&chip8->inst, test);
+			return;
+		}
+
+		chip8->cycles += 3;
+		jump(chip8, pc + 4, back & 0x0FFF);
+		executed += 3;
+	} while(chip8->PC == pc && budget - executed >= 3);
+
+	decode_instruction(&chip8->inst, back);
+}
+
+uint32_t emulate_fused(chip8_t *chip8, uint32_t budget){
+	const uint16_t pc = chip8->PC;
+	const fuse_kind_t kind = fusion_lookup(chip8, pc);
+	if(kind == FUSE_NONE || fusion_length(kind) > budget){
+		emulate_instructions(chip8);
+		return 1;
+	}
+
+	const uint64_t start = chip8->cycles;
+	chip8->fused_hits[kind]++;
+
+	switch(kind){
+		case FUSE_LOAD_LOAD_DRAW:{
+			const uint16_t first = fusion_fetch(chip8, pc);
+			const uint16_t second = fusion_fetch(chip8, pc + 2);
+			chip8->V[(first >> 8) & 0x0F] = first & 0xFF;
+			chip8->V[(second >> 8) & 0x0F] = second & 0xFF;
+			decode_instruction(&chip8->inst, fusion_fetch(chip8, pc + 4));
+			chip8->cycles += 3;
+			chip8->PC = pc + 6;
+			draw_sprite(chip8, pc + 4);
+			break;
+		}
+
+		case FUSE_INDEX_DRAW:
+		case FUSE_INDEX_LOAD:
+			chip8->I = fusion_fetch(chip8, pc) & 0x0FFF;
+			decode_instruction(&chip8->inst, fusion_fetch(chip8, pc + 2));
+			chip8->cycles += 2;
+			chip8->PC = pc + 4;
+			if(kind == FUSE_INDEX_DRAW){
+				draw_sprite(chip8, pc + 2);
+			}
+			else{
+				load_registers(chip8, pc + 2);
+			}
+			break;
+
+		case FUSE_COUNT_LOOP:
+		case FUSE_TIMER_WAIT:
+			run_fused_loop(chip8, pc, budget);
+			break;
+
+		case FUSE_SPIN:
+			// the first pass records the wait, every later one is one more idle cycle
+			decode_instruction(&chip8->inst, 0x1000 | pc);
+			chip8->cycles++;
+			jump(chip8, pc, pc);
+			chip8->cycles += budget - 1;
+			chip8->idle_cycles += budget - 1;
+			chip8->wait_jump_cycle = chip8->cycles;
+			break;
+
+		default:
+			break;
+	}
 
-}
\ No newline at end of file
+	const uint32_t executed = chip8->cycles - start;
+	chip8->fused_cycles += executed;
+	return executed;
+}
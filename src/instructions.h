@@ -3,6 +3,19 @@
 
 #include "chip8.h"
 
-void emulate_instructions(chip8_t *chip8, const config_t config);
+// Split an opcode into its symbols
+static inline void decode_instruction(instruction_t *inst, uint16_t opcode){
+	inst->opcode = opcode;
+	inst->NNN = opcode & 0x0FFF;
+	inst->NN = opcode & 0x0FF;
+	inst->N = opcode & 0x0F;
+	inst->X = (opcode >> 8) & 0x0F;
+	inst->Y = (opcode >> 4) & 0x0F;
+}
+
+void emulate_instructions(chip8_t *chip8);
+
+// Run the superinstruction at PC if it fits in budget, else one instruction. Returns instructions executed
+uint32_t emulate_fused(chip8_t *chip8, uint32_t budget);
 
 #endif
\ No newline at end of file
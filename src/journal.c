@@ -0,0 +1,209 @@
+#include "journal.h"
+#include "fusion.h"
+
+bool journal_open(journal_t *journal, uint64_t entries){
+	*journal = (journal_t){0};
+
+	// round down to a power of 2 so the ring index is a mask
+	journal->size = 1;
+	while(journal->size * 2 <= entries){
+		journal->size *= 2;
+	}
+
+	journal->ring = malloc(journal->size * sizeof(journal_entry_t));
+	if(!journal->ring){
+		fprintf(stderr, "could not allocate journal\n");
+		return false;
+	}
+	return true;
+}
+
+void journal_close(journal_t *journal){
+	free(journal->ring);
+	*journal = (journal_t){0};
+}
+
+void journal_clear(journal_t *journal){
+	journal->oldest = journal->head;
+}
+
+static inline void push(journal_t *journal, journal_kind_t kind, uint8_t index, uint16_t address, uint32_t value){
+	journal->ring[journal->head & (journal->size - 1)] = (journal_entry_t){
+		.value = value,
+		.address = address,
+		.kind = kind,
+		.index = index,
+	};
+	journal->head++;
+
+	if(journal->head - journal->oldest > journal->size){
+		journal->oldest = journal->head - journal->size;
+	}
+}
+
+static void push_row(journal_t *journal, const chip8_t *chip8, uint8_t row){
+	const uint64_t pixels = chip8->display[row % CHIP8_HEIGHT];
+	push(journal, JOURNAL_ROW_LEFT, row % CHIP8_HEIGHT, 0, pixels >> 32);
+	push(journal, JOURNAL_ROW_RIGHT, row % CHIP8_HEIGHT, 0, pixels & 0xFFFFFFFF);
+}
+
+static void push_ram(journal_t *journal, const chip8_t *chip8, uint16_t address, uint16_t len){
+	for(uint16_t i = 0; i < len; i++){
+		const uint16_t a = (address + i) & CHIP8_RAM_MASK;
+		push(journal, JOURNAL_RAM, 0, a, ram_read(chip8, a));
+	}
+}
+
+void journal_record(journal_t *journal, const chip8_t *chip8, uint16_t pc){
+	const instruction_t *inst = &chip8->inst;
+	push(journal, JOURNAL_INSTRUCTION, 0, pc, 0);
+
+	switch((inst->opcode >> 12) & 0x0F){
+		case 0x00:
+			if(inst->NN == 0xE0){
+				for(uint8_t row = 0; row < CHIP8_HEIGHT; row++){
+					push_row(journal, chip8, row);
+				}
+			}
+			else if(inst->NN == 0xEE){
+				push(journal, JOURNAL_SP, 0, 0, chip8->SP);
+			}
+			break;
+
+		case 0x02:
+			push(journal, JOURNAL_SP, 0, 0, chip8->SP);
+			push(journal, JOURNAL_STACK, chip8->SP & CHIP8_STACK_MASK, 0, chip8->stack[chip8->SP & CHIP8_STACK_MASK]);
+			break;
+
+		case 0x06:
+		case 0x07:
+			push(journal, JOURNAL_V, inst->X, 0, chip8->V[inst->X]);
+			break;
+
+		case 0x08:
+			push(journal, JOURNAL_V, inst->X, 0, chip8->V[inst->X]);
+			push(journal, JOURNAL_V, 0xF, 0, chip8->V[0xF]);
+			break;
+
+		case 0x0A:
+			push(journal, JOURNAL_I, 0, 0, chip8->I);
+			break;
+
+		case 0x0C:
+			push(journal, JOURNAL_V, inst->X, 0, chip8->V[inst->X]);
+			push(journal, JOURNAL_RNG, 0, 0, chip8->rng);
+			break;
+
+		case 0x0D:
+			push(journal, JOURNAL_V, 0xF, 0, chip8->V[0xF]);
+			for(uint8_t i = 0; i < inst->N && i < CHIP8_HEIGHT; i++){
+				push_row(journal, chip8, chip8->V[inst->Y] % CHIP8_HEIGHT + i);
+			}
+			break;
+
+		case 0x0F:
+			switch(inst->NN){
+				case 0x07:
+				case 0x0A:
+					push(journal, JOURNAL_V, inst->X, 0, chip8->V[inst->X]);
+					break;
+
+				case 0x15:
+				case 0x18:
+					push(journal, JOURNAL_TIMERS, 0, 0, chip8->delay_timer << 8 | chip8->sound_timer);
+					break;
+
+				case 0x1E:
+				case 0x29:
+					push(journal, JOURNAL_I, 0, 0, chip8->I);
+					break;
+
+				case 0x33:
+					push_ram(journal, chip8, chip8->I, 3);
+					break;
+
+				case 0x55:
+					push_ram(journal, chip8, chip8->I, inst->X + 1);
+					push(journal, JOURNAL_I, 0, 0, chip8->I);
+					break;
+
+				case 0x65:
+					for(uint8_t i = 0; i <= inst->X; i++){
+						push(journal, JOURNAL_V, i, 0, chip8->V[i]);
+					}
+					push(journal, JOURNAL_I, 0, 0, chip8->I);
+					break;
+			}
+			break;
+	}
+}
+
+void journal_timers(journal_t *journal, const chip8_t *chip8){
+	push(journal, JOURNAL_TIMERS, 0, 0, chip8->delay_timer << 8 | chip8->sound_timer);
+}
+
+bool journal_step_back(journal_t *journal, chip8_t *chip8){
+	// find the header of the last instruction, it has to still be in the ring
+	uint64_t start = journal->head;
+	while(start > journal->oldest){
+		start--;
+		if(journal->ring[start & (journal->size - 1)].kind == JOURNAL_INSTRUCTION){
+			break;
+		}
+	}
+	if(start == journal->head || journal->ring[start & (journal->size - 1)].kind != JOURNAL_INSTRUCTION){
+		return false;
+	}
+
+	// newest first, so the oldest value written back wins
+	while(journal->head > start){
+		const journal_entry_t *entry = &journal->ring[--journal->head & (journal->size - 1)];
+		switch(entry->kind){
+			case JOURNAL_INSTRUCTION:
+				chip8->PC = entry->address;
+				chip8->cycles--;
+				break;
+
+			case JOURNAL_V:
+				chip8->V[entry->index] = entry->value;
+				break;
+
+			case JOURNAL_I:
+				chip8->I = entry->value;
+				break;
+
+			case JOURNAL_SP:
+				chip8->SP = entry->value;
+				break;
+
+			case JOURNAL_STACK:
+				chip8->stack[entry->index] = entry->value;
+				break;
+
+			case JOURNAL_RAM:
+				ram_write(chip8, entry->address, entry->value);
+				fusion_invalidate(chip8, entry->address, 1);
+				break;
+
+			case JOURNAL_ROW_LEFT:
+			case JOURNAL_ROW_RIGHT:{
+				const uint32_t shift = entry->kind == JOURNAL_ROW_LEFT ? 32 : 0;
+				uint64_t *pixels = &chip8->display[entry->index % CHIP8_HEIGHT];
+				*pixels = (*pixels & ~((uint64_t)0xFFFFFFFF << shift)) | (uint64_t)entry->value << shift;
+				chip8->draw = true;
+				break;
+			}
+
+			case JOURNAL_TIMERS:
+				chip8->delay_timer = entry->value >> 8;
+				chip8->sound_timer = entry->value & 0xFF;
+				break;
+
+			case JOURNAL_RNG:
+				chip8->rng = entry->value;
+				break;
+		}
+	}
+
+	return true;
+}
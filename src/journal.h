@@ -0,0 +1,58 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "chip8.h"
+
+#define JOURNAL_DEFAULT_ENTRIES (1 << 23) // 64 MB, a few million instructions
+
+/*
+Undo log for reverse stepping. Before each instruction runs, the old value
+of everything it is about to write is appended to a ring of 8 byte entries,
+after a header entry with the PC it ran from. Stepping back pops entries
+down to the last header and puts the old values back. Once the ring is full
+the oldest instructions are overwritten.
+*/
+typedef enum {
+	JOURNAL_INSTRUCTION, // address = PC, starts the entries of one instruction
+	JOURNAL_V, // index = register
+	JOURNAL_I,
+	JOURNAL_SP,
+	JOURNAL_STACK, // index = slot
+	JOURNAL_RAM, // address, value = byte
+	JOURNAL_ROW_LEFT, // index = display row, value = pixels 0-31, the top half of the row
+	JOURNAL_ROW_RIGHT, // pixels 32-63, the bottom half
+	JOURNAL_TIMERS, // value = delay << 8 | sound, before a 60Hz tick
+	JOURNAL_RNG, // CXNN generator state
+} journal_kind_t;
+
+typedef struct {
+	uint32_t value;
+	uint16_t address;
+	uint8_t kind;
+	uint8_t index;
+} journal_entry_t;
+
+struct journal {
+	journal_entry_t *ring;
+	uint64_t size; // entries, power of 2
+	uint64_t head; // entries written, ring[head & (size-1)] is next
+	uint64_t oldest; // first entry not yet overwritten or undone past
+};
+
+bool journal_open(journal_t *journal, uint64_t entries);
+
+void journal_close(journal_t *journal);
+
+// Forget the history, after a reset
+void journal_clear(journal_t *journal);
+
+// Log what the instruction in chip8->inst, fetched from pc, is about to overwrite
+void journal_record(journal_t *journal, const chip8_t *chip8, uint16_t pc);
+
+// Log the timers before chip8_update_timers ticks them
+void journal_timers(journal_t *journal, const chip8_t *chip8);
+
+// Undo the last instruction, false if it is no longer in the ring
+bool journal_step_back(journal_t *journal, chip8_t *chip8);
+
+#endif
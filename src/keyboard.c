@@ -14,8 +14,82 @@ A 0 B F				Z X C V
 
 */
 
+// Game controller layout, d-pad on the usual 2/4/6/8 movement keys
+static const struct {
+	SDL_GameControllerButton button;
+	uint8_t key;
+} controller_layout[] = {
+	{SDL_CONTROLLER_BUTTON_DPAD_UP, 0x2},
+	{SDL_CONTROLLER_BUTTON_DPAD_DOWN, 0x8},
+	{SDL_CONTROLLER_BUTTON_DPAD_LEFT, 0x4},
+	{SDL_CONTROLLER_BUTTON_DPAD_RIGHT, 0x6},
+	{SDL_CONTROLLER_BUTTON_A, 0x5},
+	{SDL_CONTROLLER_BUTTON_B, 0x0},
+	{SDL_CONTROLLER_BUTTON_X, 0x7},
+	{SDL_CONTROLLER_BUTTON_Y, 0x9},
+	{SDL_CONTROLLER_BUTTON_LEFTSHOULDER, 0xA},
+	{SDL_CONTROLLER_BUTTON_RIGHTSHOULDER, 0xB},
+	{SDL_CONTROLLER_BUTTON_BACK, 0xE},
+	{SDL_CONTROLLER_BUTTON_START, 0xF},
+};
+
+// Letter or digit to its scancode
+static SDL_Scancode char_to_scancode(char c){
+	if(c >= 'a' && c <= 'z') return SDL_SCANCODE_A + (c - 'a');
+	if(c >= 'A' && c <= 'Z') return SDL_SCANCODE_A + (c - 'A');
+	if(c >= '1' && c <= '9') return SDL_SCANCODE_1 + (c - '1');
+	if(c == '0') return SDL_SCANCODE_0;
+	return SDL_SCANCODE_UNKNOWN;
+}
+
+bool init_keymap(keymap_t *keymap, const char *layout){
+	memset(keymap->scancodes, -1, sizeof(keymap->scancodes));
+	memset(keymap->buttons, -1, sizeof(keymap->buttons));
+	keymap->controller = NULL;
+	keymap->show_hud = false;
+	keymap->reset = false;
+
+	if(strlen(layout) != 16){
+		SDL_Log("keymap needs 16 keys, one for each CHIP-8 key 0-F\n");
+		return false;
+	}
+
+	for(uint8_t key = 0; key < 16; key++){
+		const SDL_Scancode scancode = char_to_scancode(layout[key]);
+		if(scancode == SDL_SCANCODE_UNKNOWN){
+			SDL_Log("keymap key '%c' is not a letter or digit\n", layout[key]);
+			return false;
+		}
+		keymap->scancodes[scancode] = key;
+	}
+
+	for(uint32_t i = 0; i < sizeof controller_layout / sizeof controller_layout[0]; i++){
+		keymap->buttons[controller_layout[i].button] = controller_layout[i].key;
+	}
+
+	return true;
+}
+
+void start_controllers(void){
+	if(SDL_InitSubSystem(SDL_INIT_GAMECONTROLLER) != 0){
+		SDL_Log("no game controllers: %s\n", SDL_GetError());
+	}
+}
+
+void close_keymap(keymap_t *keymap){
+	if(keymap->controller){
+		SDL_GameControllerClose(keymap->controller);
+		keymap->controller = NULL;
+	}
+}
 
-void handle_input(chip8_t *chip8){
+static void set_key(chip8_t *chip8, int8_t key, bool pressed){
+	if(key >= 0){
+		set_keypad(chip8, key, pressed);
+	}
+}
+
+void handle_input(chip8_t *chip8, keymap_t *keymap){
 	SDL_Event event;
 
 	while(SDL_PollEvent(&event)){
@@ -24,168 +98,76 @@ void handle_input(chip8_t *chip8){
 				chip8->state = QUIT;
 				return ;
 
+			case SDL_WINDOWEVENT:
+				// with the memory viewer open closing a window no longer sends SDL_QUIT,
+				// the viewer just hides and the main window quits
+				if(event.window.event == SDL_WINDOWEVENT_CLOSE){
+					SDL_Window *window = SDL_GetWindowFromID(event.window.windowID);
+					if(window && SDL_GetWindowData(window, "viewer")){
+						SDL_HideWindow(window);
+						break;
+					}
+					chip8->state = QUIT;
+					return;
+				}
+				break;
+
 			case SDL_KEYDOWN:
-				switch(event.key.keysym.sym){
-					case SDLK_ESCAPE:
+				switch(event.key.keysym.scancode){
+					case SDL_SCANCODE_ESCAPE:
 						chip8 -> state = QUIT;
 						return;
 
-					case SDLK_SPACE:
+					case SDL_SCANCODE_SPACE:
 						if(chip8->state == RUNNING){
 							chip8->state = PAUSED; // pause
 							puts("paused"); 
 						}
-						else{
+						else if(chip8->state == PAUSED){
 							chip8->state = RUNNING; // resume
 						}
 						break;
 
-					case SDLK_BACKSPACE:
-						init_chip8(chip8, chip8->rom_name);
-						break;
-
-					case SDLK_1:
-						chip8->keypad[0x1] =  true;
-						break;
-
-					case SDLK_2:
-						chip8->keypad[0x2] =  true;
-						break;
-
-					case SDLK_3:
-						chip8->keypad[0x3] =  true;
-						break;
-
-					case SDLK_4:
-						chip8->keypad[0xC] =  true;
-						break;
-
-					case SDLK_q:
-						chip8->keypad[0x4] =  true;
-						break;
-
-					case SDLK_w:
-						chip8->keypad[0x5] =  true;
-						break;
-
-					case SDLK_e:
-						chip8->keypad[0x6] =  true;
-						break;
-
-					case SDLK_r:
-						chip8->keypad[0xD] =  true;
-						break;
-
-					case SDLK_a:
-						chip8->keypad[0x7] =  true;
-						break;
-
-					case SDLK_s:
-						chip8->keypad[0x8] =  true;
-						break;
-
-					case SDLK_d:
-						chip8->keypad[0x9] =  true;
-						break;
-
-					case SDLK_f:
-						chip8->keypad[0xE] =  true;
-						break;
-
-					case SDLK_z:
-						chip8->keypad[0xA] =  true;
-						break;
-
-					case SDLK_x:
-						chip8->keypad[0x0] =  true;
-						break;
-
-					case SDLK_c:
-						chip8->keypad[0xB] =  true;
+					case SDL_SCANCODE_BACKSPACE:
+						keymap->reset = true;
 						break;
 
-					case SDLK_v:
-						chip8->keypad[0xF] =  true;
+					case SDL_SCANCODE_F1:
+						keymap->show_hud = !keymap->show_hud;
 						break;
 
-
 					default:
+						set_key(chip8, keymap->scancodes[event.key.keysym.scancode], true);
 						break;
 
 				}
 				break;
 
 			case SDL_KEYUP:
-				switch(event.key.keysym.sym){
-
-					case SDLK_1:
-						chip8->keypad[0x1] =  false;
-						break;
-
-					case SDLK_2:
-						chip8->keypad[0x2] =  false;
-						break;
-
-					case SDLK_3:
-						chip8->keypad[0x3] =  false;
-						break;
-
-					case SDLK_4:
-						chip8->keypad[0xC] =  false;
-						break;
-
-					case SDLK_q:
-						chip8->keypad[0x4] =  false;
-						break;
-
-					case SDLK_w:
-						chip8->keypad[0x5] =  false;
-						break;
-
-					case SDLK_e:
-						chip8->keypad[0x6] =  false;
-						break;
-
-					case SDLK_r:
-						chip8->keypad[0xD] =  false;
-						break;
-
-					case SDLK_a:
-						chip8->keypad[0x7] =  false;
-						break;
-
-					case SDLK_s:
-						chip8->keypad[0x8] =  false;
-						break;
-
-					case SDLK_d:
-						chip8->keypad[0x9] =  false;
-						break;
-
-					case SDLK_f:
-						chip8->keypad[0xE] =  false;
-						break;
-
-					case SDLK_z:
-						chip8->keypad[0xA] =  false;
-						break;
-
-					case SDLK_x:
-						chip8->keypad[0x0] =  false;
-						break;
-
-					case SDLK_c:
-						chip8->keypad[0xB] =  false;
-						break;
-
-					case SDLK_v:
-						chip8->keypad[0xF] =  false;
-						break;
+				set_key(chip8, keymap->scancodes[event.key.keysym.scancode], false);
+				break;
 
+			case SDL_CONTROLLERDEVICEADDED:
+				if(!keymap->controller){
+					keymap->controller = SDL_GameControllerOpen(event.cdevice.which);
+				}
+				break;
 
-					default:
-						break;
+			case SDL_CONTROLLERDEVICEREMOVED:
+				// only the controller in use matters, and its held buttons will never come back up
+				if(keymap->controller && event.cdevice.which ==
+					SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(keymap->controller))){
+					for(uint32_t i = 0; i < sizeof controller_layout / sizeof controller_layout[0]; i++){
+						set_key(chip8, controller_layout[i].key, false);
+					}
+					close_keymap(keymap);
+				}
+				break;
 
+			case SDL_CONTROLLERBUTTONDOWN:
+			case SDL_CONTROLLERBUTTONUP:
+				if(event.cbutton.button < SDL_CONTROLLER_BUTTON_MAX){
+					set_key(chip8, keymap->buttons[event.cbutton.button], event.type == SDL_CONTROLLERBUTTONDOWN);
 				}
 				break;
 
@@ -193,4 +175,4 @@ void handle_input(chip8_t *chip8){
 				break;
 		}
 	}
-}
\ No newline at end of file
+}
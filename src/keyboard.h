@@ -1,7 +1,7 @@
 #ifndef KEYBOARD_H
 #define KEYBOARD_H
 
-#include "chip8.h"
+#include "frontend.h"
 
 // User Input
 
@@ -15,7 +15,28 @@ A 0 B F				Z X C V
 
 */
 
+// QWERTY keys for CHIP-8 keys 0-F, by physical position
+#define DEFAULT_KEYMAP "x123qweasdzc4rfv"
 
-void handle_input(chip8_t *chip8);
+typedef struct {
+	int8_t scancodes[SDL_NUM_SCANCODES]; // CHIP-8 key for each scancode, -1 if unmapped
+	int8_t buttons[SDL_CONTROLLER_BUTTON_MAX]; // CHIP-8 key for each controller button
+	SDL_GameController *controller; // first connected game controller, if any
+	bool show_hud; // F1 flips it, the main loop shows or hides the HUD to match
+	bool reset; // Backspace sets it, the main loop resets the machine before the next frame
+} keymap_t;
 
-#endif
\ No newline at end of file
+/*
+Build the lookup tables. layout lists the keyboard key for CHIP-8 keys
+0 to F in order, letters and digits only (see DEFAULT_KEYMAP).
+*/
+bool init_keymap(keymap_t *keymap, const char *layout);
+
+// Start the game controller subsystem, controllers already plugged in then arrive as hotplug events
+void start_controllers(void);
+
+void close_keymap(keymap_t *keymap);
+
+void handle_input(chip8_t *chip8, keymap_t *keymap);
+
+#endif
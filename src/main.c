@@ -1,9 +1,33 @@
-#include "chip8.h"
+#include <signal.h>
+#include <time.h>
+#include "frontend.h"
 #include "screen.h"
 #include "keyboard.h"
-#include "instructions.h"
+#include "trace.h"
+#include "debugger.h"
+#include "capture.h"
+#include "shared.h"
+#include "adaptive.h"
+#include "viewer.h"
+#include "journal.h"
+#include "replay.h"
+#include "hud.h"
+#include "metrics.h"
+#include "sound.h"
+#include "remote.h"
+
+// Ctrl+C under --debug, the main loop breaks into the prompt at the next slice
+static volatile sig_atomic_t break_requested = 0;
+
+static void request_break(int signal){
+	(void)signal;
+	break_requested = 1;
+}
 
 int main(int argc, char **argv){
+	timings_t timings;
+	timings_start(&timings);
+
 	// NO ROM PASSED
 	if(argc<2){
 		printf("NO ROM PASSED\n");
@@ -16,54 +40,305 @@ int main(int argc, char **argv){
 	if(set_config(&config, argc, argv) == false){
 		exit(EXIT_FAILURE);
 	}
+	timings.enabled = config.timings;
+	timings_mark(&timings, "config");
+
+	// CHIP-8 Initialization
+	chip8_t *chip8 = chip8_create(time(NULL));
+	const char *rom_name = argv[1];
+	if(!chip8 || !init_chip8(chip8, rom_name)){
+		exit(EXIT_FAILURE);
+	}
+	chip8_set_clock(chip8, config.inst_per_sec);
+	chip8_set_timing(chip8, config.timing);
+	chip8_set_strict(chip8, config.strict);
+	chip8_set_fusion(chip8, config.fusion);
+	timings_mark(&timings, "rom");
+
+	// Quirk profile, settled before the window opens
+	select_quirks(chip8, &config);
+	timings_mark(&timings, "quirks");
 
 	// Initialization
 	sdl_t sdl = {0};
 	if(init_sdl(&sdl, &config) == false){
 		exit(EXIT_FAILURE);
 	}
+	timings_mark(&timings, "video");
 
-	// CHIP-8 Initialization
-	chip8_t chip8 = {0};
-	const char *rom_name = argv[1];
-	if(!init_chip8(&chip8, rom_name)){
+	// Memory Heatmap and Register Viewer
+	viewer_t viewer = {0};
+	if(config.viewer && !viewer_open(&viewer, chip8)){
 		exit(EXIT_FAILURE);
 	}
 
-	clear_screen(sdl, config);
+	// Performance Overlay, F1 shows and hides it
+	hud_t hud;
+	if(!hud_open(&hud, &sdl, chip8, config.hud)){
+		exit(EXIT_FAILURE);
+	}
+
+	// Run-Ahead, a second machine the future frames are emulated on
+	chip8_t *ahead = NULL;
+	if(config.run_ahead){
+		ahead = chip8_create(0);
+		if(!ahead){
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// Instruction Trace
+	trace_t trace = {0};
+	if(config.trace_file){
+		if(!trace_open(&trace, config.trace_file)){
+			exit(EXIT_FAILURE);
+		}
+		chip8->trace = &trace;
+	}
+
+	// Interactive Debugger, Ctrl+C stops at the next slice even after it detached
+	debugger_t debugger;
+	if(config.debugger){
+		debugger_init(&debugger);
+		chip8->debugger = &debugger;
+		signal(SIGINT, request_break); // replaces SDL's handler, which would quit
+	}
+
+	// Undo Journal for stepping backwards
+	journal_t journal = {0};
+	if(config.journal){
+		if(!journal_open(&journal, JOURNAL_DEFAULT_ENTRIES)){
+			exit(EXIT_FAILURE);
+		}
+		chip8->journal = &journal;
+	}
+
+	// Video Capture
+	static capture_t capture;
+	if(config.capture_file && !capture_start(&capture, config.capture_file)){
+		exit(EXIT_FAILURE);
+	}
+
+	// Shared Memory State Export
+	shared_t shared = {0};
+	if(config.shared_name && !shared_open(&shared, config.shared_name)){
+		exit(EXIT_FAILURE);
+	}
+
+	// Keyboard and Game Controller Mapping
+	keymap_t keymap;
+	if(!init_keymap(&keymap, config.keymap)){
+		exit(EXIT_FAILURE);
+	}
+	keymap.show_hud = config.hud;
+
+	// Input Recording and Playback
+	replay_recorder_t recorder = {0};
+	if(config.record_file && !replay_record_start(&recorder, config.record_file, chip8, config.input_slices)){
+		exit(EXIT_FAILURE);
+	}
+	replay_t replay = {0};
+	replay_cursor_t cursor = {0};
+	if(config.replay_file){
+		if(!replay_open(&replay, config.replay_file)){
+			exit(EXIT_FAILURE);
+		}
+		config.input_slices = replay.header->slices; // the first frame restores the recorded machine
+	}
+
+	// Metrics Export, counted per frame here and per buffer in the audio callback
+	metrics_t metrics = {0};
+	if(config.metrics_target){
+		if(!metrics_start(&metrics, config.metrics_target, config.metrics_interval * 1000)){
+			exit(EXIT_FAILURE);
+		}
+		audio_set_metrics(&metrics.blocks[METRICS_AUDIO]);
+	}
 
-	srand(time(NULL));
+	// Remote Debugger, its requests are run between slices
+	remote_t remote = {0};
+	if(config.remote_path && !remote_start(&remote, config.remote_path)){
+		exit(EXIT_FAILURE);
+	}
+
+	// Adaptive Clock
+	adaptive_t adaptive;
+	adaptive_init(&adaptive, chip8);
+
+	clear_screen(sdl, config);
+	timings_mark(&timings, "setup");
 
 	// Main Emulator Loop
-	while(chip8.state != QUIT){
+	bool first_frame = true;
+	bool halted = false; // the last pass stopped at PAUSED or FAULTED
+	while(chip8->state != QUIT){
 		// User Input
-		handle_input(&chip8);
+		handle_input(chip8, &keymap);
 
-		if(chip8.state == PAUSED){continue;}
+		// Backspace resets between frames, never part way through one: a recording
+		// only sees a reset as a frame starting from a machine it didn't end with
+		if(keymap.reset){
+			init_chip8(chip8, chip8->rom_name);
+			keymap.reset = false;
+		}
+
+		// While halted the loop waits for the client instead of spinning
+		if(remote.running){
+			remote_service_wait(&remote, chip8, chip8->state == RUNNING ? 0 : REMOTE_IDLE_MS);
+		}
+
+		// Nothing runs until a key resumes or resets it, so sleep until an event arrives
+		if(chip8->state == PAUSED || chip8->state == FAULTED){
+			if(!remote.running){
+				SDL_WaitEventTimeout(NULL, PAUSED_WAIT_MS);
+			}
+			halted = true;
+			continue;
+		}
+
+		// The time stood still isn't a frame, the HUD and metrics start timing again from here
+		if(halted){
+			hud_resume(&hud, chip8);
+			if(metrics.running){
+				metrics_resume(&metrics);
+			}
+			halted = false;
+		}
 
 		// Get time before running instructions
-		uint64_t start = SDL_GetPerformanceCounter();
+		const uint64_t start = SDL_GetPerformanceCounter();
+		const double frequency = SDL_GetPerformanceFrequency();
 
-		for(uint32_t i = 0; i < config.inst_per_sec/60; i++)
-		emulate_instructions(&chip8, config);
+		// A replay drives the keypad and says how many slices the frame ran
+		uint32_t slices = config.input_slices;
+		if(replay.data){
+			const int32_t recorded = replay_begin_frame(&replay, chip8, &cursor);
+			if(recorded < 0){
+				SDL_Log("replay finished after %llu frames, the keyboard has control\n", (unsigned long long)cursor.frame);
+				replay_close(&replay);
+			}
+			else{
+				slices = recorded;
+			}
+		}
+		replay_record_frame(&recorder, chip8);
 
-		// Get time after running instructions
-		uint64_t end = SDL_GetPerformanceCounter();
+		// Run the frame in slices spread over its 16.67ms, polling input
+		// between them so key changes reach the program mid-frame
+		bool missed_deadline = false;
+		for(uint32_t slice = 0; slice < slices && chip8->state == RUNNING; slice++){
+			if(slice > 0){
+				handle_input(chip8, &keymap);
+				if(remote.running){
+					remote_service(&remote, chip8);
+				}
+			}
+			if(shared.state){
+				shared_sync_keys(&shared, chip8);
+			}
+			if(replay.data){
+				chip8_set_keys(chip8, replay_slice_keys(&replay, &cursor, slice));
+			}
+			replay_record_keys(&recorder, chip8);
+			if(break_requested){
+				break_requested = 0;
+				debugger.break_next = true;
+				chip8->debugger = &debugger;
+			}
 
+			chip8_run_frame_part(chip8, slice, config.input_slices);
 
-		double time_elapsed = (double)((end-start)*1000)/SDL_GetPerformanceFrequency();
+			// Get time after running instructions
+			const uint64_t end = SDL_GetPerformanceCounter();
+			const double time_elapsed = (double)((end-start)*1000)/frequency;
+			const double deadline = 16.67 * (slice+1) / config.input_slices;
+			missed_deadline |= time_elapsed > deadline + 2.0;
 
-		// Delay for 60fps
-		SDL_Delay(16.67f > time_elapsed ? 16.67f - time_elapsed : 0);
-		// Update Window
-		if(chip8.draw){
-			update_screen(sdl, config, chip8);
-			chip8.draw = false;
+			// Delay until this slice's share of the 60fps frame is up, the
+			// first frame goes straight to the screen
+			SDL_Delay(!first_frame && deadline > time_elapsed ? deadline - time_elapsed : 0);
+		}
+		if(chip8->state == FAULTED){
+			SDL_Log("%s at PC %03X (opcode %04X, address %03X), backspace resets\n",
+				chip8_fault_name(chip8->fault.kind), chip8->fault.PC, chip8->fault.opcode, chip8->fault.address);
+		}
+		if(shared.state){
+			shared_publish(&shared, chip8);
+		}
+
+		// Record every emulated frame, the writer thread does the disk I/O
+		if(config.capture_file){
+			capture_frame(&capture, chip8);
+		}
+
+		update_timers(&sdl, chip8);
+		replay_record_end_frame(&recorder, chip8);
+		if(replay.data){
+			replay_end_frame(&replay, &cursor);
+		}
+
+		// Update Window, every frame when blending with previous frames.
+		// With run-ahead show where the program will be run_ahead frames
+		// from now if the keys stay as they are
+		const chip8_t *shown = chip8;
+		if(ahead){
+			chip8_run_ahead(chip8, ahead, config.run_ahead);
+			shown = ahead;
+		}
+		hud_show(&hud, keymap.show_hud);
+		double present_ms = -1;
+		uint32_t draw_calls = 0;
+		if(shown->draw || sdl.persist || hud.dirty){
+			const uint64_t present_start = SDL_GetPerformanceCounter();
+			draw_calls = update_screen(sdl, config, shown, &hud);
+			present_ms = (double)((SDL_GetPerformanceCounter() - present_start)*1000)/frequency;
+			hud.dirty = false;
+		}
+		chip8->draw = false;
+
+		// Nothing on screen waits for the controllers, they start once the first frame is up
+		if(first_frame){
+			timings_mark(&timings, "first frame");
+			start_controllers();
+			timings_mark(&timings, "controllers");
+			first_frame = false;
+		}
+
+		hud_frame(&hud, &sdl, chip8, present_ms, missed_deadline);
+		if(metrics.running){
+			metrics_frame(&metrics, chip8, missed_deadline, draw_calls);
+		}
+
+		if(viewer.window){
+			viewer_update(&viewer, chip8);
+		}
+
+		// Retune the clock and show the rate in the title bar
+		if(config.adaptive && adaptive_update(&adaptive, chip8, missed_deadline)){
+			char title[96];
+			snprintf(title, sizeof title, "CHIP-8 Emulator - %u IPS, %.0f%% idle%s",
+				adaptive.inst_per_frame * 60, adaptive.idle_ratio * 100, adaptive.backed_off ? ", host busy" : "");
+			SDL_SetWindowTitle(sdl.window, title);
 		}
-		update_timers(sdl, &chip8);
 	}
 
+	if(recorder.file){
+		replay_record_stop(&recorder, chip8);
+	}
+	remote_stop(&remote, chip8);
+	audio_set_metrics(NULL);
+	metrics_stop(&metrics);
+	replay_close(&replay);
+	viewer_close(&viewer, chip8);
+	hud_close(&hud);
+	shared_close(&shared);
+	capture_stop(&capture);
+	close_keymap(&keymap);
+	trace_close(&trace);
+	journal_close(&journal);
 	final_cleanup(sdl);
+	chip8_destroy(ahead);
+	chip8_destroy(chip8);
 
 	exit(EXIT_SUCCESS);
 }
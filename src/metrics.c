@@ -0,0 +1,286 @@
+#define _POSIX_C_SOURCE 200809L
+#include <poll.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "metrics.h"
+#include "unixsock.h"
+#include "timing.h"
+
+#define METRICS_TEXT_SIZE 8192
+
+// Upper bounds of the frame time buckets in ms, fine around 16.67
+static const double bucket_ms[METRICS_BUCKETS - 1] = {2, 4, 8, 12, 16, 17, 18, 20, 25, 33, 50, 100};
+
+static const struct {
+	const char *name;
+	const char *help;
+} metric_info[METRIC_COUNT] = {
+	[METRIC_INSTRUCTIONS] = {"instructions", "Instructions executed"},
+	[METRIC_IDLE_INSTRUCTIONS] = {"idle_instructions", "Instructions spent in wait loops"},
+	[METRIC_FRAMES] = {"frames", "Frames emulated"},
+	[METRIC_FRAME_MICROSECONDS] = {"frame_microseconds", "Host frame times summed"},
+	[METRIC_MISSED_DEADLINES] = {"missed_deadlines", "Frames that ran over their 16.67 ms"},
+	[METRIC_PRESENTS] = {"presents", "Frames shown in the window"},
+	[METRIC_DRAW_CALLS] = {"draw_calls", "Texture copies to the window"},
+	[METRIC_AUDIO_CALLBACKS] = {"audio_callbacks", "Audio buffers filled"},
+	[METRIC_AUDIO_UNDERRUNS] = {"audio_underruns", "Audio buffers asked for over two buffers late"},
+};
+
+typedef struct {
+	uint64_t counters[METRIC_COUNT];
+	uint64_t frame_time[METRICS_BUCKETS];
+} totals_t;
+
+void metrics_frame(metrics_t *metrics, const chip8_t *chip8, bool missed_deadline, uint32_t draw_calls){
+	metrics_block_t *block = &metrics->blocks[METRICS_MAIN];
+	const double now = host_ms();
+	const double frame_ms = now - metrics->last_frame_ms;
+	metrics->last_frame_ms = now;
+
+	// a reset starts the machine's counters again
+	const uint64_t cycles = chip8->cycles >= metrics->last_cycles ? chip8->cycles - metrics->last_cycles : chip8->cycles;
+	const uint64_t idle = chip8->idle_cycles >= metrics->last_idle_cycles ? chip8->idle_cycles - metrics->last_idle_cycles : chip8->idle_cycles;
+	metrics->last_cycles = chip8->cycles;
+	metrics->last_idle_cycles = chip8->idle_cycles;
+
+	metrics_add(block, METRIC_INSTRUCTIONS, cycles);
+	metrics_add(block, METRIC_IDLE_INSTRUCTIONS, idle);
+	metrics_add(block, METRIC_FRAMES, 1);
+	metrics_add(block, METRIC_FRAME_MICROSECONDS, frame_ms * 1000);
+	metrics_add(block, METRIC_MISSED_DEADLINES, missed_deadline);
+	metrics_add(block, METRIC_PRESENTS, draw_calls > 0);
+	metrics_add(block, METRIC_DRAW_CALLS, draw_calls);
+
+	uint32_t bucket = 0;
+	while(bucket < METRICS_BUCKETS - 1 && frame_ms > bucket_ms[bucket]){
+		bucket++;
+	}
+	const uint64_t count = atomic_load_explicit(&block->frame_time[bucket], memory_order_relaxed);
+	atomic_store_explicit(&block->frame_time[bucket], count + 1, memory_order_relaxed);
+}
+
+void metrics_resume(metrics_t *metrics){
+	metrics->last_frame_ms = host_ms();
+}
+
+static void sum_blocks(const metrics_t *metrics, totals_t *totals){
+	*totals = (totals_t){0};
+	for(uint32_t t = 0; t < METRICS_THREADS; t++){
+		const metrics_block_t *block = &metrics->blocks[t];
+		for(uint32_t m = 0; m < METRIC_COUNT; m++){
+			totals->counters[m] += atomic_load_explicit(&block->counters[m], memory_order_relaxed);
+		}
+		for(uint32_t b = 0; b < METRICS_BUCKETS; b++){
+			totals->frame_time[b] += atomic_load_explicit(&block->frame_time[b], memory_order_relaxed);
+		}
+	}
+}
+
+// Frame time at quantile q, interpolated inside its bucket; the unbounded bucket gives its lower bound
+static double frame_quantile(const totals_t *totals, double q){
+	uint64_t count = 0;
+	for(uint32_t b = 0; b < METRICS_BUCKETS; b++){
+		count += totals->frame_time[b];
+	}
+	if(count == 0){
+		return 0;
+	}
+
+	const double target = q * count;
+	uint64_t below = 0;
+	for(uint32_t b = 0; b < METRICS_BUCKETS - 1; b++){
+		const uint64_t in = totals->frame_time[b];
+		if(in && below + in >= target){
+			const double lower = b ? bucket_ms[b - 1] : 0;
+			return lower + (bucket_ms[b] - lower) * (target - below) / in;
+		}
+		below += in;
+	}
+	return bucket_ms[METRICS_BUCKETS - 2];
+}
+
+// snprintf onto the end of out, *used grows by the full length even when it doesn't fit
+static void append(char *out, size_t size, size_t *used, const char *format, ...){
+	va_list args;
+	va_start(args, format);
+	const int length = vsnprintf(*used < size ? out + *used : NULL, *used < size ? size - *used : 0, format, args);
+	va_end(args);
+	*used += length > 0 ? length : 0;
+}
+
+static const double quantiles[] = {0.5, 0.9, 0.99};
+
+static void format_prometheus(const totals_t *totals, double uptime, char *out, size_t size, size_t *used){
+	append(out, size, used, "# HELP chip8_uptime_seconds Time since the export started\n"
+		"# TYPE chip8_uptime_seconds gauge\nchip8_uptime_seconds %.3f\n", uptime);
+	for(uint32_t m = 0; m < METRIC_COUNT; m++){
+		if(m == METRIC_FRAME_MICROSECONDS){
+			continue; // the histogram's sum
+		}
+		append(out, size, used, "# HELP chip8_%s_total %s\n# TYPE chip8_%s_total counter\nchip8_%s_total %llu\n",
+			metric_info[m].name, metric_info[m].help, metric_info[m].name, metric_info[m].name,
+			(unsigned long long)totals->counters[m]);
+	}
+
+	append(out, size, used, "# HELP chip8_frame_seconds Host frame time\n# TYPE chip8_frame_seconds histogram\n");
+	uint64_t cumulative = 0;
+	for(uint32_t b = 0; b < METRICS_BUCKETS; b++){
+		cumulative += totals->frame_time[b];
+		if(b < METRICS_BUCKETS - 1){
+			append(out, size, used, "chip8_frame_seconds_bucket{le=\"%g\"} %llu\n", bucket_ms[b] / 1000, (unsigned long long)cumulative);
+		}
+		else{
+			append(out, size, used, "chip8_frame_seconds_bucket{le=\"+Inf\"} %llu\n", (unsigned long long)cumulative);
+		}
+	}
+	append(out, size, used, "chip8_frame_seconds_sum %.6f\nchip8_frame_seconds_count %llu\n",
+		totals->counters[METRIC_FRAME_MICROSECONDS] / 1e6, (unsigned long long)cumulative);
+
+	append(out, size, used, "# HELP chip8_frame_quantile_seconds Host frame time percentiles, from the histogram\n"
+		"# TYPE chip8_frame_quantile_seconds gauge\n");
+	for(uint32_t q = 0; q < sizeof quantiles / sizeof quantiles[0]; q++){
+		append(out, size, used, "chip8_frame_quantile_seconds{quantile=\"%g\"} %.6f\n", quantiles[q],
+			frame_quantile(totals, quantiles[q]) / 1000);
+	}
+}
+
+static void format_json(const totals_t *totals, double uptime, char *out, size_t size, size_t *used){
+	append(out, size, used, "{\n\t\"uptime_seconds\": %.3f,\n", uptime);
+	for(uint32_t m = 0; m < METRIC_COUNT; m++){
+		append(out, size, used, "\t\"%s\": %llu,\n", metric_info[m].name, (unsigned long long)totals->counters[m]);
+	}
+
+	append(out, size, used, "\t\"frame_ms\": {\n");
+	for(uint32_t q = 0; q < sizeof quantiles / sizeof quantiles[0]; q++){
+		append(out, size, used, "\t\t\"p%g\": %.3f,\n", quantiles[q] * 100, frame_quantile(totals, quantiles[q]));
+	}
+	append(out, size, used, "\t\t\"buckets\": [");
+	for(uint32_t b = 0; b < METRICS_BUCKETS; b++){
+		if(b < METRICS_BUCKETS - 1){
+			append(out, size, used, "{\"le\": %g, \"frames\": %llu}, ", bucket_ms[b], (unsigned long long)totals->frame_time[b]);
+		}
+		else{
+			append(out, size, used, "{\"le\": null, \"frames\": %llu}]\n\t}\n}\n", (unsigned long long)totals->frame_time[b]);
+		}
+	}
+}
+
+size_t metrics_format(const metrics_t *metrics, char *out, size_t size){
+	totals_t totals;
+	sum_blocks(metrics, &totals);
+	const double uptime = (host_ms() - metrics->start_ms) / 1000;
+
+	size_t used = 0;
+	if(size){
+		out[0] = '\0';
+	}
+	if(metrics->format == METRICS_JSON){
+		format_json(&totals, uptime, out, size, &used);
+	}
+	else{
+		format_prometheus(&totals, uptime, out, size, &used);
+	}
+	return used;
+}
+
+// Write beside the file and rename over it, so readers never see half an export
+static void write_file(const metrics_t *metrics, char *text){
+	const size_t length = metrics_format(metrics, text, METRICS_TEXT_SIZE);
+	char temp[4096];
+	snprintf(temp, sizeof temp, "%s.tmp", metrics->path);
+
+	FILE *file = fopen(temp, "w");
+	if(!file){
+		fprintf(stderr, "could not write metrics to %s\n", temp);
+		return;
+	}
+	fwrite(text, 1, length < METRICS_TEXT_SIZE ? length : METRICS_TEXT_SIZE - 1, file);
+	if(fclose(file) != 0 || rename(temp, metrics->path) != 0){
+		fprintf(stderr, "could not write metrics to %s\n", metrics->path);
+	}
+}
+
+// A client connected: send the counters as they are now and hang up
+static void serve_client(const metrics_t *metrics, char *text){
+	const int client = accept(metrics->listen_fd, NULL, NULL);
+	if(client < 0){
+		return;
+	}
+
+	size_t length = metrics_format(metrics, text, METRICS_TEXT_SIZE);
+	length = length < METRICS_TEXT_SIZE ? length : METRICS_TEXT_SIZE - 1;
+	for(size_t sent = 0; sent < length;){
+		const ssize_t n = send(client, text + sent, length - sent, MSG_NOSIGNAL);
+		if(n <= 0){
+			break;
+		}
+		sent += n;
+	}
+	close(client);
+}
+
+static void *metrics_thread(void *arg){
+	metrics_t *metrics = arg;
+	char *text = malloc(METRICS_TEXT_SIZE);
+	if(!text){
+		fprintf(stderr, "Out of memory for metrics\n");
+		return NULL;
+	}
+
+	for(bool stop = false; !stop;){
+		struct pollfd fds[2] = {{.fd = metrics->wake[0], .events = POLLIN}, {.fd = metrics->listen_fd, .events = POLLIN}};
+		const int ready = poll(fds, metrics->socket ? 2 : 1, metrics->socket ? -1 : (int)metrics->interval_ms);
+		stop = ready > 0 && (fds[0].revents & POLLIN);
+
+		if(metrics->socket){
+			if(ready > 0 && (fds[1].revents & POLLIN)){
+				serve_client(metrics, text);
+			}
+		}
+		else if(ready >= 0){
+			write_file(metrics, text); // every interval, and once more on the way out
+		}
+	}
+
+	free(text);
+	return NULL;
+}
+
+bool metrics_start(metrics_t *metrics, const char *target, uint32_t interval_ms){
+	*metrics = (metrics_t){
+		.listen_fd = -1,
+		.wake = {-1, -1},
+		.interval_ms = interval_ms ? interval_ms : METRICS_DEFAULT_INTERVAL * 1000,
+	};
+	metrics->socket = strncmp(target, "unix:", 5) == 0;
+	metrics->path = metrics->socket ? target + 5 : target;
+	const size_t length = strlen(metrics->path);
+	metrics->format = length > 5 && strcmp(metrics->path + length - 5, ".json") == 0 ? METRICS_JSON : METRICS_PROMETHEUS;
+	metrics->start_ms = metrics->last_frame_ms = host_ms();
+
+	if(metrics->socket && (metrics->listen_fd = unixsock_listen(metrics->path, 8, "metrics")) < 0){
+		return false;
+	}
+	if(pipe(metrics->wake) != 0 || pthread_create(&metrics->thread, NULL, metrics_thread, metrics) != 0){
+		fprintf(stderr, "could not start the metrics thread\n");
+		unixsock_close(&metrics->listen_fd, metrics->wake, metrics->path);
+		return false;
+	}
+
+	metrics->running = true;
+	return true;
+}
+
+void metrics_stop(metrics_t *metrics){
+	if(!metrics->running){
+		return;
+	}
+
+	if(write(metrics->wake[1], "", 1) != 1){
+		fprintf(stderr, "could not stop the metrics thread\n");
+	}
+	pthread_join(metrics->thread, NULL);
+	unixsock_close(&metrics->listen_fd, metrics->wake, metrics->path);
+	metrics->running = false;
+}
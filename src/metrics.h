@@ -0,0 +1,90 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "chip8.h"
+
+/*
+Metrics export for unattended runs. Every thread that counts something
+has its own block of counters that only it writes, with plain relaxed
+stores, so counting never contends. An exporter thread sums the blocks
+every interval and writes them in Prometheus text format, or JSON when the
+target ends in .json, either to a file (replaced whole, never half
+written) or, for a target of unix:PATH, to every client that connects to
+that socket.
+*/
+
+#define METRICS_DEFAULT_INTERVAL 10 // seconds
+#define METRICS_BUCKETS 13 // frame time histogram buckets, the last one unbounded
+
+typedef enum {
+	METRIC_INSTRUCTIONS,
+	METRIC_IDLE_INSTRUCTIONS,
+	METRIC_FRAMES,
+	METRIC_FRAME_MICROSECONDS, // frame times summed
+	METRIC_MISSED_DEADLINES,
+	METRIC_PRESENTS,
+	METRIC_DRAW_CALLS, // SDL_RenderCopy calls for the main window
+	METRIC_AUDIO_CALLBACKS,
+	METRIC_AUDIO_UNDERRUNS, // callbacks later than two buffers after the last one
+	METRIC_COUNT
+} metric_t;
+
+typedef enum {
+	METRICS_MAIN, // the emulator loop
+	METRICS_AUDIO, // the SDL audio callback
+	METRICS_THREADS
+} metrics_thread_t;
+
+typedef enum {
+	METRICS_PROMETHEUS,
+	METRICS_JSON,
+} metrics_format_t;
+
+// One thread's counters, padded so two threads never share a cache line
+typedef struct {
+	_Alignas(64) _Atomic uint64_t counters[METRIC_COUNT];
+	_Atomic uint64_t frame_time[METRICS_BUCKETS]; // frames per bucket, see metrics.c
+} metrics_block_t;
+
+typedef struct {
+	metrics_block_t blocks[METRICS_THREADS];
+	metrics_format_t format;
+	const char *path; // output file or socket
+	bool socket;
+	int listen_fd; // -1 when writing a file
+	int wake[2]; // pipe, a byte in it stops the exporter
+	uint32_t interval_ms;
+	double start_ms;
+	pthread_t thread;
+	bool running;
+
+	// emulator loop only
+	uint64_t last_cycles;
+	uint64_t last_idle_cycles;
+	double last_frame_ms;
+} metrics_t;
+
+// Start exporting to a file path or unix:PATH every interval_ms
+bool metrics_start(metrics_t *metrics, const char *target, uint32_t interval_ms);
+
+// Add to a counter, only from the thread that owns the block
+static inline void metrics_add(metrics_block_t *block, metric_t metric, uint64_t n){
+	const uint64_t value = atomic_load_explicit(&block->counters[metric], memory_order_relaxed);
+	atomic_store_explicit(&block->counters[metric], value + n, memory_order_relaxed);
+}
+
+// Count a finished frame of the emulator loop
+void metrics_frame(metrics_t *metrics, const chip8_t *chip8, bool missed_deadline, uint32_t draw_calls);
+
+// The machine runs again after a pause, fault or remote halt: the next frame is timed from now
+void metrics_resume(metrics_t *metrics);
+
+// Write the counters summed over every block, returns the length as snprintf does
+size_t metrics_format(const metrics_t *metrics, char *out, size_t size);
+
+// Write a last export and stop the exporter
+void metrics_stop(metrics_t *metrics);
+
+#endif
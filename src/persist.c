@@ -0,0 +1,78 @@
+#include <string.h>
+#include "persist.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define PERSIST_SSE2
+#endif
+
+void persist_init(persist_t *persist, persist_mode_t mode, uint8_t decay, uint32_t frames){
+	memset(persist, 0, sizeof(persist_t));
+	persist->mode = mode;
+	persist->decay = decay;
+	persist->frames = frames < 1 ? 1 : frames > PERSIST_MAX_FRAMES ? PERSIST_MAX_FRAMES : frames;
+}
+
+// intensity = max(lit ? 255 : 0, intensity * decay / 256)
+static void phosphor(persist_t *persist, const uint8_t *display){
+	uint32_t i = 0;
+#ifdef PERSIST_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i decay = _mm_set1_epi16(persist->decay);
+	for(; i + 16 <= PERSIST_PIXELS; i += 16){
+		const __m128i lit = _mm_cmpgt_epi8(_mm_loadu_si128((const __m128i *)&display[i]), zero);
+		const __m128i prev = _mm_loadu_si128((const __m128i *)&persist->intensity[i]);
+
+		// widen to 16 bits for the multiply, narrow back
+		const __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(prev, zero), decay), 8);
+		const __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(prev, zero), decay), 8);
+		const __m128i faded = _mm_packus_epi16(lo, hi);
+
+		_mm_storeu_si128((__m128i *)&persist->intensity[i], _mm_max_epu8(lit, faded));
+	}
+#endif
+	for(; i < PERSIST_PIXELS; i++){
+		const uint8_t faded = (persist->intensity[i] * persist->decay) >> 8;
+		persist->intensity[i] = display[i] ? 255 : faded;
+	}
+}
+
+// intensity = 255 if lit in any of the last frames
+static void blend(persist_t *persist, const uint8_t *display){
+	memcpy(persist->history[persist->next], display, PERSIST_PIXELS);
+	persist->next = (persist->next + 1) % persist->frames;
+
+	uint32_t i = 0;
+#ifdef PERSIST_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for(; i + 16 <= PERSIST_PIXELS; i += 16){
+		__m128i any = zero;
+		for(uint32_t f = 0; f < persist->frames; f++){
+			any = _mm_or_si128(any, _mm_loadu_si128((const __m128i *)&persist->history[f][i]));
+		}
+		_mm_storeu_si128((__m128i *)&persist->intensity[i], _mm_cmpgt_epi8(any, zero));
+	}
+#endif
+	for(; i < PERSIST_PIXELS; i++){
+		uint8_t any = 0;
+		for(uint32_t f = 0; f < persist->frames; f++){
+			any |= persist->history[f][i];
+		}
+		persist->intensity[i] = any ? 255 : 0;
+	}
+}
+
+const uint8_t *persist_apply(persist_t *persist, const uint8_t *display){
+	switch(persist->mode){
+		case PERSIST_PHOSPHOR:
+			phosphor(persist, display);
+			return persist->intensity;
+
+		case PERSIST_BLEND:
+			blend(persist, display);
+			return persist->intensity;
+
+		default:
+			return display;
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PERSIST_PIXELS (64*32)
+#define PERSIST_MAX_FRAMES 8
+
+// Flicker reduction, blends the display with previous frames before it is scaled
+typedef enum {
+	PERSIST_OFF,
+	PERSIST_PHOSPHOR, // lit pixels fade out by decay/256 per frame
+	PERSIST_BLEND, // a pixel is lit if it was lit in any of the last frames
+} persist_mode_t;
+
+typedef struct {
+	persist_mode_t mode;
+	uint8_t decay; // PERSIST_PHOSPHOR: brightness kept each frame, out of 256
+	uint32_t frames; // PERSIST_BLEND: frames ORed together
+	uint32_t next; // next history slot
+	uint8_t history[PERSIST_MAX_FRAMES][PERSIST_PIXELS];
+	uint8_t intensity[PERSIST_PIXELS]; // output, 0 = off, 255 = fully lit
+} persist_t;
+
+void persist_init(persist_t *persist, persist_mode_t mode, uint8_t decay, uint32_t frames);
+
+/*
+Feed one frame of the display (0/1 per pixel) and return the intensity
+buffer to draw. Runs once per presented frame whether or not the game drew.
+*/
+const uint8_t *persist_apply(persist_t *persist, const uint8_t *display);
+
+#endif
@@ -0,0 +1,160 @@
+#include <pthread.h>
+#include <inttypes.h>
+#include "quirks.h"
+
+static const char *profile_names[PROFILE_COUNT] = {"default", "vip", "schip", "xochip"};
+
+static const uint8_t profile_flags[PROFILE_COUNT] = {
+	[PROFILE_DEFAULT] = 0,
+	[PROFILE_VIP] = QUIRK_VF_RESET | QUIRK_SHIFT_VY | QUIRK_LOAD_STORE_I,
+	[PROFILE_SCHIP] = QUIRK_JUMP_VX,
+	[PROFILE_XOCHIP] = QUIRK_SHIFT_VY | QUIRK_LOAD_STORE_I | QUIRK_WRAP,
+};
+
+quirk_profile_t profile_from_name(const char *name){
+	for(uint32_t i = 0; i < PROFILE_COUNT; i++){
+		if(strcmp(name, profile_names[i]) == 0){
+			return (quirk_profile_t)i;
+		}
+	}
+	return PROFILE_COUNT;
+}
+
+const char *profile_name(quirk_profile_t profile){
+	return profile < PROFILE_COUNT ? profile_names[profile] : "unknown";
+}
+
+uint8_t profile_quirks(quirk_profile_t profile){
+	return profile < PROFILE_COUNT ? profile_flags[profile] : 0;
+}
+
+uint64_t quirks_rom_hash(const chip8_t *chip8){
+	uint64_t hash = 0xcbf29ce484222325;
+	for(uint32_t i = CHIP8_ENTRY_POINT; i < CHIP8_RAM_SIZE; i++){
+		hash = (hash ^ ram_read(chip8, i)) * 0x100000001b3;
+	}
+	return hash;
+}
+
+typedef struct {
+	chip8_t *chip8;
+	quirk_profile_t profile;
+	int32_t score;
+} detect_run_t;
+
+static void *detect_thread(void *arg){
+	detect_run_t *run = arg;
+	chip8_t *chip8 = run->chip8;
+	chip8_set_quirks(chip8, profile_quirks(run->profile));
+	chip8_set_strict(chip8, true);
+
+	int32_t score = 0;
+	uint32_t changes = 0;
+	for(uint32_t frame = 0; frame < DETECT_FRAMES; frame++){
+		// hold each key for a few frames so menus and games get going
+		chip8_set_keys(chip8, (frame / 8) % 2 ? 1 << ((frame / 16) % 16) : 0);
+
+		uint64_t before[CHIP8_HEIGHT];
+		memcpy(before, chip8->display, sizeof before);
+		chip8_run_frame(chip8);
+
+		if(chip8->state == FAULTED){
+			// the sooner it broke the worse
+			score -= 1000 + (DETECT_FRAMES - frame) * 10;
+			break;
+		}
+
+		if(chip8->I >= CHIP8_RAM_SIZE){
+			score -= 10;
+		}
+
+		uint32_t lit = 0;
+		for(uint32_t y = 0; y < CHIP8_HEIGHT; y++){
+			lit += __builtin_popcountll(chip8->display[y]);
+		}
+		if(lit > CHIP8_WIDTH * CHIP8_HEIGHT * 3 / 4){
+			score -= 2; // a screen that is mostly lit is usually garbage
+		}
+
+		changes += memcmp(before, chip8->display, sizeof before) != 0;
+	}
+
+	// a program that draws something and keeps drawing looks alive
+	score += changes < DETECT_FRAMES / 3 ? changes : DETECT_FRAMES / 3;
+	run->score = score;
+	return NULL;
+}
+
+quirk_profile_t quirks_detect(const chip8_t *chip8, int32_t scores[PROFILE_COUNT]){
+	detect_run_t runs[PROFILE_COUNT] = {0};
+	pthread_t threads[PROFILE_COUNT];
+	bool started[PROFILE_COUNT] = {0};
+
+	for(uint32_t i = 0; i < PROFILE_COUNT; i++){
+		runs[i].profile = i;
+		runs[i].score = INT32_MIN;
+		runs[i].chip8 = chip8_create(1);
+		if(!runs[i].chip8){
+			continue;
+		}
+
+		chip8_snapshot(chip8, runs[i].chip8);
+		runs[i].chip8->trace = NULL;
+		runs[i].chip8->debugger = NULL;
+		runs[i].chip8->heatmap = NULL;
+		runs[i].chip8->journal = NULL;
+
+		started[i] = pthread_create(&threads[i], NULL, detect_thread, &runs[i]) == 0;
+		if(!started[i]){
+			detect_thread(&runs[i]); // no thread, run it here
+		}
+	}
+
+	quirk_profile_t best = PROFILE_DEFAULT;
+	for(uint32_t i = 0; i < PROFILE_COUNT; i++){
+		if(started[i]){
+			pthread_join(threads[i], NULL);
+		}
+		chip8_destroy(runs[i].chip8);
+
+		if(scores){
+			scores[i] = runs[i].score;
+		}
+		if(runs[i].score > runs[best].score){
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+bool quirks_cache_find(const char *path, uint64_t hash, quirk_profile_t *profile){
+	FILE *file = fopen(path, "r");
+	if(!file){
+		return false;
+	}
+
+	bool found = false;
+	uint64_t line_hash;
+	char name[16];
+	while(fscanf(file, "%" SCNx64 " %15s", &line_hash, name) == 2){
+		const quirk_profile_t line_profile = profile_from_name(name);
+		if(line_hash == hash && line_profile != PROFILE_COUNT){
+			*profile = line_profile;
+			found = true; // keep going, later lines win
+		}
+	}
+
+	fclose(file);
+	return found;
+}
+
+bool quirks_cache_store(const char *path, uint64_t hash, quirk_profile_t profile){
+	FILE *file = fopen(path, "a");
+	if(!file){
+		return false;
+	}
+
+	fprintf(file, "%016" PRIx64 " %s\n", hash, profile_name(profile));
+	return fclose(file) == 0;
+}
@@ -0,0 +1,40 @@
+#ifndef QUIRKS_H
+#define QUIRKS_H
+
+#include "chip8.h"
+
+// Quirk sets of the interpreters ROMs are usually written for
+typedef enum {
+	PROFILE_DEFAULT, // this emulator's original behaviour
+	PROFILE_VIP, // COSMAC VIP, the original CHIP-8
+	PROFILE_SCHIP, // SUPER-CHIP 1.1 on the HP48
+	PROFILE_XOCHIP, // XO-CHIP / Octo
+	PROFILE_COUNT
+} quirk_profile_t;
+
+#define DETECT_FRAMES 180 // three seconds of each profile
+
+quirk_profile_t profile_from_name(const char *name); // PROFILE_COUNT if unknown
+
+const char *profile_name(quirk_profile_t profile);
+
+uint8_t profile_quirks(quirk_profile_t profile);
+
+// FNV-1a of the program area, identifies the loaded ROM
+uint64_t quirks_rom_hash(const chip8_t *chip8);
+
+/*
+Run the loaded ROM for DETECT_FRAMES frames under every profile, one thread
+each, in strict mode with a fixed key pattern. Runs lose points for faults,
+I pointing outside ram and screens that are blank, frozen or mostly lit.
+Returns the best profile, ties go to the lower one so PROFILE_DEFAULT wins
+unless another profile does better. scores may be NULL.
+*/
+quirk_profile_t quirks_detect(const chip8_t *chip8, int32_t scores[PROFILE_COUNT]);
+
+// Results file of "hash profile" lines
+bool quirks_cache_find(const char *path, uint64_t hash, quirk_profile_t *profile);
+
+bool quirks_cache_store(const char *path, uint64_t hash, quirk_profile_t profile);
+
+#endif
@@ -0,0 +1,571 @@
+#define _POSIX_C_SOURCE 200809L
+#include <poll.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "remote.h"
+#include "fusion.h"
+#include "unixsock.h"
+
+/*
+Commands, numbers are hex. Each gets a line back, "ok" and what it asked
+for or "error" and why.
+
+	halt			stop at this slice boundary
+	continue		run again, breakpoints at the current PC don't fire straight away
+	step [N]		run N instructions (default 1) while halted
+	wait			hold the rest of the request until the machine stops
+	status			running, or halted and why: halt step break watch fault pause
+	regs			PC I SP DT ST, V0-VF as 32 hex digits, the stack in use
+	set REG VALUE		V0-VF, I, PC, SP, DT or ST
+	break ADDR		add a breakpoint
+	delete ADDR		remove one
+	watch r|w|rw ADDR [LEN]	watch reads and/or writes of ram[ADDR..ADDR+LEN-1]
+	unwatch ADDR [LEN]	stop watching them
+	read ADDR LEN		ram as hex
+	write ADDR HEX		ram from hex
+	fb			the display as hex, 8 pixels a byte (top bit leftmost), 8 bytes a row
+	fbwrite HEX		the same back
+	detach			drop every breakpoint and watchpoint and run, as when the client hangs up
+
+"continue;wait;regs;read 3C0 40" runs to the next breakpoint and reads the
+state there in one round trip.
+*/
+
+#define FB_BYTES (CHIP8_WIDTH * CHIP8_HEIGHT / 8)
+
+static const char *reason_names[] = {
+	[STOP_NONE] = "running",
+	[STOP_HALT] = "halt",
+	[STOP_STEP] = "step",
+	[STOP_BREAK] = "break",
+	[STOP_WATCH] = "watch",
+	[STOP_FAULT] = "fault",
+	[STOP_PAUSE] = "pause",
+};
+
+static void reply(remote_t *remote, const char *format, ...){
+	const size_t room = REMOTE_LINE_SIZE - remote->reply_length;
+	va_list args;
+	va_start(args, format);
+	const int n = vsnprintf(remote->reply + remote->reply_length, room, format, args);
+	va_end(args);
+	remote->reply_length += n < 0 ? 0 : (size_t)n < room ? (size_t)n : room - 1;
+}
+
+static void reply_hex(remote_t *remote, const uint8_t *data, size_t size){
+	static const char digits[] = "0123456789ABCDEF";
+	char *out = remote->reply + remote->reply_length;
+	const size_t room = REMOTE_LINE_SIZE - remote->reply_length - 1;
+	size_t i = 0;
+	for(; i < size && 2 * i + 2 <= room; i++){
+		out[2 * i] = digits[data[i] >> 4];
+		out[2 * i + 1] = digits[data[i] & 0xF];
+	}
+	remote->reply_length += 2 * i;
+	remote->reply[remote->reply_length] = '\0';
+}
+
+static int hex_digit(char c){
+	return c >= '0' && c <= '9' ? c - '0' : c >= 'A' && c <= 'F' ? c - 'A' + 10 : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// Bytes in hex, -1 if it isn't whole bytes of hex or doesn't fit
+static int32_t parse_hex(const char *hex, uint8_t *out, size_t max){
+	size_t size = 0;
+	for(; hex[0] && hex[1]; hex += 2){
+		const int high = hex_digit(hex[0]), low = hex_digit(hex[1]);
+		if(high < 0 || low < 0 || size == max){
+			return -1;
+		}
+		out[size++] = high << 4 | low;
+	}
+	return hex[0] ? -1 : (int32_t)size;
+}
+
+static bool parse_number(const char *text, uint32_t *value){
+	char *end;
+	*value = strtoul(text, &end, 16);
+	return *text && !*end;
+}
+
+static void set_range(uint8_t *bitmap, uint16_t address, uint32_t len, bool value){
+	for(uint32_t i = 0; i < len; i++){
+		const uint16_t a = (address + i) & CHIP8_RAM_MASK;
+		if(value){
+			bitmap[a >> 3] |= 1 << (a & 7);
+		}
+		else{
+			bitmap[a >> 3] &= ~(1 << (a & 7));
+		}
+	}
+}
+
+// The debugger is attached only while there is something to check, so the machine keeps its superinstructions
+static void update_attached(remote_t *remote, chip8_t *chip8){
+	chip8->debugger = debugger_needed(&remote->debugger) ? &remote->debugger : NULL;
+}
+
+// Work out why the machine is halted if it stopped on its own since the last request
+static void update_reason(remote_t *remote, const chip8_t *chip8){
+	debugger_t *dbg = &remote->debugger;
+	if(chip8->state == RUNNING){
+		remote->reason = STOP_NONE;
+	}
+	else if(chip8->state == FAULTED){
+		remote->reason = STOP_FAULT;
+	}
+	else if(remote->reason == STOP_NONE){
+		// a break leaves break_next clear and the PC on the breakpoint, a watch sets watch_hit
+		const uint16_t pc = chip8->PC & CHIP8_RAM_MASK;
+		if(dbg->watch_hit){
+			remote->reason = STOP_WATCH;
+		}
+		else if(chip8->debugger && (dbg->breakpoints[pc >> 3] & (1 << (pc & 7)))){
+			remote->reason = STOP_BREAK;
+		}
+		else{
+			remote->reason = STOP_PAUSE;
+		}
+	}
+}
+
+static void reply_status(remote_t *remote, const chip8_t *chip8){
+	if(remote->reason == STOP_NONE){
+		reply(remote, "ok running\n");
+		return;
+	}
+	reply(remote, "ok halted %s PC=%03X", reason_names[remote->reason], chip8->PC);
+	if(remote->reason == STOP_WATCH){
+		reply(remote, " %s=%03X", remote->debugger.watch_write ? "write" : "read", remote->debugger.watch_address);
+	}
+	else if(remote->reason == STOP_FAULT){
+		reply(remote, " %s", chip8_fault_name(chip8->fault.kind));
+	}
+	reply(remote, "\n");
+}
+
+static void resume(remote_t *remote, chip8_t *chip8){
+	remote->debugger.resume_pc = chip8->debugger ? chip8->PC & CHIP8_RAM_MASK : -1;
+	remote->debugger.watch_hit = false;
+	remote->reason = STOP_NONE;
+	chip8->state = RUNNING;
+}
+
+static bool set_register(chip8_t *chip8, const char *name, uint32_t value){
+	if((name[0] == 'V' || name[0] == 'v') && hex_digit(name[1]) >= 0 && !name[2]){
+		chip8->V[hex_digit(name[1])] = value;
+	}
+	else if(strcmp(name, "I") == 0){
+		chip8->I = value & CHIP8_RAM_MASK;
+	}
+	else if(strcmp(name, "PC") == 0){
+		chip8->PC = value & CHIP8_RAM_MASK;
+	}
+	else if(strcmp(name, "SP") == 0 && value <= CHIP8_STACK_DEPTH){
+		chip8->SP = value;
+	}
+	else if(strcmp(name, "DT") == 0){
+		chip8->delay_timer = value;
+	}
+	else if(strcmp(name, "ST") == 0){
+		chip8->sound_timer = value;
+	}
+	else{
+		return false;
+	}
+	return true;
+}
+
+static void read_framebuffer(const chip8_t *chip8, uint8_t *out){
+	// the rows are already 8 pixels a byte with the top bit leftmost, only big endian
+	for(uint32_t y = 0; y < CHIP8_HEIGHT; y++){
+		for(uint32_t b = 0; b < CHIP8_WIDTH / 8; b++){
+			out[y * CHIP8_WIDTH / 8 + b] = chip8->display[y] >> (CHIP8_WIDTH - 8 - 8 * b);
+		}
+	}
+}
+
+static void write_framebuffer(chip8_t *chip8, const uint8_t *in){
+	for(uint32_t y = 0; y < CHIP8_HEIGHT; y++){
+		chip8->display[y] = 0;
+		for(uint32_t b = 0; b < CHIP8_WIDTH / 8; b++){
+			chip8->display[y] |= (uint64_t)in[y * CHIP8_WIDTH / 8 + b] << (CHIP8_WIDTH - 8 - 8 * b);
+		}
+	}
+	chip8->draw = true;
+}
+
+static void run_command(remote_t *remote, chip8_t *chip8, char *command){
+	char *args[4] = {0};
+	uint32_t count = 0;
+	for(char *save, *token = strtok_r(command, " \t\r", &save); token && count < 4; token = strtok_r(NULL, " \t\r", &save)){
+		args[count++] = token;
+	}
+	if(count == 0){
+		reply(remote, "error empty command\n");
+		return;
+	}
+
+	const char *name = args[0];
+	const bool halted = chip8->state != RUNNING;
+	debugger_t *dbg = &remote->debugger;
+	uint32_t a = 0, b = 0;
+	uint8_t data[CHIP8_RAM_SIZE];
+
+	if(strcmp(name, "wait") == 0 || strcmp(name, "status") == 0){
+		reply_status(remote, chip8);
+	}
+	else if(strcmp(name, "halt") == 0){
+		if(!halted){
+			chip8->state = PAUSED;
+			remote->reason = STOP_HALT;
+		}
+		reply_status(remote, chip8);
+	}
+	else if(strcmp(name, "continue") == 0){
+		if(chip8->state == FAULTED){
+			reply(remote, "error faulted, reset from the keyboard\n");
+			return;
+		}
+		if(halted){
+			resume(remote, chip8);
+		}
+		reply(remote, "ok\n");
+	}
+	else if(strcmp(name, "step") == 0){
+		if(count > 1 && (!parse_number(args[1], &a) || a == 0)){
+			reply(remote, "error bad count %s\n", args[1]);
+		}
+		else if(chip8->state != PAUSED){
+			reply(remote, "error not halted\n");
+		}
+		else{
+			resume(remote, chip8);
+			chip8_run_cycles(chip8, count > 1 ? a : 1);
+			if(chip8->state == RUNNING){
+				chip8->state = PAUSED;
+				remote->reason = STOP_STEP;
+			}
+			update_reason(remote, chip8);
+			reply_status(remote, chip8);
+		}
+	}
+	else if(strcmp(name, "regs") == 0){
+		reply(remote, "ok PC=%03X I=%03X SP=%X DT=%02X ST=%02X V=", chip8->PC, chip8->I, chip8->SP,
+			chip8->delay_timer, chip8->sound_timer);
+		reply_hex(remote, chip8->V, sizeof chip8->V);
+		reply(remote, " stack=");
+		for(uint8_t i = 0; i < chip8->SP; i++){
+			reply(remote, "%s%03X", i ? "," : "", chip8->stack[i]);
+		}
+		reply(remote, "\n");
+	}
+	else if(strcmp(name, "set") == 0){
+		if(count != 3 || !parse_number(args[2], &a) || !set_register(chip8, args[1], a)){
+			reply(remote, "error usage: set V0-VF|I|PC|SP|DT|ST VALUE\n");
+			return;
+		}
+		reply(remote, "ok\n");
+	}
+	else if(strcmp(name, "break") == 0 || strcmp(name, "delete") == 0){
+		if(count != 2 || !parse_number(args[1], &a)){
+			reply(remote, "error usage: %s ADDR\n", name);
+			return;
+		}
+		set_range(dbg->breakpoints, a, 1, name[0] == 'b');
+		update_attached(remote, chip8);
+		reply(remote, "ok\n");
+	}
+	else if(strcmp(name, "watch") == 0){
+		const bool reads = count > 1 && strchr(args[1], 'r'), writes = count > 1 && strchr(args[1], 'w');
+		if(count < 3 || !(reads || writes) || !parse_number(args[2], &a) || (count > 3 && !parse_number(args[3], &b))){
+			reply(remote, "error usage: watch r|w|rw ADDR [LEN]\n");
+			return;
+		}
+		b = count > 3 ? b : 1;
+		if(reads){
+			set_range(dbg->read_watch, a, b, true);
+		}
+		if(writes){
+			set_range(dbg->write_watch, a, b, true);
+		}
+		update_attached(remote, chip8);
+		reply(remote, "ok\n");
+	}
+	else if(strcmp(name, "unwatch") == 0){
+		if(count < 2 || !parse_number(args[1], &a) || (count > 2 && !parse_number(args[2], &b))){
+			reply(remote, "error usage: unwatch ADDR [LEN]\n");
+			return;
+		}
+		b = count > 2 ? b : 1;
+		set_range(dbg->read_watch, a, b, false);
+		set_range(dbg->write_watch, a, b, false);
+		update_attached(remote, chip8);
+		reply(remote, "ok\n");
+	}
+	else if(strcmp(name, "read") == 0){
+		if(count != 3 || !parse_number(args[1], &a) || !parse_number(args[2], &b) || b > CHIP8_RAM_SIZE){
+			reply(remote, "error usage: read ADDR LEN, at most 1000 bytes\n");
+			return;
+		}
+		for(uint32_t i = 0; i < b; i++){
+			data[i] = ram_read(chip8, a + i);
+		}
+		reply(remote, "ok ");
+		reply_hex(remote, data, b);
+		reply(remote, "\n");
+	}
+	else if(strcmp(name, "write") == 0){
+		const int32_t size = count == 3 ? parse_hex(args[2], data, sizeof data) : -1;
+		if(size < 0 || !parse_number(args[1], &a)){
+			reply(remote, "error usage: write ADDR HEX, at most 1000 bytes\n");
+			return;
+		}
+		for(int32_t i = 0; i < size; i++){
+			ram_write(chip8, a + i, data[i]);
+		}
+		fusion_invalidate(chip8, a, size); // a write over code drops the superinstructions decoded from it
+		reply(remote, "ok\n");
+	}
+	else if(strcmp(name, "fb") == 0){
+		read_framebuffer(chip8, data);
+		reply(remote, "ok ");
+		reply_hex(remote, data, FB_BYTES);
+		reply(remote, "\n");
+	}
+	else if(strcmp(name, "fbwrite") == 0){
+		if(count != 2 || parse_hex(args[1], data, sizeof data) != FB_BYTES){
+			reply(remote, "error usage: fbwrite HEX, %u bytes\n", FB_BYTES);
+			return;
+		}
+		write_framebuffer(chip8, data);
+		reply(remote, "ok\n");
+	}
+	else if(strcmp(name, "detach") == 0){
+		memset(dbg->breakpoints, 0, sizeof dbg->breakpoints);
+		memset(dbg->read_watch, 0, sizeof dbg->read_watch);
+		memset(dbg->write_watch, 0, sizeof dbg->write_watch);
+		update_attached(remote, chip8);
+		if(chip8->state == PAUSED && remote->reason != STOP_PAUSE){
+			resume(remote, chip8);
+		}
+		reply(remote, "ok\n");
+	}
+	else{
+		reply(remote, "error unknown command %s\n", name);
+	}
+}
+
+// A wait that has to hold the request back, checked before the command is cut up
+static bool must_wait(const char *command, size_t length, const chip8_t *chip8){
+	char word[8];
+	snprintf(word, sizeof word, "%.*s", (int)(length < 7 ? length : 7), command + strspn(command, " \t"));
+	word[strcspn(word, " \t\r")] = '\0';
+	return chip8->state == RUNNING && strcmp(word, "wait") == 0;
+}
+
+// Run the request from its cursor on, false while a wait holds it back
+static bool run_request(remote_t *remote, chip8_t *chip8){
+	update_reason(remote, chip8);
+	while(remote->request[remote->cursor]){
+		char *command = remote->request + remote->cursor;
+		const size_t length = strcspn(command, ";");
+		if(must_wait(command, length, chip8)){
+			return false;
+		}
+
+		const bool last = command[length] == '\0';
+		command[length] = '\0';
+		run_command(remote, chip8, command);
+		remote->cursor += length + !last;
+		update_reason(remote, chip8);
+	}
+	return true;
+}
+
+void remote_service_wait(remote_t *remote, chip8_t *chip8, uint32_t wait_ms){
+	if(wait_ms == 0 && !atomic_load_explicit(&remote->pending, memory_order_acquire)){
+		return;
+	}
+
+	pthread_mutex_lock(&remote->lock);
+	if(!atomic_load_explicit(&remote->pending, memory_order_acquire) && wait_ms > 0){
+		struct timespec until;
+		clock_gettime(CLOCK_REALTIME, &until);
+		until.tv_nsec += wait_ms * 1000000L;
+		until.tv_sec += until.tv_nsec / 1000000000L;
+		until.tv_nsec %= 1000000000L;
+		pthread_cond_timedwait(&remote->changed, &remote->lock, &until);
+	}
+	if(atomic_load_explicit(&remote->pending, memory_order_acquire) && run_request(remote, chip8)){
+		atomic_store_explicit(&remote->pending, false, memory_order_release);
+		pthread_cond_broadcast(&remote->changed);
+	}
+	pthread_mutex_unlock(&remote->lock);
+}
+
+// Hand a request to the emulator loop and wait for its replies, false when stopping
+static bool post_request(remote_t *remote){
+	pthread_mutex_lock(&remote->lock);
+	remote->cursor = 0;
+	remote->reply_length = 0;
+	remote->reply[0] = '\0';
+	atomic_store_explicit(&remote->pending, true, memory_order_release);
+	pthread_cond_broadcast(&remote->changed);
+	while(atomic_load_explicit(&remote->pending, memory_order_acquire) && !remote->stopping){
+		pthread_cond_wait(&remote->changed, &remote->lock);
+	}
+	const bool answered = !remote->stopping;
+	pthread_mutex_unlock(&remote->lock);
+	return answered;
+}
+
+static bool send_all(int fd, const char *data, size_t length){
+	for(size_t sent = 0; sent < length;){
+		const ssize_t n = send(fd, data + sent, length - sent, MSG_NOSIGNAL);
+		if(n <= 0){
+			return false;
+		}
+		sent += n;
+	}
+	return true;
+}
+
+// Talk to one client until it hangs up, false when stopping
+static bool serve_client(remote_t *remote, int client, char *input){
+	size_t used = 0;
+	while(true){
+		struct pollfd fds[2] = {{.fd = remote->wake[0], .events = POLLIN}, {.fd = client, .events = POLLIN}};
+		if(poll(fds, 2, -1) < 0 || (fds[0].revents & POLLIN)){
+			return false;
+		}
+
+		const ssize_t n = recv(client, input + used, REMOTE_LINE_SIZE - used, 0);
+		if(n <= 0){
+			return true;
+		}
+		used += n;
+
+		// every whole line is a request
+		char *line = input, *newline;
+		while((newline = memchr(line, '\n', input + used - line))){
+			*newline = '\0';
+			snprintf(remote->request, REMOTE_LINE_SIZE, "%s", line);
+			line = newline + 1;
+			if(!post_request(remote)){
+				return false;
+			}
+			if(!send_all(client, remote->reply, remote->reply_length)){
+				return true;
+			}
+		}
+		used -= line - input;
+		memmove(input, line, used);
+		if(used == REMOTE_LINE_SIZE){
+			send_all(client, "error request too long\n", 23);
+			return true;
+		}
+	}
+}
+
+static void *remote_thread(void *arg){
+	remote_t *remote = arg;
+	char *input = malloc(REMOTE_LINE_SIZE);
+	if(!input){
+		fprintf(stderr, "Out of memory for the remote debugger\n");
+		return NULL;
+	}
+
+	for(bool stop = false; !stop;){
+		struct pollfd fds[2] = {{.fd = remote->wake[0], .events = POLLIN}, {.fd = remote->listen_fd, .events = POLLIN}};
+		const int ready = poll(fds, 2, -1);
+		stop = ready < 0 || (fds[0].revents & POLLIN);
+		if(stop || !(fds[1].revents & POLLIN)){
+			continue;
+		}
+
+		const int client = accept(remote->listen_fd, NULL, NULL);
+		if(client < 0){
+			continue;
+		}
+		stop = !serve_client(remote, client, input);
+		close(client);
+
+		// whoever hung up, the machine is left running without the client's breakpoints
+		if(!stop){
+			strcpy(remote->request, "detach");
+			stop = !post_request(remote);
+		}
+	}
+
+	free(input);
+	return NULL;
+}
+
+static void close_fds(remote_t *remote){
+	unixsock_close(&remote->listen_fd, remote->wake, remote->path);
+	free(remote->request);
+	free(remote->reply);
+	remote->request = remote->reply = NULL;
+}
+
+bool remote_start(remote_t *remote, const char *path){
+	*remote = (remote_t){
+		.path = path,
+		.listen_fd = -1,
+		.wake = {-1, -1},
+		.request = malloc(REMOTE_LINE_SIZE),
+		.reply = malloc(REMOTE_LINE_SIZE),
+	};
+	atomic_init(&remote->pending, false);
+	debugger_init(&remote->debugger);
+	remote->debugger.break_next = false; // the machine starts running, a client can halt it
+	remote->debugger.remote = true;
+
+	if(!remote->request || !remote->reply){
+		fprintf(stderr, "Out of memory for the remote debugger\n");
+		close_fds(remote);
+		return false;
+	}
+	if((remote->listen_fd = unixsock_listen(remote->path, 1, "remote debugger")) < 0){
+		close_fds(remote);
+		return false;
+	}
+	pthread_mutex_init(&remote->lock, NULL);
+	pthread_cond_init(&remote->changed, NULL);
+	if(pipe(remote->wake) != 0 || pthread_create(&remote->thread, NULL, remote_thread, remote) != 0){
+		fprintf(stderr, "could not start the remote debugger thread\n");
+		pthread_cond_destroy(&remote->changed);
+		pthread_mutex_destroy(&remote->lock);
+		close_fds(remote);
+		return false;
+	}
+
+	remote->running = true;
+	return true;
+}
+
+void remote_stop(remote_t *remote, chip8_t *chip8){
+	if(!remote->running){
+		return;
+	}
+
+	pthread_mutex_lock(&remote->lock);
+	remote->stopping = true;
+	pthread_cond_broadcast(&remote->changed);
+	pthread_mutex_unlock(&remote->lock);
+	if(write(remote->wake[1], "", 1) != 1){
+		fprintf(stderr, "could not stop the remote debugger thread\n");
+	}
+	pthread_join(remote->thread, NULL);
+
+	if(chip8->debugger == &remote->debugger){
+		chip8->debugger = NULL;
+	}
+	pthread_cond_destroy(&remote->changed);
+	pthread_mutex_destroy(&remote->lock);
+	close_fds(remote);
+	remote->running = false;
+}
@@ -0,0 +1,74 @@
+#ifndef REMOTE_H
+#define REMOTE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "chip8.h"
+#include "debugger.h"
+
+/*
+Remote debugger for external tools and editors. A thread listens on a Unix
+socket for one client at a time and reads its requests, a line of commands
+separated by ';'. It never touches the machine: the request waits in a
+mailbox until the emulator loop reaches a slice boundary, where every
+command of it is run at once and the replies, one line per command, are
+handed back. Between requests the loop pays one atomic load per slice.
+
+Breakpoints and watchpoints use a debugger_t of the stub's own, attached to
+the machine only while any are set, so a client with none keeps the
+superinstructions and full speed. See remote_help in remote.c for the
+commands.
+*/
+
+#define REMOTE_LINE_SIZE 65536 // longest request and reply
+#define REMOTE_IDLE_MS 10 // how long the loop waits for a request while halted
+
+typedef enum {
+	STOP_NONE, // running
+	STOP_HALT, // halt command
+	STOP_STEP, // step finished
+	STOP_BREAK, // breakpoint
+	STOP_WATCH, // watchpoint
+	STOP_FAULT, // strict memory fault
+	STOP_PAUSE, // paused from the keyboard
+} stop_reason_t;
+
+typedef struct {
+	const char *path;
+	int listen_fd;
+	int wake[2]; // pipe, a byte in it stops the server
+	pthread_t thread;
+	bool running;
+
+	// the mailbox, request and reply are REMOTE_LINE_SIZE
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	atomic_bool pending; // a request waits for the emulator loop
+	bool stopping;
+	char *request;
+	size_t cursor; // commands before it already ran, a wait holds the rest back
+	char *reply;
+	size_t reply_length;
+
+	// emulator loop only
+	debugger_t debugger;
+	stop_reason_t reason;
+} remote_t;
+
+// Listen on the socket at path
+bool remote_start(remote_t *remote, const char *path);
+
+// Run the waiting request if there is one, waiting up to wait_ms for one to come
+void remote_service_wait(remote_t *remote, chip8_t *chip8, uint32_t wait_ms);
+
+// Called at every slice boundary, costs an atomic load when nothing waits
+static inline void remote_service(remote_t *remote, chip8_t *chip8){
+	if(atomic_load_explicit(&remote->pending, memory_order_acquire)){
+		remote_service_wait(remote, chip8, 0);
+	}
+}
+
+// Hang up, remove the socket and detach from the machine
+void remote_stop(remote_t *remote, chip8_t *chip8);
+
+#endif
@@ -0,0 +1,452 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include "replay.h"
+
+#define ALIGN8(n) (((n) + 7) & ~(uint64_t)7)
+
+static void capture_keyframe(const chip8_t *chip8, replay_keyframe_t *keyframe){
+	memset(keyframe, 0, sizeof *keyframe); // padding too, keyframes are compared with memcmp
+	keyframe->cycles = chip8->cycles;
+	keyframe->idle_cycles = chip8->idle_cycles;
+	keyframe->wait_jump_cycle = chip8->wait_jump_cycle;
+	keyframe->rng = chip8->rng;
+	keyframe->inst_per_frame = chip8->inst_per_frame;
+	keyframe->cycle_budget = chip8->cycle_budget;
+	keyframe->PC = chip8->PC;
+	keyframe->I = chip8->I;
+	keyframe->wait_jump_pc = chip8->wait_jump_pc;
+	memcpy(keyframe->stack, chip8->stack, sizeof keyframe->stack);
+	memcpy(keyframe->V, chip8->V, sizeof keyframe->V);
+	keyframe->SP = chip8->SP;
+	keyframe->delay_timer = chip8->delay_timer;
+	keyframe->sound_timer = chip8->sound_timer;
+	keyframe->state = chip8->state == FAULTED ? FAULTED : RUNNING; // not paused or quitting
+	keyframe->vblank_wait = chip8->vblank_wait;
+
+	for(uint8_t key = 0; key < 16; key++){
+		keyframe->keys |= chip8->keypad[key] << key;
+	}
+	for(uint32_t i = 0; i < CHIP8_WIDTH * CHIP8_HEIGHT; i++){
+		keyframe->display[i / 8] |= chip8_pixel(chip8, i % CHIP8_WIDTH, i / CHIP8_WIDTH) << (i % 8);
+	}
+	for(uint32_t page = 0; page < CHIP8_PAGES; page++){
+		memcpy(&keyframe->ram[page * CHIP8_PAGE_SIZE], chip8->pages[page], CHIP8_PAGE_SIZE);
+	}
+}
+
+static bool add_keyframe(replay_recorder_t *recorder, const chip8_t *chip8, uint8_t flags){
+	if(recorder->header.keyframe_count == recorder->keyframe_capacity){
+		const uint32_t capacity = recorder->keyframe_capacity ? recorder->keyframe_capacity * 2 : 64;
+		replay_keyframe_t *keyframes = realloc(recorder->keyframes, capacity * sizeof *keyframes);
+		if(!keyframes){
+			fprintf(stderr, "Out of memory for replay keyframes, recording stopped\n");
+			return false;
+		}
+		recorder->keyframes = keyframes;
+		recorder->keyframe_capacity = capacity;
+	}
+
+	replay_keyframe_t *keyframe = &recorder->keyframes[recorder->header.keyframe_count++];
+	capture_keyframe(chip8, keyframe);
+	keyframe->frame = recorder->header.frames;
+	keyframe->input = recorder->header.input_words;
+	keyframe->flags = flags;
+	return true;
+}
+
+// Stop recording after an error, the file is left without an index
+static void record_abort(replay_recorder_t *recorder){
+	if(recorder->file){
+		fclose(recorder->file);
+	}
+	free(recorder->keyframes);
+	free(recorder->frame);
+	*recorder = (replay_recorder_t){0};
+}
+
+bool replay_record_start(replay_recorder_t *recorder, const char *path, const chip8_t *chip8, uint32_t slices){
+	*recorder = (replay_recorder_t){0};
+	if(!chip8->image){
+		fprintf(stderr, "no ROM loaded to record\n");
+		return false;
+	}
+	size_t rom_size;
+	const uint8_t *rom = chip8_image_rom(chip8->image, &rom_size);
+
+	recorder->frame = malloc((slices + 1) * sizeof(uint16_t));
+	recorder->file = fopen(path, "wb");
+	if(!recorder->file || !recorder->frame){
+		fprintf(stderr, "could not open replay file %s\n", path);
+		if(recorder->file){
+			fclose(recorder->file);
+		}
+		free(recorder->frame);
+		recorder->file = NULL;
+		return false;
+	}
+
+	recorder->header = (replay_header_t){
+		.magic = REPLAY_MAGIC,
+		.version = REPLAY_VERSION,
+		.keyframe_size = sizeof(replay_keyframe_t),
+		.slices = slices,
+		.rom_size = rom_size,
+		.timing = chip8->timing,
+		.quirks = chip8->quirks,
+		.strict = chip8->strict,
+		.input_offset = ALIGN8(sizeof(replay_header_t) + rom_size),
+	};
+
+	// the header is written again with the counts when the recording stops
+	static const uint8_t zeros[8];
+	fwrite(&recorder->header, sizeof recorder->header, 1, recorder->file);
+	fwrite(rom, 1, rom_size, recorder->file);
+	fwrite(zeros, 1, recorder->header.input_offset - sizeof(replay_header_t) - rom_size, recorder->file);
+
+	recorder->last_cycles = chip8->cycles;
+	recorder->last_inst_per_frame = chip8->inst_per_frame;
+	if(!add_keyframe(recorder, chip8, 0)){
+		record_abort(recorder);
+		return false;
+	}
+	return true;
+}
+
+void replay_record_frame(replay_recorder_t *recorder, const chip8_t *chip8){
+	if(!recorder->file){
+		return;
+	}
+
+	// anything that ran the machine between frames (a reset) cuts the recording,
+	// a new clock rate only needs the new rate
+	uint8_t flags = 0;
+	if(chip8->cycles != recorder->last_cycles){
+		flags = KEYFRAME_CUT;
+	}
+	const bool due = recorder->header.frames % REPLAY_KEYFRAME_INTERVAL == 0
+		|| chip8->inst_per_frame != recorder->last_inst_per_frame;
+
+	const replay_keyframe_t *last = &recorder->keyframes[recorder->header.keyframe_count - 1];
+	if((flags || due) && last->frame != recorder->header.frames && !add_keyframe(recorder, chip8, flags)){
+		record_abort(recorder);
+		return;
+	}
+
+	recorder->frame_words = 1; // word 0 counts the slices
+}
+
+void replay_record_keys(replay_recorder_t *recorder, const chip8_t *chip8){
+	if(!recorder->file || recorder->frame_words > recorder->header.slices){
+		return;
+	}
+
+	uint16_t keys = 0;
+	for(uint8_t key = 0; key < 16; key++){
+		keys |= chip8->keypad[key] << key;
+	}
+	recorder->frame[recorder->frame_words++] = keys;
+}
+
+void replay_record_end_frame(replay_recorder_t *recorder, const chip8_t *chip8){
+	if(!recorder->file){
+		return;
+	}
+
+	recorder->frame[0] = recorder->frame_words - 1;
+	fwrite(recorder->frame, sizeof(uint16_t), recorder->frame_words, recorder->file);
+	recorder->header.input_words += recorder->frame_words;
+	recorder->header.frames++;
+	recorder->last_cycles = chip8->cycles;
+	recorder->last_inst_per_frame = chip8->inst_per_frame;
+}
+
+bool replay_record_stop(replay_recorder_t *recorder, const chip8_t *chip8){
+	if(!recorder->file){
+		return false;
+	}
+
+	bool ok = add_keyframe(recorder, chip8, KEYFRAME_END);
+	if(ok){
+		replay_header_t *header = &recorder->header;
+		const uint64_t input_end = header->input_offset + header->input_words * sizeof(uint16_t);
+		static const uint8_t zeros[8];
+		header->keyframe_offset = ALIGN8(input_end);
+		fwrite(zeros, 1, header->keyframe_offset - input_end, recorder->file);
+		fwrite(recorder->keyframes, sizeof(replay_keyframe_t), header->keyframe_count, recorder->file);
+
+		ok = fseek(recorder->file, 0, SEEK_SET) == 0 && fwrite(header, sizeof *header, 1, recorder->file) == 1;
+		fprintf(stderr, "recorded %llu frames, %u keyframes\n", (unsigned long long)header->frames, header->keyframe_count);
+	}
+	ok = fclose(recorder->file) == 0 && ok;
+	recorder->file = NULL;
+	record_abort(recorder); // frees the buffers
+	return ok;
+}
+
+bool replay_open(replay_t *replay, const char *path){
+	*replay = (replay_t){0};
+
+	FILE *file = fopen(path, "rb");
+	if(!file){
+		fprintf(stderr, "could not open replay file %s\n", path);
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	const long size = ftell(file);
+	rewind(file);
+
+	replay->data = size > 0 ? malloc(size) : NULL;
+	if(!replay->data || fread(replay->data, size, 1, file) != 1){
+		fprintf(stderr, "could not read replay file %s\n", path);
+		fclose(file);
+		free(replay->data);
+		replay->data = NULL;
+		return false;
+	}
+	fclose(file);
+
+	const replay_header_t *header = (const replay_header_t *)replay->data;
+	const bool valid = (size_t)size >= sizeof *header
+		&& header->magic == REPLAY_MAGIC
+		&& header->version == REPLAY_VERSION
+		&& header->keyframe_size == sizeof(replay_keyframe_t)
+		&& header->keyframe_count > 0
+		&& header->slices > 0
+		&& header->input_offset >= sizeof *header + header->rom_size
+		&& header->keyframe_offset >= header->input_offset + header->input_words * sizeof(uint16_t)
+		&& header->keyframe_offset + (uint64_t)header->keyframe_count * sizeof(replay_keyframe_t) <= (uint64_t)size;
+	if(!valid){
+		fprintf(stderr, "%s is not a finished replay file from this version\n", path);
+		replay_close(replay);
+		return false;
+	}
+
+	replay->header = header;
+	replay->rom = replay->data + sizeof *header;
+	replay->input = (const uint16_t *)(replay->data + header->input_offset);
+	replay->keyframes = (const replay_keyframe_t *)(replay->data + header->keyframe_offset);
+	replay->image = chip8_image_create(replay->rom, header->rom_size);
+	if(!replay->image){
+		replay_close(replay);
+		return false;
+	}
+	return true;
+}
+
+void replay_close(replay_t *replay){
+	chip8_image_release(replay->image);
+	free(replay->data);
+	*replay = (replay_t){0};
+}
+
+void replay_restore(const replay_t *replay, uint32_t k, chip8_t *chip8, replay_cursor_t *cursor){
+	const replay_keyframe_t *keyframe = &replay->keyframes[k];
+
+	chip8_set_timing(chip8, replay->header->timing);
+	chip8_set_quirks(chip8, replay->header->quirks);
+	chip8_set_strict(chip8, replay->header->strict);
+	chip8_load_image(chip8, replay->image);
+
+	chip8->cycles = keyframe->cycles;
+	chip8->idle_cycles = keyframe->idle_cycles;
+	chip8->wait_jump_cycle = keyframe->wait_jump_cycle;
+	chip8->rng = keyframe->rng;
+	chip8->inst_per_frame = keyframe->inst_per_frame;
+	chip8->cycle_budget = keyframe->cycle_budget;
+	chip8->PC = keyframe->PC;
+	chip8->I = keyframe->I;
+	chip8->wait_jump_pc = keyframe->wait_jump_pc;
+	memcpy(chip8->stack, keyframe->stack, sizeof chip8->stack);
+	memcpy(chip8->V, keyframe->V, sizeof chip8->V);
+	chip8->SP = keyframe->SP;
+	chip8->delay_timer = keyframe->delay_timer;
+	chip8->sound_timer = keyframe->sound_timer;
+	chip8->state = keyframe->state;
+	chip8->vblank_wait = keyframe->vblank_wait;
+	chip8->draw = true;
+
+	for(uint8_t key = 0; key < 16; key++){
+		chip8->keypad[key] = keyframe->keys & (1 << key);
+	}
+	memset(chip8->display, 0, sizeof chip8->display);
+	for(uint32_t i = 0; i < CHIP8_WIDTH * CHIP8_HEIGHT; i++){
+		const uint64_t lit = (keyframe->display[i / 8] >> (i % 8)) & 1;
+		chip8->display[i / CHIP8_WIDTH] |= lit << (CHIP8_WIDTH - 1 - i % CHIP8_WIDTH);
+	}
+
+	// only the pages the program wrote to stop being shared
+	for(uint32_t page = 0; page < CHIP8_PAGES; page++){
+		const uint8_t *data = &keyframe->ram[page * CHIP8_PAGE_SIZE];
+		if(memcmp(chip8->pages[page], data, CHIP8_PAGE_SIZE) != 0 && chip8_own_page(chip8, page)){
+			memcpy(chip8->owned[page], data, CHIP8_PAGE_SIZE);
+		}
+	}
+
+	*cursor = (replay_cursor_t){
+		.frame = keyframe->frame,
+		.input = keyframe->input,
+		.keyframe = k + 1,
+	};
+}
+
+int32_t replay_begin_frame(const replay_t *replay, chip8_t *chip8, replay_cursor_t *cursor){
+	const replay_header_t *header = replay->header;
+	if(cursor->keyframe < header->keyframe_count && replay->keyframes[cursor->keyframe].frame == cursor->frame){
+		const replay_keyframe_t *keyframe = &replay->keyframes[cursor->keyframe];
+		if(cursor->keyframe == 0 || keyframe->flags & KEYFRAME_CUT){
+			replay_restore(replay, cursor->keyframe, chip8, cursor);
+		}
+		else{
+			chip8->inst_per_frame = keyframe->inst_per_frame; // the clock may have changed here
+			cursor->keyframe++;
+		}
+	}
+
+	if(cursor->frame >= header->frames || cursor->input >= header->input_words){
+		return -1;
+	}
+
+	cursor->slices = replay->input[cursor->input];
+	if(cursor->slices > header->slices || cursor->input + 1 + cursor->slices > header->input_words){
+		return -1;
+	}
+	return cursor->slices;
+}
+
+uint16_t replay_slice_keys(const replay_t *replay, const replay_cursor_t *cursor, uint32_t slice){
+	return slice < cursor->slices ? replay->input[cursor->input + 1 + slice] : 0;
+}
+
+void replay_end_frame(const replay_t *replay, replay_cursor_t *cursor){
+	(void)replay;
+	cursor->input += 1 + cursor->slices;
+	cursor->frame++;
+}
+
+bool replay_run_frame(const replay_t *replay, chip8_t *chip8, replay_cursor_t *cursor){
+	const int32_t slices = replay_begin_frame(replay, chip8, cursor);
+	if(slices < 0){
+		return false;
+	}
+
+	for(int32_t slice = 0; slice < slices; slice++){
+		chip8_set_keys(chip8, replay_slice_keys(replay, cursor, slice));
+		chip8_run_frame_part(chip8, slice, replay->header->slices);
+	}
+	chip8_update_timers(chip8);
+	replay_end_frame(replay, cursor);
+	return true;
+}
+
+uint32_t replay_find_keyframe(const replay_t *replay, uint64_t frame){
+	uint32_t low = 0, high = replay->header->keyframe_count - 1;
+	while(low < high){
+		const uint32_t mid = (low + high + 1) / 2;
+		if(replay->keyframes[mid].frame <= frame){
+			low = mid;
+		}
+		else{
+			high = mid - 1;
+		}
+	}
+	return low;
+}
+
+bool replay_seek(const replay_t *replay, uint64_t frame, chip8_t *chip8, replay_cursor_t *cursor){
+	if(frame > replay->header->frames){
+		return false;
+	}
+
+	replay_restore(replay, replay_find_keyframe(replay, frame), chip8, cursor);
+	while(cursor->frame < frame){
+		if(!replay_run_frame(replay, chip8, cursor)){
+			return false;
+		}
+	}
+	return true;
+}
+
+typedef struct {
+	const replay_t *replay;
+	atomic_uint next; // next segment to claim
+	atomic_uint bad;
+	atomic_uint first_bad;
+} verify_t;
+
+// Does segment k, run from its keyframe, end in keyframe k+1?
+static bool verify_segment(const replay_t *replay, uint32_t k, chip8_t *chip8){
+	const replay_keyframe_t *end = &replay->keyframes[k + 1];
+	if(end->flags & KEYFRAME_CUT){
+		return true;
+	}
+
+	replay_cursor_t cursor;
+	replay_restore(replay, k, chip8, &cursor);
+	while(cursor.frame < end->frame){
+		if(!replay_run_frame(replay, chip8, &cursor)){
+			return false;
+		}
+	}
+
+	// the clock rate may change at a keyframe and the keys are the next frame's input, everything else must match
+	replay_keyframe_t *state = malloc(sizeof *state);
+	if(!state){
+		return false;
+	}
+	capture_keyframe(chip8, state);
+	state->frame = end->frame;
+	state->input = end->input;
+	state->flags = end->flags;
+	state->inst_per_frame = end->inst_per_frame;
+	state->keys = end->keys;
+	const bool same = memcmp(state, end, sizeof *state) == 0;
+	free(state);
+	return same;
+}
+
+static void *verify_thread(void *arg){
+	verify_t *verify = arg;
+	const uint32_t segments = verify->replay->header->keyframe_count - 1;
+	chip8_t *chip8 = chip8_create(1);
+	if(!chip8){
+		return NULL;
+	}
+
+	for(uint32_t k; (k = atomic_fetch_add(&verify->next, 1)) < segments;){
+		if(!verify_segment(verify->replay, k, chip8)){
+			atomic_fetch_add(&verify->bad, 1);
+			uint32_t first = atomic_load(&verify->first_bad);
+			while(k < first && !atomic_compare_exchange_weak(&verify->first_bad, &first, k));
+		}
+	}
+
+	chip8_destroy(chip8);
+	return NULL;
+}
+
+uint32_t replay_verify(const replay_t *replay, uint32_t threads, uint32_t *first_bad){
+	verify_t verify = {.replay = replay};
+	atomic_init(&verify.next, 0);
+	atomic_init(&verify.bad, 0);
+	atomic_init(&verify.first_bad, UINT32_MAX);
+
+	pthread_t *ids = malloc(threads * sizeof *ids);
+	uint32_t started = 0;
+	for(; ids && started < threads; started++){
+		if(pthread_create(&ids[started], NULL, verify_thread, &verify) != 0){
+			break;
+		}
+	}
+	if(started == 0){
+		verify_thread(&verify); // no threads, do it all here
+	}
+	for(uint32_t i = 0; i < started; i++){
+		pthread_join(ids[i], NULL);
+	}
+	free(ids);
+
+	if(first_bad){
+		*first_bad = atomic_load(&verify.first_bad);
+	}
+	return atomic_load(&verify.bad);
+}
@@ -0,0 +1,152 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "chip8.h"
+
+/*
+Input recordings with keyframes. A replay file holds the ROM and, for
+every frame, the keypad as it was before each input slice of the frame
+ran. Every REPLAY_KEYFRAME_INTERVAL frames a keyframe with the whole
+machine is added, and one more whenever the machine was changed from
+outside (a reset, a new clock rate). The keyframes go at the end of the
+file and are its index: verifying re-simulates the segments between them
+on every core at once, seeking starts from the nearest one.
+*/
+
+#define REPLAY_MAGIC 0x52384843 // "CH8R"
+#define REPLAY_VERSION 1
+#define REPLAY_KEYFRAME_INTERVAL 600 // frames, 10 seconds
+
+enum {
+	KEYFRAME_CUT = 1 << 0, // the machine was reset since the last frame, the segment before can't be checked
+	KEYFRAME_END = 1 << 1, // state after the last recorded frame
+};
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t keyframe_size;
+	uint32_t slices; // input slices per frame
+	uint32_t rom_size;
+	uint8_t timing; // timing_t
+	uint8_t quirks;
+	uint8_t strict;
+	uint8_t reserved;
+	uint32_t keyframe_count;
+	uint64_t frames;
+	uint64_t input_offset; // file offsets, 8 byte aligned
+	uint64_t input_words;
+	uint64_t keyframe_offset;
+} replay_header_t;
+
+// The machine at the start of a frame, everything that decides how it runs on
+typedef struct {
+	uint64_t frame; // frames recorded before it
+	uint64_t input; // input word the frame starts at
+	uint64_t cycles;
+	uint64_t idle_cycles;
+	uint64_t wait_jump_cycle;
+	uint32_t rng;
+	uint32_t inst_per_frame;
+	int32_t cycle_budget;
+	uint16_t PC;
+	uint16_t I;
+	uint16_t wait_jump_pc;
+	uint16_t keys; // keypad, bit n = key n
+	uint16_t stack[CHIP8_STACK_MASK + 1];
+	uint8_t V[16];
+	uint8_t SP;
+	uint8_t delay_timer;
+	uint8_t sound_timer;
+	uint8_t state; // emulator_state_t, RUNNING or FAULTED
+	uint8_t vblank_wait;
+	uint8_t flags; // KEYFRAME_*
+	uint8_t reserved[2];
+	uint8_t display[CHIP8_WIDTH * CHIP8_HEIGHT / 8]; // bit per pixel, row major
+	uint8_t ram[CHIP8_RAM_SIZE];
+} replay_keyframe_t;
+
+/*
+Recording. The input words of a frame are the number of slices it ran
+followed by the keypad before each one. Keyframes are kept in memory and
+written with the header when the recording stops.
+*/
+typedef struct {
+	FILE *file;
+	replay_header_t header;
+	replay_keyframe_t *keyframes;
+	uint32_t keyframe_capacity;
+	uint16_t *frame; // the current frame's input words
+	uint32_t frame_words;
+	uint64_t last_cycles; // at the end of the last frame
+	uint32_t last_inst_per_frame;
+} replay_recorder_t;
+
+// Start recording a machine with a ROM loaded, from its current state
+bool replay_record_start(replay_recorder_t *recorder, const char *path, const chip8_t *chip8, uint32_t slices);
+
+// Call before the first slice of every frame that runs, adds a keyframe when one is due
+void replay_record_frame(replay_recorder_t *recorder, const chip8_t *chip8);
+
+// Call right before each slice runs
+void replay_record_keys(replay_recorder_t *recorder, const chip8_t *chip8);
+
+// Call after the frame's timer tick
+void replay_record_end_frame(replay_recorder_t *recorder, const chip8_t *chip8);
+
+// Add the final keyframe, the index and the header
+bool replay_record_stop(replay_recorder_t *recorder, const chip8_t *chip8);
+
+// Playback, the whole file is read into memory so any number of threads can replay from it
+typedef struct {
+	uint8_t *data;
+	const replay_header_t *header;
+	const uint8_t *rom;
+	const uint16_t *input;
+	const replay_keyframe_t *keyframes;
+	chip8_image_t *image; // the recorded ROM, shared by every machine replaying it
+} replay_t;
+
+// Position in a replay
+typedef struct {
+	uint64_t frame; // next frame to run
+	uint64_t input; // its first input word
+	uint32_t keyframe; // next keyframe to reach
+	uint32_t slices; // slices the current frame ran
+} replay_cursor_t;
+
+bool replay_open(replay_t *replay, const char *path);
+
+void replay_close(replay_t *replay);
+
+// Put the machine in the state of keyframe k and the cursor just after it
+void replay_restore(const replay_t *replay, uint32_t k, chip8_t *chip8, replay_cursor_t *cursor);
+
+/*
+Start the frame at the cursor: keyframes that cut the recording are
+restored on the way. Returns the slices it ran, -1 past the end. Run each
+slice with replay_slice_keys held, tick the timers, then replay_end_frame.
+*/
+int32_t replay_begin_frame(const replay_t *replay, chip8_t *chip8, replay_cursor_t *cursor);
+
+uint16_t replay_slice_keys(const replay_t *replay, const replay_cursor_t *cursor, uint32_t slice);
+
+void replay_end_frame(const replay_t *replay, replay_cursor_t *cursor);
+
+// Run the frame at the cursor headless, false past the end
+bool replay_run_frame(const replay_t *replay, chip8_t *chip8, replay_cursor_t *cursor);
+
+// Last keyframe at or before frame
+uint32_t replay_find_keyframe(const replay_t *replay, uint64_t frame);
+
+// Restore the nearest keyframe and run on to the start of frame
+bool replay_seek(const replay_t *replay, uint64_t frame, chip8_t *chip8, replay_cursor_t *cursor);
+
+/*
+Re-simulate every segment between two keyframes, threads at a time, and
+check each one ends in the state of the keyframe after it. Returns the
+segments that don't, and the first one in *first_bad.
+*/
+uint32_t replay_verify(const replay_t *replay, uint32_t threads, uint32_t *first_bad);
+
+#endif
@@ -0,0 +1,106 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+#include "replay.h"
+#include "timing.h"
+
+// Offline checker for replays written with --record
+
+/*
+usage: replaycheck <replay-file> [--threads N] [--seek FRAME]
+
+Without --seek every segment between two keyframes is re-simulated, on N
+threads (default: one per core), and checked against the keyframe it
+should end in. --seek FRAME prints the screen and registers at the start
+of FRAME, replayed from the nearest keyframe.
+*/
+
+static void print_machine(const chip8_t *chip8){
+	for(uint32_t y = 0; y < CHIP8_HEIGHT; y++){
+		for(uint32_t x = 0; x < CHIP8_WIDTH; x++){
+			putchar(chip8_pixel(chip8, x, y) ? '#' : '.');
+		}
+		putchar('\n');
+	}
+
+	printf("PC %03X I %03X SP %u DT %u ST %u cycles %llu\n", chip8->PC, chip8->I, chip8->SP,
+		chip8->delay_timer, chip8->sound_timer, (unsigned long long)chip8->cycles);
+	for(uint8_t i = 0; i < 16; i++){
+		printf("V%X %02X%s", i, chip8->V[i], i == 7 || i == 15 ? "\n" : "  ");
+	}
+}
+
+int main(int argc, char **argv){
+	if(argc < 2){
+		printf("usage: %s <replay-file> [--threads N] [--seek FRAME]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t threads = cores > 0 ? cores : 1;
+	bool seek = false;
+	uint64_t frame = 0;
+
+	for(int i = 2; i < argc; i++){
+		if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc){
+			threads = strtoul(argv[++i], NULL, 10);
+			if(threads == 0){
+				threads = 1;
+			}
+		}
+		else if(strcmp(argv[i], "--seek") == 0 && i + 1 < argc){
+			seek = true;
+			frame = strtoull(argv[++i], NULL, 10);
+		}
+		else{
+			printf("unknown option %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	replay_t replay;
+	if(!replay_open(&replay, argv[1])){
+		exit(EXIT_FAILURE);
+	}
+	const replay_header_t *header = replay.header;
+	printf("%llu frames, %u keyframes, %u input slices per frame, %u byte ROM\n",
+		(unsigned long long)header->frames, header->keyframe_count, header->slices, header->rom_size);
+
+	int status = EXIT_SUCCESS;
+	if(seek){
+		chip8_t *chip8 = chip8_create(1);
+		replay_cursor_t cursor;
+		const double start = host_ms();
+		if(!chip8 || !replay_seek(&replay, frame, chip8, &cursor)){
+			printf("frame %llu is past the end\n", (unsigned long long)frame);
+			status = EXIT_FAILURE;
+		}
+		else{
+			const uint32_t k = replay_find_keyframe(&replay, frame);
+			printf("frame %llu, %.2f ms from the keyframe at frame %llu\n", (unsigned long long)frame,
+				host_ms() - start, (unsigned long long)replay.keyframes[k].frame);
+			print_machine(chip8);
+		}
+		chip8_destroy(chip8);
+	}
+	else{
+		uint32_t first_bad;
+		const double start = host_ms();
+		const uint32_t bad = replay_verify(&replay, threads, &first_bad);
+		const double elapsed = host_ms() - start;
+
+		printf("%u segments on %u threads in %.1f ms, %.0f frames/s\n", header->keyframe_count - 1, threads,
+			elapsed, header->frames / (elapsed / 1000));
+		if(bad){
+			printf("%u segments don't match, the first from frame %llu\n", bad,
+				(unsigned long long)replay.keyframes[first_bad].frame);
+			status = EXIT_FAILURE;
+		}
+		else{
+			printf("every segment matches\n");
+		}
+	}
+
+	replay_close(&replay);
+	return status;
+}
@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include "scaler.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCALER_X86
+#endif
+
+static const char *filter_names[FILTER_COUNT] = {"nearest", "scale2x", "scanline", "crt"};
+
+// Span kernels, run over one output row at a time
+typedef struct {
+	void (*fill)(uint32_t *dst, uint32_t color, uint32_t n); // dst[0..n) = color
+	void (*darken)(uint32_t *p, uint32_t n); // halve RGB, keep alpha
+	void (*mask)(uint32_t *p, const uint32_t *keep, uint32_t n); // halve channels not in keep
+} kernels_t;
+
+static void fill_scalar(uint32_t *dst, uint32_t color, uint32_t n){
+	for(uint32_t i = 0; i < n; i++){
+		dst[i] = color;
+	}
+}
+
+static void darken_scalar(uint32_t *p, uint32_t n){
+	for(uint32_t i = 0; i < n; i++){
+		p[i] = ((p[i] >> 1) & 0x7F7F7F00) | (p[i] & 0xFF);
+	}
+}
+
+static void mask_scalar(uint32_t *p, const uint32_t *keep, uint32_t n){
+	for(uint32_t i = 0; i < n; i++){
+		p[i] = (p[i] & keep[i]) | ((p[i] >> 1) & 0x7F7F7F00 & ~keep[i]);
+	}
+}
+
+#ifndef SCALER_X86
+static const kernels_t kernels_scalar = {fill_scalar, darken_scalar, mask_scalar};
+#endif
+
+#ifdef SCALER_X86
+// SSE2, 4 pixels per step
+static void fill_sse2(uint32_t *dst, uint32_t color, uint32_t n){
+	const __m128i c = _mm_set1_epi32(color);
+	uint32_t i = 0;
+	for(; i + 4 <= n; i += 4){
+		_mm_storeu_si128((__m128i *)(dst + i), c);
+	}
+	fill_scalar(dst + i, color, n - i);
+}
+
+static void darken_sse2(uint32_t *p, uint32_t n){
+	const __m128i rgb = _mm_set1_epi32(0x7F7F7F00);
+	const __m128i alpha = _mm_set1_epi32(0xFF);
+	uint32_t i = 0;
+	for(; i + 4 <= n; i += 4){
+		const __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		const __m128i half = _mm_and_si128(_mm_srli_epi32(v, 1), rgb);
+		_mm_storeu_si128((__m128i *)(p + i), _mm_or_si128(half, _mm_and_si128(v, alpha)));
+	}
+	darken_scalar(p + i, n - i);
+}
+
+static void mask_sse2(uint32_t *p, const uint32_t *keep, uint32_t n){
+	const __m128i rgb = _mm_set1_epi32(0x7F7F7F00);
+	uint32_t i = 0;
+	for(; i + 4 <= n; i += 4){
+		const __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		const __m128i k = _mm_loadu_si128((const __m128i *)(keep + i));
+		const __m128i half = _mm_andnot_si128(k, _mm_and_si128(_mm_srli_epi32(v, 1), rgb));
+		_mm_storeu_si128((__m128i *)(p + i), _mm_or_si128(_mm_and_si128(v, k), half));
+	}
+	mask_scalar(p + i, keep + i, n - i);
+}
+
+static const kernels_t kernels_sse2 = {fill_sse2, darken_sse2, mask_sse2};
+
+// AVX2, 8 pixels per step, selected at runtime
+__attribute__((target("avx2")))
+static void fill_avx2(uint32_t *dst, uint32_t color, uint32_t n){
+	const __m256i c = _mm256_set1_epi32(color);
+	uint32_t i = 0;
+	for(; i + 8 <= n; i += 8){
+		_mm256_storeu_si256((__m256i *)(dst + i), c);
+	}
+	fill_sse2(dst + i, color, n - i);
+}
+
+__attribute__((target("avx2")))
+static void darken_avx2(uint32_t *p, uint32_t n){
+	const __m256i rgb = _mm256_set1_epi32(0x7F7F7F00);
+	const __m256i alpha = _mm256_set1_epi32(0xFF);
+	uint32_t i = 0;
+	for(; i + 8 <= n; i += 8){
+		const __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+		const __m256i half = _mm256_and_si256(_mm256_srli_epi32(v, 1), rgb);
+		_mm256_storeu_si256((__m256i *)(p + i), _mm256_or_si256(half, _mm256_and_si256(v, alpha)));
+	}
+	darken_sse2(p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void mask_avx2(uint32_t *p, const uint32_t *keep, uint32_t n){
+	const __m256i rgb = _mm256_set1_epi32(0x7F7F7F00);
+	uint32_t i = 0;
+	for(; i + 8 <= n; i += 8){
+		const __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+		const __m256i k = _mm256_loadu_si256((const __m256i *)(keep + i));
+		const __m256i half = _mm256_andnot_si256(k, _mm256_and_si256(_mm256_srli_epi32(v, 1), rgb));
+		_mm256_storeu_si256((__m256i *)(p + i), _mm256_or_si256(_mm256_and_si256(v, k), half));
+	}
+	mask_sse2(p + i, keep + i, n - i);
+}
+
+static const kernels_t kernels_avx2 = {fill_avx2, darken_avx2, mask_avx2};
+#endif
+
+static const kernels_t *select_kernels(void){
+#ifdef SCALER_X86
+	if(__builtin_cpu_supports("avx2")){
+		return &kernels_avx2;
+	}
+	return &kernels_sse2;
+#else
+	return &kernels_scalar;
+#endif
+}
+
+bool scaler_init(scaler_t *scaler, filter_t filter, uint32_t src_width, uint32_t src_height, uint32_t scale, bool outlines){
+	*scaler = (scaler_t){
+		.filter = filter,
+		.src_width = src_width,
+		.src_height = src_height,
+		.scale = scale,
+		.outlines = outlines && filter != FILTER_SCALE2X,
+	};
+
+	// Scale2x doubles the display first, so the rest of the scale has to be a whole number
+	if(filter == FILTER_SCALE2X && scale % 2 != 0){
+		scaler->filter = FILTER_NEAREST;
+	}
+
+	const uint32_t width = src_width * scale;
+	scaler->row = malloc(width * sizeof(uint32_t));
+	scaler->edge_row = malloc(width * sizeof(uint32_t));
+	scaler->dark_row = malloc(width * sizeof(uint32_t));
+	scaler->grille = malloc(width * sizeof(uint32_t));
+	scaler->epx = malloc(src_width * src_height * 4);
+
+	if(!scaler->row || !scaler->edge_row || !scaler->dark_row || !scaler->grille || !scaler->epx){
+		scaler_free(scaler);
+		return false;
+	}
+
+	// R, G, B phosphor stripes, alpha always kept
+	const uint32_t stripes[3] = {0xFF0000FF, 0x00FF00FF, 0x0000FFFF};
+	for(uint32_t x = 0; x < width; x++){
+		scaler->grille[x] = stripes[x % 3];
+	}
+
+	return true;
+}
+
+void scaler_free(scaler_t *scaler){
+	free(scaler->row);
+	free(scaler->edge_row);
+	free(scaler->dark_row);
+	free(scaler->grille);
+	free(scaler->epx);
+	*scaler = (scaler_t){0};
+}
+
+// Scale2x/EPX: each pixel becomes 2x2, corners take a neighbour's colour along diagonal edges
+static void epx(const uint8_t *src, uint32_t w, uint32_t h, uint8_t *dst){
+	for(uint32_t y = 0; y < h; y++){
+		for(uint32_t x = 0; x < w; x++){
+			const uint8_t p = src[y*w + x];
+			const uint8_t a = src[(y > 0 ? y-1 : y)*w + x];
+			const uint8_t b = src[y*w + (x < w-1 ? x+1 : x)];
+			const uint8_t c = src[y*w + (x > 0 ? x-1 : x)];
+			const uint8_t d = src[(y < h-1 ? y+1 : y)*w + x];
+
+			uint8_t *out = &dst[(2*y)*(2*w) + 2*x];
+			out[0] = (c == a && c != d && a != b) ? a : p;
+			out[1] = (a == b && a != c && b != d) ? b : p;
+			out[2*w] = (d == c && d != b && c != a) ? c : p;
+			out[2*w + 1] = (b == d && b != a && d != c) ? d : p;
+		}
+	}
+}
+
+void scaler_run(const scaler_t *scaler, const uint8_t *src, const uint32_t palette[256], uint32_t *dst, uint32_t pitch){
+	const kernels_t *k = select_kernels();
+
+	uint32_t w = scaler->src_width;
+	uint32_t h = scaler->src_height;
+	uint32_t scale = scaler->scale;
+
+	if(scaler->filter == FILTER_SCALE2X){
+		epx(src, w, h, scaler->epx);
+		src = scaler->epx;
+		w *= 2;
+		h *= 2;
+		scale /= 2;
+	}
+
+	const uint32_t width = w * scale;
+	const bool scanlines = (scaler->filter == FILTER_SCANLINE || scaler->filter == FILTER_CRT) && scale >= 3;
+	const uint32_t dark_from = scale - scale/3; // last third of every cell is the dark gap
+
+	for(uint32_t y = 0; y < h; y++){
+		const uint8_t *line = &src[y*w];
+
+		// Build the row once
+		for(uint32_t x = 0; x < w; x++){
+			k->fill(&scaler->row[x*scale], palette[line[x]], scale);
+		}
+
+		if(scaler->filter == FILTER_CRT){
+			k->mask(scaler->row, scaler->grille, width);
+		}
+
+		if(scaler->outlines){
+			memcpy(scaler->edge_row, scaler->row, width * sizeof(uint32_t));
+			for(uint32_t x = 0; x < w; x++){
+				if(line[x]){
+					k->fill(&scaler->edge_row[x*scale], palette[0], scale);
+					scaler->row[x*scale] = palette[0];
+					scaler->row[x*scale + scale - 1] = palette[0];
+				}
+			}
+		}
+
+		if(scanlines){
+			memcpy(scaler->dark_row, scaler->row, width * sizeof(uint32_t));
+			k->darken(scaler->dark_row, width);
+		}
+
+		// Copy it down the cell
+		for(uint32_t r = 0; r < scale; r++){
+			const uint32_t *from = scaler->row;
+			if(scaler->outlines && (r == 0 || r == scale - 1)){
+				from = scaler->edge_row;
+			}
+			else if(scanlines && r >= dark_from){
+				from = scaler->dark_row;
+			}
+			memcpy(&dst[(y*scale + r) * pitch], from, width * sizeof(uint32_t));
+		}
+	}
+}
+
+filter_t filter_from_name(const char *name){
+	for(uint32_t i = 0; i < FILTER_COUNT; i++){
+		if(strcmp(name, filter_names[i]) == 0){
+			return (filter_t)i;
+		}
+	}
+	return FILTER_COUNT;
+}
+
+const char *filter_name(filter_t filter){
+	return filter < FILTER_COUNT ? filter_names[filter] : "unknown";
+}
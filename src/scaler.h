@@ -0,0 +1,46 @@
+#ifndef SCALER_H
+#define SCALER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Upscaling filters for the CHIP-8 display
+typedef enum {
+	FILTER_NEAREST, // integer nearest neighbour
+	FILTER_SCALE2X, // Scale2x/EPX smoothing, then nearest
+	FILTER_SCANLINE, // nearest with darkened scanlines
+	FILTER_CRT, // scanlines plus an RGB aperture grille mask
+	FILTER_COUNT
+} filter_t;
+
+typedef struct {
+	filter_t filter;
+	uint32_t src_width, src_height; // display size
+	uint32_t scale; // output pixels per display pixel
+	bool outlines; // outline lit pixels with the background colour
+
+	// one output row of each kind, built once per display row and copied down
+	uint32_t *row; // plain row
+	uint32_t *edge_row; // first/last row of a cell when drawing outlines
+	uint32_t *dark_row; // scanline row
+	uint32_t *grille; // per-column channel mask for FILTER_CRT
+	uint8_t *epx; // 2x intermediate for FILTER_SCALE2X
+} scaler_t;
+
+bool scaler_init(scaler_t *scaler, filter_t filter, uint32_t src_width, uint32_t src_height, uint32_t scale, bool outlines);
+
+void scaler_free(scaler_t *scaler);
+
+/*
+Scale src (one byte per display pixel, used as an index into palette) into
+dst, an RGBA8888 buffer of (src_width*scale) x (src_height*scale) pixels
+whose rows are pitch pixels apart.
+*/
+void scaler_run(const scaler_t *scaler, const uint8_t *src, const uint32_t palette[256], uint32_t *dst, uint32_t pitch);
+
+// Look up a filter by name, returns FILTER_COUNT if unknown
+filter_t filter_from_name(const char *name);
+
+const char *filter_name(filter_t filter);
+
+#endif
@@ -11,50 +11,47 @@ void clear_screen(const sdl_t sdl, const config_t config){
 }
 
 // Update window changes
-void update_screen(const sdl_t sdl, config_t config, chip8_t chip8){
-	SDL_Rect rect = {.x = 0, .y = 0, .w = config.scale_factor, .h = config.scale_factor};
-
-// Color Values
-	const uint8_t bg_r = (config.background_color >> 24) & 0xFF;
-	const uint8_t bg_g = (config.background_color >> 16) & 0xFF;
-	const uint8_t bg_b = (config.background_color >> 8) & 0xFF;
-	const uint8_t bg_a = (config.background_color >> 0) & 0xFF;
-
-	const uint8_t fg_r = (config.foreground_color >> 24) & 0xFF;
-	const uint8_t fg_g = (config.foreground_color >> 16) & 0xFF;
-	const uint8_t fg_b = (config.foreground_color >> 8) & 0xFF;
-	const uint8_t fg_a = (config.foreground_color >> 0) & 0xFF;
-
-
-
-// Draw Rectange per pixel
-	for(uint32_t i = 0; i < sizeof(chip8.display); i++){
-		// Translate i value to x y coordinates
-		rect.x = (i % config.window_width)*config.scale_factor;
-		rect.y = (i / config.window_width) *config.scale_factor;
-
+uint32_t update_screen(const sdl_t sdl, config_t config, const chip8_t *chip8, const hud_t *hud){
+	uint8_t display[CHIP8_WIDTH * CHIP8_HEIGHT];
+	chip8_get_framebuffer(chip8, display);
+	const uint8_t *frame = display;
+
+// Color Values, display pixels index the palette (0 = off)
+	uint32_t palette[256];
+	palette[0] = config.background_color;
+	for(uint32_t i = 1; i < 256; i++){
+		palette[i] = config.foreground_color;
+	}
 
-		if(chip8.display[i]){
-			// draw foreground
-			SDL_SetRenderDrawColor(sdl.renderer, fg_r, fg_g, fg_b, fg_a);
-			SDL_RenderFillRect(sdl.renderer, &rect);
+// Blend with previous frames, intensities fade from background to foreground
+	if(sdl.persist){
+		frame = persist_apply(sdl.persist, frame);
 
-			// pixel outlines not necessary can be used as user option
-			if(config.pixel_outlines){
-				SDL_SetRenderDrawColor(sdl.renderer, bg_r, bg_g, bg_b, bg_a);
-				SDL_RenderDrawRect(sdl.renderer, &rect);
+		for(uint32_t i = 0; i < 256; i++){
+			uint32_t color = 0;
+			for(uint32_t shift = 0; shift < 32; shift += 8){
+				const uint32_t bg = (config.background_color >> shift) & 0xFF;
+				const uint32_t fg = (config.foreground_color >> shift) & 0xFF;
+				color |= ((bg * (255 - i) + fg * i) / 255) << shift;
 			}
-
-
-		}
-		else{
-			// draw background
-			SDL_SetRenderDrawColor(sdl.renderer, bg_r, bg_g, bg_b, bg_a);
-			SDL_RenderFillRect(sdl.renderer, &rect);
+			palette[i] = color;
 		}
 	}
 
+// Scale the whole display into the streaming texture in one pass
+	void *pixels;
+	int pitch;
+	if(SDL_LockTexture(sdl.texture, NULL, &pixels, &pitch) != 0){
+		SDL_Log("could not lock texture %s\n", SDL_GetError());
+		return 0;
+	}
+
+	scaler_run(&sdl.scaler, frame, palette, pixels, pitch / sizeof(uint32_t));
 
+	SDL_UnlockTexture(sdl.texture);
 
+	SDL_RenderCopy(sdl.renderer, sdl.texture, NULL, NULL);
+	hud_draw(hud, sdl.renderer);
 	SDL_RenderPresent(sdl.renderer);
-}
\ No newline at end of file
+	return 1 + hud->visible;
+}
@@ -1,11 +1,12 @@
 #ifndef SCREEN_H
 #define SCREEN_H
 
-#include "chip8.h"
+#include "frontend.h"
+#include "hud.h"
 
 void clear_screen(const sdl_t sdl, const config_t config);
 
-// Update window changes
-void update_screen(const sdl_t sdl, config_t config, chip8_t chip8);
+// Update window changes, with the HUD on top when it is shown. Returns the texture copies made
+uint32_t update_screen(const sdl_t sdl, config_t config, const chip8_t *chip8, const hud_t *hud);
 
 #endif
\ No newline at end of file
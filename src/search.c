@@ -0,0 +1,326 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include "search.h"
+
+typedef struct {
+	chip8_t *chip8;
+	int64_t score;
+	uint64_t hash; // of the state, to drop duplicates
+	uint32_t parent; // beam slot it was copied from
+	uint16_t keys; // action that led to it
+} node_t;
+
+// One step of the search, the workers claim children from it
+typedef struct {
+	const search_config_t *config;
+	const node_t *beam;
+	node_t *children;
+	uint32_t count;
+	uint32_t step;
+	atomic_uint next; // next child to claim
+	_Atomic uint64_t frames;
+} step_t;
+
+typedef struct {
+	step_t *step;
+	chip8_t *scratch; // playouts run here, NULL without rollouts
+} worker_t;
+
+// Children sorted by score, ties go to the one expanded first so threads don't change the result
+typedef struct {
+	int64_t score;
+	uint32_t index;
+} rank_t;
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size){
+	const uint8_t *bytes = data;
+	for(size_t i = 0; i < size; i++){
+		hash = (hash ^ bytes[i]) * 0x100000001b3;
+	}
+	return hash;
+}
+
+// Everything the machine's future depends on except the keys, which the next step sets anyway
+static uint64_t hash_state(const chip8_t *chip8){
+	const uint8_t regs[] = {
+		chip8->I >> 8, chip8->I & 0xFF, chip8->PC >> 8, chip8->PC & 0xFF, chip8->SP,
+		chip8->delay_timer, chip8->sound_timer, chip8->state, chip8->vblank_wait,
+	};
+	uint64_t hash = 0xcbf29ce484222325;
+	hash = hash_bytes(hash, chip8->display, sizeof chip8->display);
+	hash = hash_bytes(hash, chip8->V, sizeof chip8->V);
+	hash = hash_bytes(hash, regs, sizeof regs);
+	hash = hash_bytes(hash, &chip8->rng, sizeof chip8->rng);
+	hash = hash_bytes(hash, &chip8->cycle_budget, sizeof chip8->cycle_budget);
+	hash = hash_bytes(hash, chip8->stack, chip8->SP * sizeof chip8->stack[0]);
+	for(uint8_t page = 0; page < CHIP8_PAGES; page++){
+		if(chip8->private_pages & (1u << page)){
+			hash = hash_bytes(hash, &page, 1);
+			hash = hash_bytes(hash, chip8->pages[page], CHIP8_PAGE_SIZE);
+		}
+	}
+	return hash;
+}
+
+static uint32_t xorshift(uint32_t *x){
+	*x ^= *x << 13;
+	*x ^= *x >> 17;
+	*x ^= *x << 5;
+	return *x;
+}
+
+// Hold keys for frames frames, returns the frames run
+static uint64_t run_action(chip8_t *chip8, uint16_t keys, uint32_t frames){
+	chip8_set_keys(chip8, keys);
+	uint32_t f = 0;
+	for(; f < frames && chip8->state == RUNNING; f++){
+		chip8_run_frame(chip8);
+	}
+	return f;
+}
+
+static uint64_t expand_child(step_t *step, uint32_t i, chip8_t *scratch){
+	const search_config_t *config = step->config;
+	node_t *child = &step->children[i];
+	child->parent = i / config->action_count;
+	child->keys = config->actions[i % config->action_count];
+
+	chip8_snapshot(step->beam[child->parent].chip8, child->chip8);
+	uint64_t frames = run_action(child->chip8, child->keys, config->frames_per_step);
+	child->hash = hash_state(child->chip8);
+
+	if(!scratch){
+		child->score = config->score(child->chip8, config->user);
+		return frames;
+	}
+
+	// the playouts of a child are the same whichever thread runs them
+	uint32_t rng = config->seed ^ (step->step * 0x9E3779B9u) ^ (i * 0x85EBCA6Bu);
+	rng = rng ? rng : 1;
+	child->score = INT64_MIN;
+	for(uint32_t r = 0; r < config->rollouts; r++){
+		chip8_snapshot(child->chip8, scratch);
+		for(uint32_t s = 0; s < config->rollout_steps && scratch->state == RUNNING; s++){
+			const uint16_t keys = config->actions[xorshift(&rng) % config->action_count];
+			frames += run_action(scratch, keys, config->frames_per_step);
+		}
+		const int64_t score = config->score(scratch, config->user);
+		if(score > child->score){
+			child->score = score;
+		}
+	}
+	return frames;
+}
+
+static void *search_thread(void *arg){
+	worker_t *worker = arg;
+	step_t *step = worker->step;
+	uint64_t frames = 0;
+	for(uint32_t i; (i = atomic_fetch_add(&step->next, 1)) < step->count;){
+		frames += expand_child(step, i, worker->scratch);
+	}
+	atomic_fetch_add(&step->frames, frames);
+	return NULL;
+}
+
+// Expand every child of the step on the workers, the calling thread only waits
+static void run_step(step_t *step, worker_t *workers, uint32_t threads){
+	pthread_t *ids = malloc(threads * sizeof *ids);
+	uint32_t started = 0;
+	for(; ids && started < threads; started++){
+		workers[started].step = step;
+		if(pthread_create(&ids[started], NULL, search_thread, &workers[started]) != 0){
+			break;
+		}
+	}
+	if(started == 0){
+		search_thread(&workers[0]); // no threads, do it all here
+	}
+	for(uint32_t i = 0; i < started; i++){
+		pthread_join(ids[i], NULL);
+	}
+	free(ids);
+}
+
+static int compare_rank(const void *a, const void *b){
+	const rank_t *x = a, *y = b;
+	if(x->score != y->score){
+		return x->score > y->score ? -1 : 1;
+	}
+	return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// Everything a search holds, the machines are made up front and reused every step
+typedef struct {
+	uint32_t width;
+	uint32_t max_children;
+	uint32_t threads;
+	node_t *beam;
+	node_t *children;
+	rank_t *ranks;
+	worker_t *workers;
+	uint32_t *parents; // beam slot of the parent of every kept state, depth x width
+	uint16_t *keys; // and its action
+} search_t;
+
+static void search_free(search_t *search){
+	for(uint32_t i = 0; search->beam && i < search->width; i++){
+		chip8_destroy(search->beam[i].chip8);
+	}
+	for(uint32_t i = 0; search->children && i < search->max_children; i++){
+		chip8_destroy(search->children[i].chip8);
+	}
+	for(uint32_t t = 0; search->workers && t < search->threads; t++){
+		chip8_destroy(search->workers[t].scratch);
+	}
+	free(search->beam);
+	free(search->children);
+	free(search->ranks);
+	free(search->workers);
+	free(search->parents);
+	free(search->keys);
+}
+
+static bool search_alloc(search_t *search, const search_config_t *config){
+	*search = (search_t){
+		.width = config->width,
+		.max_children = config->width * config->action_count,
+		.threads = config->threads ? config->threads : 1,
+	};
+	search->beam = calloc(search->width, sizeof *search->beam);
+	search->children = calloc(search->max_children, sizeof *search->children);
+	search->ranks = malloc(search->max_children * sizeof *search->ranks);
+	search->workers = calloc(search->threads, sizeof *search->workers);
+	search->parents = malloc((size_t)config->depth * search->width * sizeof *search->parents);
+	search->keys = malloc((size_t)config->depth * search->width * sizeof *search->keys);
+	if(!search->beam || !search->children || !search->ranks || !search->workers || !search->parents || !search->keys){
+		return false;
+	}
+
+	for(uint32_t i = 0; i < search->width; i++){
+		if(!(search->beam[i].chip8 = chip8_create(1))){
+			return false;
+		}
+	}
+	for(uint32_t i = 0; i < search->max_children; i++){
+		if(!(search->children[i].chip8 = chip8_create(1))){
+			return false;
+		}
+	}
+	for(uint32_t t = 0; t < search->threads && config->rollouts; t++){
+		if(!(search->workers[t].scratch = chip8_create(1))){
+			return false;
+		}
+	}
+	return true;
+}
+
+// Average over every machine the search holds
+static size_t node_bytes(const search_t *search, uint32_t nodes){
+	size_t bytes = 0;
+	chip8_memory_t stats;
+	for(uint32_t i = 0; i < search->width; i++){
+		chip8_memory_stats(search->beam[i].chip8, &stats);
+		bytes += stats.resident_bytes;
+	}
+	for(uint32_t i = 0; i < search->max_children; i++){
+		chip8_memory_stats(search->children[i].chip8, &stats);
+		bytes += stats.resident_bytes;
+	}
+	for(uint32_t t = 0; t < search->threads; t++){
+		if(search->workers[t].scratch){
+			chip8_memory_stats(search->workers[t].scratch, &stats);
+			bytes += stats.resident_bytes;
+		}
+	}
+	return bytes / nodes;
+}
+
+// Keep the best distinct children as the next beam, returns how many
+static uint32_t select_beam(search_t *search, uint32_t count, uint32_t step, search_result_t *result){
+	node_t *beam = search->beam, *children = search->children;
+	for(uint32_t i = 0; i < count; i++){
+		search->ranks[i] = (rank_t){children[i].score, i};
+	}
+	qsort(search->ranks, count, sizeof *search->ranks, compare_rank);
+
+	// the kept children swap their machines with the old beam's
+	uint32_t kept = 0;
+	for(uint32_t r = 0; r < count && kept < search->width; r++){
+		node_t *child = &children[search->ranks[r].index];
+		bool duplicate = false;
+		for(uint32_t k = 0; k < kept && !duplicate; k++){
+			duplicate = beam[k].hash == child->hash;
+		}
+		if(duplicate){
+			result->duplicates++;
+			continue;
+		}
+
+		chip8_t *old = beam[kept].chip8;
+		beam[kept] = *child;
+		child->chip8 = old;
+		search->parents[step * search->width + kept] = child->parent;
+		search->keys[step * search->width + kept] = child->keys;
+		kept++;
+	}
+	return kept;
+}
+
+bool search_run(const chip8_t *start, const search_config_t *config, search_result_t *result){
+	*result = (search_result_t){.score = INT64_MIN};
+	if(config->width == 0 || config->action_count == 0 || config->depth == 0){
+		return false;
+	}
+
+	search_t search;
+	if(!search_alloc(&search, config)){
+		fprintf(stderr, "Out of memory for the search\n");
+		search_free(&search);
+		return false;
+	}
+	result->nodes = search.width + search.max_children + (config->rollouts ? search.threads : 0);
+
+	// the search runs without hooks, children copy them from the beam
+	chip8_t *root = search.beam[0].chip8;
+	chip8_snapshot(start, root);
+	root->trace = NULL;
+	root->debugger = NULL;
+	root->heatmap = NULL;
+	root->journal = NULL;
+	uint32_t beam_count = 1, best_step = 0;
+
+	for(uint32_t s = 0; s < config->depth && beam_count; s++){
+		step_t step = {.config = config, .beam = search.beam, .children = search.children,
+			.count = beam_count * config->action_count, .step = s};
+		atomic_init(&step.next, 0);
+		atomic_init(&step.frames, 0);
+		run_step(&step, search.workers, search.threads);
+		result->states += step.count;
+		result->frames += atomic_load(&step.frames);
+
+		beam_count = select_beam(&search, step.count, s, result);
+		if(search.beam[0].score >= result->score){ // ties go to the deeper state
+			result->score = search.beam[0].score;
+			best_step = s;
+		}
+	}
+
+	// walk back from the best state, slot 0 of its step
+	result->steps = best_step + 1;
+	result->inputs = malloc(result->steps * sizeof *result->inputs);
+	if(result->inputs){
+		for(uint32_t s = result->steps, slot = 0; s-- > 0;){
+			result->inputs[s] = search.keys[s * search.width + slot];
+			slot = search.parents[s * search.width + slot];
+		}
+	}
+	result->node_bytes = node_bytes(&search, result->nodes);
+	search_free(&search);
+	return result->inputs != NULL;
+}
+
+void search_result_free(search_result_t *result){
+	free(result->inputs);
+	result->inputs = NULL;
+}
@@ -0,0 +1,49 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "chip8.h"
+
+/*
+Input search for automated play and testing. From a starting machine every
+state in the beam is copied (chip8_snapshot, so only the pages it wrote to
+are its own) once per keypad action, each copy holds its action for a few
+frames, and the best scoring distinct states form the next beam. The
+copies are run on a pool of threads. With rollouts set a state is scored
+by the best of that many random playouts from it instead of as it is, a
+beam of width 1 then is a Monte Carlo search that commits a step at a time.
+*/
+
+// Higher is better. Called from the worker threads, must only read the machine
+typedef int64_t (*search_score_t)(const chip8_t *chip8, void *user);
+
+typedef struct {
+	uint32_t width; // states kept after each step
+	uint32_t depth; // steps
+	uint32_t frames_per_step; // frames each action is held for
+	const uint16_t *actions; // keypad masks to try from every state, bit n = key n
+	uint32_t action_count;
+	uint32_t rollouts; // random playouts scoring each state, 0 scores it as it is
+	uint32_t rollout_steps; // steps in each playout
+	uint32_t threads;
+	uint32_t seed; // for the playouts
+	search_score_t score;
+	void *user;
+} search_config_t;
+
+typedef struct {
+	uint16_t *inputs; // keypad of each step on the way to the best state, malloc'd
+	uint32_t steps;
+	int64_t score; // of the best state
+	uint64_t states; // states expanded, playouts not included
+	uint64_t frames; // frames emulated, playouts included
+	uint64_t duplicates; // states dropped for being the same as a better one
+	uint32_t nodes; // machines the search holds at once
+	size_t node_bytes; // average resident bytes of one, see chip8_memory_stats
+} search_result_t;
+
+// Search from start, which is not changed. False if out of memory
+bool search_run(const chip8_t *start, const search_config_t *config, search_result_t *result);
+
+void search_result_free(search_result_t *result);
+
+#endif
@@ -0,0 +1,90 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "shared.h"
+
+bool shared_open(shared_t *shared, const char *name){
+	*shared = (shared_t){.name = name};
+
+	// never attach to a segment another instance publishes into, closing would unlink it from under that one
+	const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if(fd < 0 && errno == EEXIST){
+		fprintf(stderr, "shared memory %s already exists, another instance is using it or one that crashed left it in /dev/shm\n", name);
+		return false;
+	}
+	if(fd < 0){
+		fprintf(stderr, "could not open shared memory %s\n", name);
+		return false;
+	}
+
+	if(ftruncate(fd, sizeof(shared_state_t)) != 0){
+		fprintf(stderr, "could not size shared memory %s\n", name);
+		close(fd);
+		shm_unlink(name);
+		return false;
+	}
+
+	void *map = mmap(NULL, sizeof(shared_state_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED){
+		fprintf(stderr, "could not map shared memory %s\n", name);
+		shm_unlink(name);
+		return false;
+	}
+
+	shared->state = map;
+	memset(shared->state, 0, sizeof(shared_state_t));
+	shared->state->magic = SHARED_MAGIC;
+	shared->state->version = SHARED_VERSION;
+
+	return true;
+}
+
+void shared_close(shared_t *shared){
+	if(!shared->state){
+		return;
+	}
+
+	munmap(shared->state, sizeof(shared_state_t));
+	shm_unlink(shared->name);
+	shared->state = NULL;
+}
+
+void shared_publish(shared_t *shared, const chip8_t *chip8){
+	shared_state_t *out = shared->state;
+	const uint32_t sequence = atomic_load_explicit(&out->sequence, memory_order_relaxed);
+
+	// seqlock: odd while writing
+	atomic_store_explicit(&out->sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	out->frame++;
+	out->cycles = chip8->cycles;
+	chip8_get_framebuffer(chip8, out->display);
+	memcpy(out->V, chip8->V, sizeof out->V);
+	memcpy(out->stack, chip8->stack, sizeof out->stack);
+	out->I = chip8->I;
+	out->PC = chip8->PC;
+	out->SP = chip8->SP;
+	out->delay_timer = chip8->delay_timer;
+	out->sound_timer = chip8->sound_timer;
+	out->state = chip8->state;
+	memcpy(out->key_cycles, chip8->keypad_cycle, sizeof out->key_cycles);
+
+	atomic_store_explicit(&out->sequence, sequence + 2, memory_order_release);
+}
+
+void shared_sync_keys(shared_t *shared, chip8_t *chip8){
+	const uint32_t keys = atomic_load_explicit(&shared->state->keys, memory_order_relaxed) & 0xFFFF;
+	const uint32_t changed = keys ^ shared->last_keys;
+
+	// only transitions are applied, so the local keyboard still works alongside
+	for(uint8_t key = 0; changed >> key; key++){
+		if(changed & (1 << key)){
+			set_keypad(chip8, key, keys & (1 << key));
+		}
+	}
+	shared->last_keys = keys;
+}
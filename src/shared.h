@@ -0,0 +1,68 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <stdatomic.h>
+#include "chip8.h"
+
+#define SHARED_MAGIC 0x53384843 // "CH8S"
+#define SHARED_VERSION 3
+
+/*
+Machine state published to other local processes through a POSIX shared
+memory segment once per frame. The emulator is the only writer of
+everything but keys; sequence is odd while an update is in progress.
+*/
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	_Atomic uint32_t sequence;
+	uint32_t reserved;
+	uint64_t frame; // frames published so far
+	uint64_t cycles; // instructions executed since reset
+
+	uint8_t display[CHIP8_WIDTH * CHIP8_HEIGHT]; // 1 = lit
+	uint8_t V[16];
+	uint16_t stack[CHIP8_STACK_MASK + 1]; // the whole stack, SP can pass 12 outside --strict
+	uint16_t I;
+	uint16_t PC;
+	uint8_t SP; // stack entries in use
+	uint8_t delay_timer;
+	uint8_t sound_timer;
+	uint8_t state; // emulator_state_t
+	uint64_t key_cycles[16]; // cycle each key last changed state, against cycles: how long ago a press landed
+
+	_Atomic uint32_t keys; // written by consumers, bit n holds CHIP-8 key n down
+} shared_state_t;
+
+typedef struct {
+	shared_state_t *state;
+	const char *name;
+	uint32_t last_keys; // keys as last applied to the keypad
+} shared_t;
+
+// Create the segment called name, e.g. "/chip8", refused if it already exists
+bool shared_open(shared_t *shared, const char *name);
+
+void shared_close(shared_t *shared);
+
+// Copy the machine state into the segment
+void shared_publish(shared_t *shared, const chip8_t *chip8);
+
+// Apply key changes written by consumers
+void shared_sync_keys(shared_t *shared, chip8_t *chip8);
+
+// Consumer side: copy a consistent snapshot out of the segment
+static inline void shared_read(shared_state_t *src, shared_state_t *dst){
+	uint32_t before, after;
+	do{
+		before = atomic_load_explicit(&src->sequence, memory_order_acquire);
+		if(before & 1){
+			continue; // writer is mid update
+		}
+		memcpy(dst, src, sizeof(shared_state_t));
+		atomic_thread_fence(memory_order_acquire);
+		after = atomic_load_explicit(&src->sequence, memory_order_relaxed);
+	} while((before & 1) || before != after);
+}
+
+#endif
@@ -1,5 +1,10 @@
+#include <stdatomic.h>
 #include "sound.h"
 
+static _Atomic uint64_t last_fill; // performance counter when the callback last ran
+static _Atomic uint32_t resumed; // times the device was started, a gap across a pause is no underrun
+static _Atomic(metrics_block_t *) audio_metrics;
+
 void audio_callback(void *userdata, uint8_t *stream, int len){
     config_t *config = (config_t *) userdata;
 
@@ -15,4 +20,84 @@ void audio_callback(void *userdata, uint8_t *stream, int len){
         config->volume : 
         -config->volume;
     }
+
+    const uint64_t now = SDL_GetPerformanceCounter();
+    const uint64_t last = atomic_exchange(&last_fill, now);
+
+    // callback thread only: late by more than two buffers since the last one, with no pause between
+    metrics_block_t *metrics = atomic_load_explicit(&audio_metrics, memory_order_acquire);
+    if(metrics){
+        static uint32_t seen_resumed = 0;
+        const uint32_t resumes = atomic_load(&resumed);
+        const double buffer = (double)(len/2) / config->audio_sample_rate; // seconds
+        if(resumes == seen_resumed && last && now - last > 2 * buffer * SDL_GetPerformanceFrequency()){
+            metrics_add(metrics, METRIC_AUDIO_UNDERRUNS, 1);
+        }
+        seen_resumed = resumes;
+        metrics_add(metrics, METRIC_AUDIO_CALLBACKS, 1);
+    }
+}
+
+// Opened on the first beep instead of at startup, many programs never beep at all
+static bool audio_open(sdl_t *sdl){
+    const uint64_t start = SDL_GetPerformanceCounter();
+    if(SDL_InitSubSystem(SDL_INIT_AUDIO) != 0){
+        SDL_Log("Can't Initialize SDL Audio %s \n", SDL_GetError());
+        return false;
+    }
+
+    sdl->dev = SDL_OpenAudioDevice(NULL,0, &sdl->want, &sdl->have, 0);
+    if(sdl->dev == 0){
+        SDL_Log("could not get any audio device %s, the beep is off\n", SDL_GetError());
+        return false;
+    }
+
+    if((sdl->want.format != sdl->have.format)||(sdl->want.channels != sdl->have.channels)){
+        SDL_Log("could not get desired audio spec, the beep is off\n");
+        SDL_CloseAudioDevice(sdl->dev);
+        sdl->dev = 0;
+        return false;
+    }
+
+    if(sdl->timings){
+        SDL_Log("startup: audio device opened on the first beep in %.2f ms\n",
+            (double)((SDL_GetPerformanceCounter() - start)*1000)/SDL_GetPerformanceFrequency());
+    }
+    return true;
+}
+
+void audio_play(sdl_t *sdl, bool on){
+    static bool playing = false; // main thread only, the device opens paused
+    if(on == playing){
+        return;
+    }
+    if(sdl->dev == 0){
+        if(sdl->audio_failed){
+            return;
+        }
+        if(!audio_open(sdl)){
+            sdl->audio_failed = true;
+            return;
+        }
+    }
+
+    if(on){
+        atomic_fetch_add(&resumed, 1);
+    }
+    SDL_PauseAudioDevice(sdl->dev, !on);
+    playing = on;
+}
+
+void audio_set_metrics(metrics_block_t *block){
+    atomic_store_explicit(&audio_metrics, block, memory_order_release);
+}
+
+double audio_buffer_fill(const sdl_t *sdl){
+    if(sdl->dev == 0 || SDL_GetAudioDeviceStatus(sdl->dev) != SDL_AUDIO_PLAYING){
+        return -1;
+    }
+
+    const double buffer = (double)sdl->have.samples / sdl->have.freq; // seconds
+    const double since = (double)(SDL_GetPerformanceCounter() - atomic_load(&last_fill)) / SDL_GetPerformanceFrequency();
+    return since >= buffer ? 0 : 1 - since / buffer;
 }
\ No newline at end of file
@@ -1,8 +1,19 @@
 #ifndef SOUND_H
 #define SOUND_H
 
-#include "chip8.h"
+#include "frontend.h"
+#include "metrics.h"
 
 void audio_callback(void *userdata, uint8_t *stream, int len);
 
-#endif
\ No newline at end of file
+// Start or pause the device, only touches it when the state changes. The
+// first start opens it
+void audio_play(sdl_t *sdl, bool on);
+
+// Count callbacks and underruns into block from now on, NULL stops counting
+void audio_set_metrics(metrics_block_t *block);
+
+// Share of the device buffer still to play, estimated from when the callback last filled it, -1 while silent
+double audio_buffer_fill(const sdl_t *sdl);
+
+#endif
@@ -0,0 +1,58 @@
+#include <ctype.h>
+#include "text.h"
+
+// Glyphs beyond the hex digits, same 4x5 layout as chip8_font
+static const struct {
+	char c;
+	uint8_t rows[5];
+} letters[] = {
+	{'I', {0xE0, 0x40, 0x40, 0x40, 0xE0}},
+	{'L', {0x80, 0x80, 0x80, 0x80, 0xF0}},
+	{'M', {0x90, 0xF0, 0xF0, 0x90, 0x90}},
+	{'N', {0x90, 0xD0, 0xB0, 0x90, 0x90}},
+	{'O', {0x60, 0x90, 0x90, 0x90, 0x60}},
+	{'P', {0xE0, 0x90, 0xE0, 0x80, 0x80}},
+	{'R', {0xE0, 0x90, 0xE0, 0xA0, 0x90}},
+	{'S', {0x70, 0x80, 0x60, 0x10, 0xE0}},
+	{'T', {0xE0, 0x40, 0x40, 0x40, 0x40}},
+	{'U', {0x90, 0x90, 0x90, 0x90, 0x60}},
+	{'V', {0x90, 0x90, 0x90, 0x60, 0x60}},
+	{'X', {0x90, 0x90, 0x60, 0x90, 0x90}},
+	{'.', {0x00, 0x00, 0x00, 0x00, 0x40}},
+	{'-', {0x00, 0x00, 0xE0, 0x00, 0x00}},
+	{'%', {0x90, 0x20, 0x40, 0x80, 0x90}},
+	{'/', {0x10, 0x20, 0x20, 0x40, 0x80}},
+};
+
+static const uint8_t *glyph(char c){
+	c = toupper((unsigned char)c);
+	if(c >= '0' && c <= '9'){
+		return &chip8_font[(c - '0') * 5];
+	}
+	if(c >= 'A' && c <= 'F'){
+		return &chip8_font[(c - 'A' + 10) * 5];
+	}
+	for(uint32_t i = 0; i < sizeof letters / sizeof letters[0]; i++){
+		if(letters[i].c == c){
+			return letters[i].rows;
+		}
+	}
+	return NULL; // space
+}
+
+void text_draw(uint32_t *pixels, uint32_t pitch, uint32_t x, uint32_t y, const char *text, uint32_t color){
+	for(; *text; text++, x += TEXT_ADVANCE){
+		const uint8_t *rows = glyph(*text);
+		if(!rows){
+			continue;
+		}
+
+		for(uint32_t row = 0; row < 5; row++){
+			for(uint32_t bit = 0; bit < 4; bit++){
+				if(rows[row] & (0x80 >> bit)){
+					pixels[(y + row)*pitch + x + bit] = color;
+				}
+			}
+		}
+	}
+}
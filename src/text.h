@@ -0,0 +1,18 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include "chip8.h"
+
+// Text in the 4x5 CHIP-8 font for the memory viewer and the HUD, drawn into a pixel buffer
+
+#define TEXT_ADVANCE 5 // pixels per character
+#define TEXT_LINE 6 // pixels per line
+
+/*
+Draw text with its top left corner at x, y. Digits, letters (upper case
+only, lower case is drawn as upper) and . - % / are drawn, other characters
+leave a space. Nothing is clipped, the text must fit.
+*/
+void text_draw(uint32_t *pixels, uint32_t pitch, uint32_t x, uint32_t y, const char *text, uint32_t color);
+
+#endif
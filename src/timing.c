@@ -0,0 +1,66 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include "timing.h"
+
+/*
+Approximate costs in machine cycles, from analyses of the original
+interpreter. Every instruction pays the fetch/decode overhead, skips pay
+extra when taken, and the memory loops scale with their operands.
+*/
+#define VIP_FETCH 68
+
+uint32_t vip_instruction_cycles(const chip8_t *chip8, const uint8_t V[16], bool skipped){
+	const instruction_t *inst = &chip8->inst;
+	const uint32_t skip = skipped ? 4 : 0;
+
+	switch((inst->opcode >> 12) & 0x0F){
+		case 0x00:
+			if(inst->NN == 0xE0) return VIP_FETCH + 3078; // clears 256 bytes of display memory
+			if(inst->NN == 0xEE) return VIP_FETCH + 10;
+			return VIP_FETCH + 10;
+
+		case 0x01: return VIP_FETCH + 12;
+		case 0x02: return VIP_FETCH + 26;
+		case 0x03:
+		case 0x04: return VIP_FETCH + 10 + skip;
+		case 0x05:
+		case 0x09: return VIP_FETCH + 14 + skip;
+		case 0x06: return VIP_FETCH + 6;
+		case 0x07: return VIP_FETCH + 10;
+		case 0x08: return VIP_FETCH + 44; // runs a generated 1802 arithmetic routine
+		case 0x0A: return VIP_FETCH + 12;
+		case 0x0B: return VIP_FETCH + 22;
+		case 0x0C: return VIP_FETCH + 36;
+
+		case 0x0D:{
+			// byte aligned sprites copy straight into display memory, the rest straddle two bytes.
+			// DFYN has already put the collision flag in VF, so the coordinate comes from before
+			const bool aligned = (V[inst->X] % 8) == 0;
+			return VIP_FETCH + 26 + inst->N * (aligned ? 34 : 46);
+		}
+
+		case 0x0E: return VIP_FETCH + 14 + skip;
+
+		case 0x0F:
+			switch(inst->NN){
+				case 0x07: return VIP_FETCH + 10;
+				case 0x0A: return VIP_FETCH + 19;
+				case 0x15: return VIP_FETCH + 10;
+				case 0x18: return VIP_FETCH + 10;
+				case 0x1E: return VIP_FETCH + 16;
+				case 0x29: return VIP_FETCH + 20;
+				case 0x33: return VIP_FETCH + 84 + 16 * (V[inst->X] / 100 + V[inst->X] / 10 % 10 + V[inst->X] % 10);
+				case 0x55:
+				case 0x65: return VIP_FETCH + 14 + 14 * (inst->X + 1);
+				default: return VIP_FETCH + 10;
+			}
+	}
+
+	return VIP_FETCH;
+}
+
+double host_ms(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
@@ -0,0 +1,22 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "chip8.h"
+
+/*
+COSMAC VIP timing. The 1.76MHz 1802 runs 8 clocks per machine cycle, so
+a 60Hz frame is about 3668 machine cycles, of which the display interrupt
+and its DMA take roughly 1000. What is left is the budget for the CHIP-8
+interpreter.
+*/
+#define VIP_CYCLES_PER_FRAME 3668
+#define VIP_DISPLAY_CYCLES 1024
+#define VIP_FRAME_BUDGET (VIP_CYCLES_PER_FRAME - VIP_DISPLAY_CYCLES)
+
+// Machine cycles the VIP interpreter spent on the instruction in chip8->inst, V holds the registers from before it ran
+uint32_t vip_instruction_cycles(const chip8_t *chip8, const uint8_t V[16], bool skipped);
+
+// Host monotonic clock in ms, for timing the emulator rather than the machine it emulates
+double host_ms(void);
+
+#endif
@@ -0,0 +1,132 @@
+#include "trace.h"
+
+// Writer thread, sleeps until a buffer is full
+static void *trace_thread(void *data){
+	trace_t *trace = data;
+
+	pthread_mutex_lock(&trace->lock);
+	while(true){
+		while(trace->written == trace->queued && !trace->stop){
+			pthread_cond_wait(&trace->changed, &trace->lock);
+		}
+		if(trace->written == trace->queued){
+			break;
+		}
+
+		const uint32_t buffer = trace->written % TRACE_BUFFERS;
+		pthread_mutex_unlock(&trace->lock);
+		fwrite(trace->buffers[buffer], sizeof(trace_record_t), trace->sizes[buffer], trace->file);
+		pthread_mutex_lock(&trace->lock);
+
+		trace->written++;
+		pthread_cond_broadcast(&trace->changed);
+	}
+	pthread_mutex_unlock(&trace->lock);
+	return NULL;
+}
+
+static void free_buffers(trace_t *trace){
+	for(uint32_t i = 0; i < TRACE_BUFFERS; i++){
+		free(trace->buffers[i]);
+	}
+}
+
+bool trace_open(trace_t *trace, const char *path){
+	*trace = (trace_t){0};
+
+	trace->file = fopen(path, "wb");
+	if(!trace->file){
+		fprintf(stderr, "could not open trace file %s\n", path);
+		return false;
+	}
+
+	bool allocated = true;
+	for(uint32_t i = 0; i < TRACE_BUFFERS; i++){
+		trace->buffers[i] = malloc(TRACE_RING_SIZE * sizeof(trace_record_t));
+		allocated &= trace->buffers[i] != NULL;
+	}
+	if(!allocated){
+		fprintf(stderr, "could not allocate trace buffer\n");
+		free_buffers(trace);
+		fclose(trace->file);
+		return false;
+	}
+	trace->ring = trace->buffers[0];
+
+	const trace_header_t header = {
+		.magic = TRACE_MAGIC,
+		.version = TRACE_VERSION,
+		.record_size = sizeof(trace_record_t),
+	};
+	fwrite(&header, sizeof header, 1, trace->file);
+
+	pthread_mutex_init(&trace->lock, NULL);
+	pthread_cond_init(&trace->changed, NULL);
+	if(pthread_create(&trace->thread, NULL, trace_thread, trace) != 0){
+		fprintf(stderr, "could not start the trace writer thread\n");
+		pthread_mutex_destroy(&trace->lock);
+		pthread_cond_destroy(&trace->changed);
+		free_buffers(trace);
+		fclose(trace->file);
+		return false;
+	}
+
+	return true;
+}
+
+void trace_flush(trace_t *trace){
+	if(trace->head == 0){
+		return;
+	}
+
+	pthread_mutex_lock(&trace->lock);
+	trace->sizes[trace->queued % TRACE_BUFFERS] = trace->head;
+	trace->queued++;
+	pthread_cond_broadcast(&trace->changed);
+
+	// the next buffer is still queued for writing
+	if(trace->queued - trace->written == TRACE_BUFFERS){
+		trace->stalls++;
+		while(trace->queued - trace->written == TRACE_BUFFERS){
+			pthread_cond_wait(&trace->changed, &trace->lock);
+		}
+	}
+	pthread_mutex_unlock(&trace->lock);
+
+	trace->ring = trace->buffers[trace->queued % TRACE_BUFFERS];
+	trace->head = 0;
+}
+
+void trace_close(trace_t *trace){
+	if(!trace->file){
+		return;
+	}
+
+	trace_flush(trace);
+	pthread_mutex_lock(&trace->lock);
+	trace->stop = true;
+	pthread_cond_broadcast(&trace->changed);
+	pthread_mutex_unlock(&trace->lock);
+	pthread_join(trace->thread, NULL);
+
+	pthread_mutex_destroy(&trace->lock);
+	pthread_cond_destroy(&trace->changed);
+	fclose(trace->file);
+	free_buffers(trace);
+
+	fprintf(stderr, "traced %llu instructions, waited for the writer %llu times\n",
+		(unsigned long long)trace->count, (unsigned long long)trace->stalls);
+	*trace = (trace_t){0};
+}
+
+bool trace_read_header(FILE *file){
+	trace_header_t header;
+
+	if(fread(&header, sizeof header, 1, file) != 1){
+		return false;
+	}
+
+	return header.magic == TRACE_MAGIC &&
+		header.version == TRACE_VERSION &&
+		header.record_size == sizeof(trace_record_t);
+}
@@ -0,0 +1,79 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+#include "chip8.h"
+
+#define TRACE_MAGIC 0x54384843 // "CH8T"
+#define TRACE_VERSION 1
+#define TRACE_RING_SIZE (1 << 16) // records per buffer, power of 2
+#define TRACE_BUFFERS 4 // buffers filled by the emulator while the writer thread drains full ones
+
+// One fixed-size record per executed instruction
+typedef struct {
+	uint16_t PC; // address the opcode was fetched from
+	uint16_t opcode;
+	uint16_t I; // I after execution
+	uint16_t changed; // bit n set if Vn was changed by this instruction
+	uint8_t V[16]; // V0-VF after execution
+} trace_record_t;
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+} trace_header_t;
+
+/*
+A full buffer is handed to a writer thread, and the emulator carries on
+in the next one. It only waits when every buffer is full, the disk being
+slower than the interpreter for TRACE_BUFFERS * TRACE_RING_SIZE records;
+records are never dropped.
+*/
+struct trace {
+	trace_record_t *buffers[TRACE_BUFFERS];
+	uint32_t sizes[TRACE_BUFFERS]; // records in each full buffer
+	trace_record_t *ring; // buffer being filled
+	uint32_t head; // next free slot in ring
+	uint64_t count; // total records traced
+	uint64_t stalls; // times the emulator waited for the writer
+	FILE *file;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	uint64_t queued; // buffers handed to the writer, under lock
+	uint64_t written; // buffers the writer is done with, under lock
+	bool stop;
+};
+
+bool trace_open(trace_t *trace, const char *path);
+
+// Hand the buffer being filled to the writer thread
+void trace_flush(trace_t *trace);
+
+void trace_close(trace_t *trace);
+
+// Append a record for the instruction just executed, called from the interpreter loop
+static inline void trace_record(trace_t *trace, const chip8_t *chip8, uint16_t pc, const uint8_t old_V[16]){
+	trace_record_t *rec = &trace->ring[trace->head];
+
+	rec->PC = pc;
+	rec->opcode = chip8->inst.opcode;
+	rec->I = chip8->I;
+	rec->changed = 0;
+	for(uint8_t i = 0; i < 16; i++){
+		rec->V[i] = chip8->V[i];
+		rec->changed |= (uint16_t)(old_V[i] != chip8->V[i]) << i;
+	}
+
+	trace->count++;
+	if(++trace->head == TRACE_RING_SIZE){
+		trace_flush(trace);
+	}
+}
+
+// Read the header of a trace file and check it matches this build
+bool trace_read_header(FILE *file);
+
+#endif
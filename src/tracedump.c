@@ -0,0 +1,93 @@
+#include "chip8.h"
+#include "debug.h"
+#include "instructions.h"
+#include "trace.h"
+
+// Offline decoder for traces written with --trace
+
+/*
+usage: tracedump <trace-file> [--pc START END] [--op OPCODE MASK]
+
+--pc	only show instructions fetched from START..END (inclusive, hex)
+--op	only show instructions where (opcode & MASK) == OPCODE (hex)
+*/
+
+int main(int argc, char **argv){
+	if(argc < 2){
+		printf("usage: %s <trace-file> [--pc START END] [--op OPCODE MASK]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	// Filters
+	uint16_t pc_start = 0x000, pc_end = 0xFFF;
+	uint16_t op_value = 0x0000, op_mask = 0x0000;
+
+	for(int i = 2; i < argc; i++){
+		if(strcmp(argv[i], "--pc") == 0 && i + 2 < argc){
+			pc_start = strtoul(argv[++i], NULL, 16);
+			pc_end = strtoul(argv[++i], NULL, 16);
+		}
+		else if(strcmp(argv[i], "--op") == 0 && i + 2 < argc){
+			op_value = strtoul(argv[++i], NULL, 16);
+			op_mask = strtoul(argv[++i], NULL, 16);
+		}
+		else{
+			printf("unknown option %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	FILE *file = fopen(argv[1], "rb");
+	if(!file){
+		printf("could not open %s\n", argv[1]);
+		exit(EXIT_FAILURE);
+	}
+
+	if(!trace_read_header(file)){
+		printf("%s is not a trace file from this version\n", argv[1]);
+		exit(EXIT_FAILURE);
+	}
+
+	// Machine state is rebuilt from the records so descriptions see
+	// the registers as they were before each instruction ran: each record
+	// starts from the one before it, and the trace from a reset machine
+	chip8_t chip8 = {0};
+	trace_record_t rec;
+	uint64_t index = 0;
+	bool first = true;
+
+	while(fread(&rec, sizeof rec, 1, file) == 1){
+		if(first){
+			// registers the first instruction didn't change already hold their old value, the rest were 0
+			for(uint8_t i = 0; i < 16; i++){
+				chip8.V[i] = rec.changed & (1 << i) ? 0 : rec.V[i];
+			}
+			first = false;
+		}
+
+		if(rec.PC >= pc_start && rec.PC <= pc_end && (rec.opcode & op_mask) == op_value){
+			decode_instruction(&chip8.inst, rec.opcode);
+			chip8.PC = rec.PC + 2; // skips and branches are described from the next instruction, as when executing
+
+			printf("#%llu ", (unsigned long long)index);
+			fprint_debug_output(stdout, &chip8, rec.PC);
+
+			// Registers written by this instruction
+			printf("    I=0x%03X", rec.I);
+			for(uint8_t i = 0; i < 16; i++){
+				if(rec.changed & (1 << i)){
+					printf(" V%X=0x%02X", i, rec.V[i]);
+				}
+			}
+			printf("\n");
+		}
+
+		memcpy(chip8.V, rec.V, sizeof chip8.V);
+		chip8.I = rec.I;
+		index++;
+	}
+
+	fclose(file);
+
+	exit(EXIT_SUCCESS);
+}
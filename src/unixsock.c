@@ -0,0 +1,56 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "unixsock.h"
+
+int unixsock_listen(const char *path, int backlog, const char *what){
+	struct sockaddr_un address = {.sun_family = AF_UNIX};
+	if(strlen(path) >= sizeof address.sun_path){
+		fprintf(stderr, "%s socket path %s is too long\n", what, path);
+		return -1;
+	}
+	strcpy(address.sun_path, path);
+
+	// a socket left by an earlier run is replaced, anything else is not touched
+	struct stat st;
+	if(lstat(path, &st) == 0){
+		if(!S_ISSOCK(st.st_mode)){
+			fprintf(stderr, "%s exists and is not a socket\n", path);
+			return -1;
+		}
+		unlink(path);
+	}
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	const bool bound = fd >= 0 && bind(fd, (struct sockaddr *)&address, sizeof address) == 0;
+	if(!bound || listen(fd, backlog) != 0){
+		fprintf(stderr, "could not listen on %s socket %s\n", what, path);
+		if(fd >= 0){
+			close(fd);
+		}
+		if(bound){
+			unlink(path);
+		}
+		return -1;
+	}
+	return fd;
+}
+
+void unixsock_close(int *listen_fd, int wake[2], const char *path){
+	if(*listen_fd >= 0){
+		close(*listen_fd);
+		unlink(path);
+	}
+	for(uint32_t i = 0; i < 2; i++){
+		if(wake[i] >= 0){
+			close(wake[i]);
+		}
+	}
+	*listen_fd = wake[0] = wake[1] = -1;
+}
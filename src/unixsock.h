@@ -0,0 +1,16 @@
+#ifndef UNIXSOCK_H
+#define UNIXSOCK_H
+
+/*
+Unix sockets for the threads that serve local clients, the metrics
+exporter and the remote debugger. Each pairs its listening socket with a
+wake pipe that it polls alongside, a byte in the pipe stops the thread.
+*/
+
+// Listen on path, what names the socket in errors. The descriptor, or -1
+int unixsock_listen(const char *path, int backlog, const char *what);
+
+// Close the listening socket and remove its path, then the wake pipe. Either may already be -1
+void unixsock_close(int *listen_fd, int wake[2], const char *path);
+
+#endif
@@ -0,0 +1,121 @@
+#include "viewer.h"
+#include "text.h"
+
+#define HEATMAP_SIDE 64 // addresses per heatmap row and rows
+#define TEXT_X 68 // left edge of the register panel
+#define TEXT_COLOR 0xFFFFFFFF
+#define DIM_COLOR 0x606060FF
+
+// Text line at column x, row line
+static void draw_text(uint32_t *pixels, uint32_t pitch, uint32_t x, uint32_t line, const char *text, uint32_t color){
+	text_draw(pixels, pitch, x, line*TEXT_LINE + 1, text, color);
+}
+
+// Counter to color channel, log scale so one access still shows
+static uint32_t heat(uint32_t count){
+	if(count == 0){
+		return 0;
+	}
+	const uint32_t level = 40 + 20 * (32 - __builtin_clz(count));
+	return level > 255 ? 255 : level;
+}
+
+bool viewer_open(viewer_t *viewer, chip8_t *chip8){
+	*viewer = (viewer_t){0};
+
+	viewer->heatmap = calloc(1, sizeof(heatmap_t));
+	if(!viewer->heatmap){
+		SDL_Log("could not allocate heatmap\n");
+		return false;
+	}
+
+	viewer->window = SDL_CreateWindow("CHIP-8 Memory", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, VIEWER_WIDTH * VIEWER_SCALE, VIEWER_HEIGHT * VIEWER_SCALE, 0);
+	if(!viewer->window){
+		SDL_Log("could not create viewer window %s\n", SDL_GetError());
+		return false;
+	}
+	SDL_SetWindowData(viewer->window, "viewer", viewer); // closing it only hides it
+
+	viewer->renderer = SDL_CreateRenderer(viewer->window, -1, SDL_RENDERER_ACCELERATED);
+	if(!viewer->renderer){
+		SDL_Log("could not create viewer renderer %s\n", SDL_GetError());
+		return false;
+	}
+
+	viewer->texture = SDL_CreateTexture(viewer->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, VIEWER_WIDTH, VIEWER_HEIGHT);
+	if(!viewer->texture){
+		SDL_Log("could not create viewer texture %s\n", SDL_GetError());
+		return false;
+	}
+
+	chip8->heatmap = viewer->heatmap;
+	return true;
+}
+
+void viewer_update(viewer_t *viewer, const chip8_t *chip8){
+	const heatmap_t *heatmap = viewer->heatmap;
+
+	if(!(SDL_GetWindowFlags(viewer->window) & SDL_WINDOW_HIDDEN)){
+		void *locked;
+		int pitch_bytes;
+		if(SDL_LockTexture(viewer->texture, NULL, &locked, &pitch_bytes) != 0){
+			SDL_Log("could not lock viewer texture %s\n", SDL_GetError());
+			return;
+		}
+		uint32_t *pixels = locked;
+		const uint32_t pitch = pitch_bytes / sizeof(uint32_t);
+
+		for(uint32_t y = 0; y < VIEWER_HEIGHT; y++){
+			memset(&pixels[y*pitch], 0, VIEWER_WIDTH * sizeof(uint32_t));
+		}
+
+		// Heatmap, one pixel per address
+		for(uint32_t address = 0; address < CHIP8_RAM_SIZE; address++){
+			uint32_t color = heat(heatmap->write[address]) << 24 | heat(heatmap->read[address]) << 16 | heat(heatmap->exec[address]) << 8 | 0xFF;
+			if(address == (chip8->PC & CHIP8_RAM_MASK)){
+				color = TEXT_COLOR;
+			}
+			pixels[(address / HEATMAP_SIDE)*pitch + address % HEATMAP_SIDE] = color;
+		}
+
+		// Registers
+		char text[32];
+		for(uint32_t i = 0; i < 16; i += 2){
+			snprintf(text, sizeof text, "V%X %02X V%X %02X", i, chip8->V[i], i + 1, chip8->V[i + 1]);
+			draw_text(pixels, pitch, TEXT_X, i / 2, text, TEXT_COLOR);
+		}
+		snprintf(text, sizeof text, "I %03X PC %03X", chip8->I, chip8->PC);
+		draw_text(pixels, pitch, TEXT_X, 8, text, TEXT_COLOR);
+		snprintf(text, sizeof text, "SP %X DT %02X", chip8->SP, chip8->delay_timer);
+		draw_text(pixels, pitch, TEXT_X, 9, text, TEXT_COLOR);
+		snprintf(text, sizeof text, "ST %02X", chip8->sound_timer);
+		draw_text(pixels, pitch, TEXT_X, 10, text, TEXT_COLOR);
+
+		// Stack, entries above SP dimmed
+		for(uint32_t i = 0; i < CHIP8_STACK_DEPTH; i++){
+			snprintf(text, sizeof text, "%03X", chip8->stack[i] & CHIP8_RAM_MASK);
+			draw_text(pixels, pitch, TEXT_X + (i % 4) * 20, 11 + i / 4, text, i < chip8->SP ? TEXT_COLOR : DIM_COLOR);
+		}
+
+		SDL_UnlockTexture(viewer->texture);
+		SDL_RenderCopy(viewer->renderer, viewer->texture, NULL, NULL);
+		SDL_RenderPresent(viewer->renderer);
+	}
+
+	heatmap_decay(viewer->heatmap);
+}
+
+void viewer_close(viewer_t *viewer, chip8_t *chip8){
+	if(!viewer->heatmap){
+		return; // never opened
+	}
+
+	if(chip8->heatmap == viewer->heatmap){
+		chip8->heatmap = NULL;
+	}
+	free(viewer->heatmap);
+	SDL_DestroyTexture(viewer->texture);
+	SDL_DestroyRenderer(viewer->renderer);
+	SDL_DestroyWindow(viewer->window);
+	*viewer = (viewer_t){0};
+}
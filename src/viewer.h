@@ -0,0 +1,31 @@
+#ifndef VIEWER_H
+#define VIEWER_H
+
+#include "frontend.h"
+#include "heatmap.h"
+
+/*
+Second window for tuning ROMs: the 4 KB address space as a 64x64 heatmap
+(red = written, green = read, blue = executed, white = PC) next to the
+registers, timers and stack, redrawn every frame.
+*/
+#define VIEWER_WIDTH 150
+#define VIEWER_HEIGHT 84
+#define VIEWER_SCALE 4
+
+typedef struct {
+	SDL_Window *window;
+	SDL_Renderer *renderer;
+	SDL_Texture *texture;
+	heatmap_t *heatmap;
+} viewer_t;
+
+// Open the window and attach a heatmap to the machine, call after init_sdl
+bool viewer_open(viewer_t *viewer, chip8_t *chip8);
+
+// Redraw from the machine, then fade the counters
+void viewer_update(viewer_t *viewer, const chip8_t *chip8);
+
+void viewer_close(viewer_t *viewer, chip8_t *chip8);
+
+#endif